@@ -1,4 +1,3 @@
-#include <AccelStepper.h>
 #include "Axis.h"
 #include <avr/io.h>
 #include <avr/interrupt.h>
@@ -6,6 +5,7 @@
 // Define default speeds in mm/s
 #define HOMING_SPEED 15
 #define PROBE_SPEED 8
+#define PROBE_SLOW_SPEED 0.5
 #define MOVE_SPEED 20
 #define PLUNGE_SPEED 4
 #define ACCELERATION 100
@@ -14,25 +14,159 @@
 #define MAX_HOME_DISTANCE 120.0
 #define MAX_PROBE_DISTANCE 120.0
 #define BACKOFF_DISTANCE 3.0
+#define PROBE_APPROACH_DISTANCE 6.0  // Slow approach without a touch that ends probing in ERROR
 
-AccelStepper* stepperPtr = nullptr; // Globaler Zeiger auf das Stepper-Objekt
-volatile bool stepperRunning = false; // Flag zur Steuerung des ISR-Aufrufs
-float desired_step_frequency;
+// Multi-touch probing in mm
+#define PROBE_RETRACT_DISTANCE 0.5   // Initial retract between touches
+#define PROBE_RETRACT_MARGIN 0.05    // Added to the observed release distance
+#define PROBE_OUTLIER_TOLERANCE 0.05 // Max deviation of a touch from the median
+
+// Distance from home in mm within which the minimum endstop stops a move without a fault
+#define HOME_TOLERANCE 1.0
+
+// Axis state of the step trace before the first record of a capture
+#define TRACE_UNKNOWN 0xFF
+
+// Height above home in mm a restored position is approached at move speed before the slow touch
+#define RESUME_APPROACH 1.0
+
+// Travel in mm of the slow homing touch beyond the expected switch position before it gives up
+#define TOUCH_TOLERANCE 0.5
+
+// Position encoder checks in mm
+#define FOLLOWING_ERROR_LIMIT 0.5    // Following error that counts as step loss
+#define CORRECTION_TOLERANCE 0.02    // Remaining error corrected at the end of a move
+#define MAX_CORRECTIONS 3            // Correction moves per move
+
+// Count change by the previous and the new channel levels, (B << 1 | A) << 2 | previous.
+// Both channels changed means a missed edge, guessed as two like the Encoder library does;
+// the guess may be off by four, so such transitions are counted in scaleErrors.
+static const int8_t quadratureSteps[16] = {0, 1, -1, 2, -1, 0, -2, 1, 1, -2, 0, -1, 2, -1, 1, 0};
+
+// Lead screw calibration in mm
+#define CALIBRATION_APPROACH 1.0     // Calibration points are approached from this far above
+#define CALIBRATION_BACKLASH_MOVE 1.0 // Move up that shows the backlash
+
+static int16_t clampInt16(long value) {
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return value;
+}
+
+Axis* Axis::limitAxes[FASTSTEPPER_MAX_AXES];
+uint8_t Axis::limitAxisCount = 0;
+
+// The endstops stop the steppers right in their pin change interrupt, independent of
+// the main loop. AVR interrupts do not nest: the pin change vector only wins over a
+// Timer1 step interrupt that is pending at the same time, an edge right after a step
+// interrupt started waits for all of it, the rest of its pulses with their gaps, the
+// followers and the next interval. So the latency is bounded by one whole step
+// interrupt (with 4 pulses per event and one axis about 200 us) plus the entry of the
+// pin change interrupt, and up to 3 pulses still go out after the edge. With hardware
+// pulses the timer output is cut when the stepper is halted. The driver is disabled
+// first, so the simavr trace shows the latency as ENDSTOP_* to ENABLE.
+// The position encoders are decoded in the same interrupt; an edge waits for a
+// running step interrupt too, so their edges must be at least one step interrupt
+// (about 200 us) apart. Two edges within that time show both channels changed, the
+// count is guessed and no longer trusted: the transition is counted and the axis
+// makes no more corrections from the encoder until it is homed again.
+// The probe edge halts an armed probing move in the same interrupt and latches its
+// position, handle() only takes the latched touch, so the loop time is not in it.
+// test_estop measures a run into the max endstop at 20 mm/s on the env:native model:
+// 27 us to ENABLE, 2 us to the end of the last pulse, no pulse after the stop; with
+// the edge on the first pulse of a 4 pulse event 39 us and 3 more pulses. That model
+// charges a flat 12.5 us per interrupt body and only the pulse delays of the step
+// interrupt, not its computation, so the AVR bound above still holds;
+// tools/simavr/scenarios/estop.txt checks the same run on the real instruction timing.
+ISR(PCINT0_vect) {
+    Axis::handleLimitInterrupt();
+}
+
+ISR(PCINT1_vect) {
+    Axis::handleLimitInterrupt();
+}
+
+ISR(PCINT2_vect) {
+    Axis::handleLimitInterrupt();
+}
 
 Axis::Axis(int stepPin, int dirPin, int enablePin, float stepsPerRev, float microsteps, float spindleLead, float minPos, float maxPos, int endstopMin, int endstopMax, int probe) 
-    : stepper(AccelStepper::DRIVER, stepPin, dirPin) {
+    : stepper(FastStepper::DRIVER, stepPin, dirPin) {
     
-    this->stepsPerRevolution = stepsPerRev;
-    this->microsteps = microsteps;
-    this->spindleLead = spindleLead;
+    this->stepsPerMM = stepsPerRev * microsteps / spindleLead;
+    this->mmPerStep = spindleLead / (stepsPerRev * microsteps);
     this->minPosition = mmToSteps(minPos);
     this->maxPosition = mmToSteps(maxPos);
     this->workOffset = 0.0;
     this->endstopMinPin = endstopMin;
     this->endstopMaxPin = endstopMax;
     this->probingPin = probe;
+    this->enablePort = portOutputRegister(digitalPinToPort(enablePin));
+    this->enableMask = digitalPinToBitMask(enablePin);
+    this->endstopMinIn = portInputRegister(digitalPinToPort(endstopMin));
+    this->endstopMaxIn = portInputRegister(digitalPinToPort(endstopMax));
+    this->endstopMinMask = digitalPinToBitMask(endstopMin);
+    this->endstopMaxMask = digitalPinToBitMask(endstopMax);
+    this->probeIn = portInputRegister(digitalPinToPort(probe));
+    this->probeMask = digitalPinToBitMask(probe);
+    this->homeTolerance = mmToSteps(HOME_TOLERANCE);
+    this->slowLimit = 0;
+    this->resuming = false;
+    this->fault = false;
+    this->scaleInA = nullptr;
+    this->scaleInB = nullptr;
+    this->scaleMaskA = 0;
+    this->scaleMaskB = 0;
+    this->scaleState = 0;
+    this->scaleCount = 0;
+    this->scaleErrors = 0;
+    this->scaleStepsPerCount = 1.0;
+    this->scaleZero = 0;
+    this->followingLimit = 0;
+    this->correctionTolerance = 0;
+    this->followingError = 0;
+    this->stepLoss = false;
+    this->corrections = 0;
+    this->moveSpeed = MOVE_SPEED;
+    this->feedOverride = 100;
+    this->targetMove = false;
+    memset(&this->calibration, 0, sizeof(this->calibration));
+    this->calibrationWork = this->calibration;
+    // The pitch map leaves room to approach its points from above and below
+    long pitchOrigin = static_cast<long>(minPosition) + mmToSteps(CALIBRATION_APPROACH);
+    long pitchSpacing = (static_cast<long>(maxPosition) - mmToSteps(CALIBRATION_APPROACH) - pitchOrigin) / (PITCH_MAP_POINTS - 1);
+    this->pitchMap = PitchMap(pitchOrigin, pitchSpacing);
+    this->lastDirection = -1;
+    this->plannedPos = 0;
+    this->calibrationStep = -1;
+    this->calibrationApproach = false;
+    this->calibrationTarget = 0;
+    this->calibrationNominal = 0;
     this->homingState = NOT_HOMED;
     this->probingState = FINISHED;
+    this->probeTouches = 1;
+    this->probeCount = 0;
+    this->probeRetract = mmToSteps(PROBE_RETRACT_DISTANCE);
+    this->probeReleased = false;
+    this->probeApproach = false;
+    this->probeFastTrigger = 0;
+    this->probeFastTouch = false;
+    this->probeArmed = false;
+    this->probeLatched = false;
+    this->probeLatch = 0;
+    this->probeFastSpeed = PROBE_SPEED;
+    this->probeSlowSpeed = PROBE_SLOW_SPEED;
+    this->probeStats.touches = 0;
+    this->probeStats.rejected = 0;
+    this->probeStats.mean = 0.0;
+    this->probeStats.spread = 0.0;
+    this->probeStats.fastTrigger = 0.0;
+    this->probeStats.approached = false;
+    this->sensorOverride = 0;
+    this->sensorValues = 0;
+    this->tracedState = TRACE_UNKNOWN;
+    this->tracedHoming = NOT_HOMED;
+    this->tracedProbing = FINISHED;
 
     pinMode(endstopMinPin, INPUT_PULLUP);
     pinMode(endstopMaxPin, INPUT_PULLUP);
@@ -43,37 +177,36 @@ Axis::Axis(int stepPin, int dirPin, int enablePin, float stepsPerRev, float micr
     stepper.setMaxSpeed(1000);
     stepper.setAcceleration(mmToSteps(ACCELERATION));
     stepper.setCurrentPosition(0);
-    stepper.moveTo(0);
-
-    stepperPtr = &stepper; // Zeiger auf das Stepper-Objekt setzen
-    stepperRunning = true; // Initial Flag to true
 
-//    setupTimer();
+    if (limitAxisCount < FASTSTEPPER_MAX_AXES) {
+        limitAxes[limitAxisCount++] = this;
+    }
 }
 
-void Axis::setupTimer() {
-    // Berechnung der desired_step_frequency basierend auf MOVE_SPEED
-    desired_step_frequency = (MOVE_SPEED * stepsPerRevolution * microsteps) * 2 / spindleLead;
+bool Axis::begin(bool hardwarePulses) {
+    // Watch both endstops and the probe with pin change interrupts
+    *digitalPinToPCMSK(endstopMinPin) |= (1 << digitalPinToPCMSKbit(endstopMinPin));
+    *digitalPinToPCMSK(endstopMaxPin) |= (1 << digitalPinToPCMSKbit(endstopMaxPin));
+    *digitalPinToPCMSK(probingPin) |= (1 << digitalPinToPCMSKbit(probingPin));
+    *digitalPinToPCICR(endstopMinPin) |= (1 << digitalPinToPCICRbit(endstopMinPin));
+    *digitalPinToPCICR(endstopMaxPin) |= (1 << digitalPinToPCICRbit(endstopMaxPin));
+    *digitalPinToPCICR(probingPin) |= (1 << digitalPinToPCICRbit(probingPin));
 
-    // Set Timer1 to CTC mode
-    TCCR1A = 0;
-    TCCR1B = (1 << WGM12) | (1 << CS11);  // CTC mode, prescaler 8
+    // Timer1 is reset by the Arduino core after global constructors ran
+    return stepper.begin(hardwarePulses);
+}
 
-    // Set OCR1A for desired frequency
-    OCR1A = (F_CPU / 8 / desired_step_frequency) - 1;
+void Axis::handle() {
+    bool endstopMin, endstopMax, probe;
 
-    // Enable Timer1 compare interrupt
-    TIMSK1 = (1 << OCIE1A);
-}
+    traceStates();
 
-ISR(TIMER1_COMPA_vect) {
-    if (stepperRunning && stepperPtr) {
-//        stepperPtr->run();
+    // Nothing moves until the fault is cleared by homing
+    if (fault) {
+        stepper.halt();
+        return;
     }
-}
 
-void Axis::handle() {
-    bool endstopMin, endstopMax, probe;
     // Check endstops
     endstopMin = getEndstopMin();
     endstopMax = getEndstopMax();
@@ -96,8 +229,6 @@ void Axis::handle() {
             case MOVE_FAST:
                 if (endstopMin && stepper.isRunning()) {
                     stepper.setCurrentPosition(0);
-                    stepper.moveTo(0);
-                    stepper.setSpeed(0);
                 } else if (endstopMin && !stepper.isRunning()) {
                     homingState = BACKOFF;
                     stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
@@ -108,21 +239,43 @@ void Axis::handle() {
                 break;
             case BACKOFF:
                 if (!endstopMin && !stepper.isRunning()) {
-                    homingState = MOVE_SLOW;
+                    startSlowTouch(BACKOFF_DISTANCE);
                 } else if (!stepper.isRunning()) {
                     homingState = ERROR;
                 }
                 break;
+            case VERIFY:
+                if (endstopMin) {
+                    // Lower than the saved position: back off and touch as in homing
+                    resuming = false;
+                    homingState = BACKOFF;
+                    stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
+                    stepper.move(mmToSteps(BACKOFF_DISTANCE));
+                } else if (!stepper.isRunning()) {
+                    // One slow move to the switch, stopped by the endstop interrupt
+                    startSlowTouch(RESUME_APPROACH);
+                    stepper.moveTo(slowLimit);
+                }
+                break;
             case MOVE_SLOW:
                 if (!endstopMin && !stepper.isRunning()) {
-                    stepper.setMaxSpeed(mmToSteps(HOMING_SPEED / 2));
-                    stepper.move(-1);
+                    if (stepper.currentPosition() <= slowLimit) {
+                        // No switch where it should be: a wrong restored position
+                        // gets a full homing, a normal homing ends in an error
+                        homingState = resuming ? NOT_HOMED : ERROR;
+                        resuming = false;
+                    } else {
+                        stepper.setMaxSpeed(mmToSteps(HOMING_SPEED / 2));
+                        stepper.move(-1);
+                    }
                 } else if (endstopMin) {
                     homingState = FINISHED;
+                    resuming = false;
                     targetPos = 0;
+                    plannedPos = 0;
+                    lastDirection = -1;
                     stepper.setCurrentPosition(0);
-                    stepper.moveTo(0);
-                    stepper.setSpeed(0);
+                    if (scaleInA) zeroScale(0);
                 }
                 break;
             default:
@@ -135,20 +288,26 @@ void Axis::handle() {
         switch (probingState) {
             case NOT_HOMED:
                 if (probe) {
+                    // Already on the probe: no fast approach to measure
                     probingState = BACKOFF;
+                    probeFastTrigger = stepper.currentPosition();
+                    probeFastTouch = false;
                     stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
                     stepper.move(mmToSteps(-BACKOFF_DISTANCE));
                 } else {
                     probingState = MOVE_FAST;
-                    stepper.setMaxSpeed(mmToSteps(PROBE_SPEED));
+                    stepper.setMaxSpeed(mmToSteps(probeFastSpeed));
                     stepper.move(mmToSteps(MAX_PROBE_DISTANCE));
+                    armProbe();
                 }
                 break;
             case MOVE_FAST:
-                if (probe && stepper.isRunning()) {
-                    stepper.moveTo(stepper.currentPosition());
-                    stepper.setSpeed(0);
+                // The interrupt halted the approach on the probe edge
+                if (takeProbeTouch(probeFastTrigger)) {
+                    probeFastTouch = true;
+                    StepTrace::trigger(STEPTRACE_TRIGGER_PROBE);
                 } else if (!stepper.isRunning()) {
+                    probeArmed = false;
                     probingState = BACKOFF;
                     stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
                     stepper.move(mmToSteps(-BACKOFF_DISTANCE));
@@ -162,16 +321,49 @@ void Axis::handle() {
                 }
                 break;
             case MOVE_SLOW:
-                if (!probe && !stepper.isRunning()) {
-                    stepper.setMaxSpeed(mmToSteps(HOMING_SPEED / 2));
-                    stepper.move(1);
-                } else if (probe) {
-                    probingState = FINISHED;
-                    stepper.moveTo(stepper.currentPosition());
-                    stepper.setSpeed(0);
-                    stepper.stop();
-                    workOffset = stepper.currentPosition();
-                    targetPos = workOffset;
+                // Touches are latched with the position of the probe edge, the loop
+                // time does not add to the samples
+                if (takeProbeTouch(probeSamples[probeCount])) {
+                    probeCount++;
+                    probeApproach = false;
+                    StepTrace::trigger(STEPTRACE_TRIGGER_PROBE);
+                    if (probeCount >= probeTouches) {
+                        finishProbing();
+                    } else {
+                        probingState = RETRACT;
+                        probeReleased = false;
+                        stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
+                        stepper.move(-probeRetract);
+                    }
+                } else if (!stepper.isRunning()) {
+                    if (probeApproach) {
+                        // The whole approach without a touch
+                        probeApproach = false;
+                        probeArmed = false;
+                        probingState = ERROR;
+                    } else {
+                        probeApproach = true;
+                        stepper.setMaxSpeed(mmToSteps(probeSlowSpeed));
+                        stepper.move(mmToSteps(PROBE_APPROACH_DISTANCE));
+                        armProbe();
+                    }
+                }
+                break;
+            case RETRACT:
+                if (!probe && !probeReleased) {
+                    // Tune the next retract to the distance the probe needed to release
+                    probeReleased = true;
+                    probeRetract = probeSamples[probeCount - 1] - stepper.currentPosition() + mmToSteps(PROBE_RETRACT_MARGIN);
+                }
+                if (!stepper.isRunning()) {
+                    if (probeReleased) {
+                        probingState = MOVE_SLOW;
+                    } else if (probeRetract < mmToSteps(BACKOFF_DISTANCE)) {
+                        probeRetract *= 2;
+                        stepper.move(-probeRetract);
+                    } else {
+                        probingState = ERROR;
+                    }
                 }
                 break;
             default:
@@ -179,35 +371,69 @@ void Axis::handle() {
         }
     }
 
-    // Calculate if travel is allowed
+    // The planned move ended, corrections and other moves keep their own speed
+    if (targetMove && !stepper.isRunning()) targetMove = false;
+
+    if (scaleInA && homingState == FINISHED) {
+        checkFollowing();
+    }
+
+    // Calibration points are approached from above, then the point itself is the target
+    if (calibrationApproach && !stepper.isRunning()) {
+        calibrationApproach = false;
+        stepper.moveTo(calibrationTarget);
+    }
+
+    // Calculate if travel is allowed, the step timer keeps stepping until we halt
     if (homingState == FINISHED && endstopMin && stepper.distanceToGo() < 0) {
-        stepperRunning = false;
+        stepper.halt();
         return;
     } else if (homingState == FINISHED && endstopMax && stepper.distanceToGo() > 0) {
-        stepperRunning = false;
+        stepper.halt();
         return;
     } else if (homingState == ERROR) {
-        stepperRunning = false;
+        stepper.halt();
         return;
     } else if (probingState == ERROR) {
-        stepperRunning = false;
+        stepper.halt();
         return;
     }
 
-    stepperRunning = true; // Allow the ISR to call stepper.run()
     stepper.run();
 }
 
 bool Axis::getEndstopMax() {
-    return digitalRead(endstopMaxPin);
+    if (sensorOverride & SENSOR_ENDSTOP_MAX) return sensorValues & SENSOR_ENDSTOP_MAX;
+    return *endstopMaxIn & endstopMaxMask;
 }
 
 bool Axis::getEndstopMin() {
-    return digitalRead(endstopMinPin);
+    if (sensorOverride & SENSOR_ENDSTOP_MIN) return sensorValues & SENSOR_ENDSTOP_MIN;
+    return *endstopMinIn & endstopMinMask;
 }
 
 bool Axis::getProbe() {
-    return !digitalRead(probingPin);
+    if (sensorOverride & SENSOR_PROBE) return sensorValues & SENSOR_PROBE;
+    return !(*probeIn & probeMask);
+}
+
+uint8_t Axis::getSensors() {
+    uint8_t sensors = 0;
+    if (getEndstopMin()) sensors |= SENSOR_ENDSTOP_MIN;
+    if (getEndstopMax()) sensors |= SENSOR_ENDSTOP_MAX;
+    if (getProbe()) sensors |= SENSOR_PROBE;
+    return sensors;
+}
+
+void Axis::overrideSensors(uint8_t mask, uint8_t values) {
+    if (mask == sensorOverride && values == sensorValues) return;
+    uint8_t oldSREG = SREG;
+    cli();
+    sensorValues = values;
+    sensorOverride = mask;
+    // Overridden endstops change without a pin change interrupt, check them like one
+    handleLimitInterrupt();
+    SREG = oldSREG;
 }
 
 bool Axis::inPosition() {
@@ -219,11 +445,12 @@ bool Axis::isHomed() {
 }
 
 bool Axis::isError() {
-    return homingState == ERROR || probingState == ERROR || getEndstopMax() || getEndstopMin();
+    return fault || homingState == ERROR || probingState == ERROR || getEndstopMax() || getEndstopMin();
 }
 
 AxisState Axis::getState() {
-    if (homingState != FINISHED) return MOVE_TO_HOME;
+    if (fault) return FAULT;
+    else if (homingState != FINISHED) return MOVE_TO_HOME;
     else if (probingState != FINISHED) return MOVE_TO_PROBE;
     else if (homingState == FINISHED && getEndstopMax()) return MAX_REACHED;
     else if (homingState == FINISHED && getEndstopMin()) return MIN_REACHED;
@@ -240,16 +467,401 @@ HomingState Axis::getProbingState() {
     return probingState;
 }
 
+bool Axis::isFault() {
+    return fault;
+}
+
+void Axis::setDriverEnabled(bool enabled) {
+    uint8_t oldSREG = SREG;
+    cli();
+    // The driver is enabled by a low level
+    if (enabled && !fault) *enablePort &= ~enableMask;
+    else *enablePort |= enableMask;
+    SREG = oldSREG;
+}
+
 void Axis::homing() {
     homingState = NOT_HOMED;
+    resuming = false;
+    targetMove = false;
     probingState = FINISHED;
+    probeArmed = false;
+    if (fault) {
+        // The position is lost after an emergency stop, so only homing clears it
+        fault = false;
+        setDriverEnabled(true);
+    }
+}
+
+void Axis::resume(long position, long offset) {
+    if (fault || homingState != NOT_HOMED) return;
+    // Only the last millimeter to the home switch is done slowly, in one move that
+    // the switch stops and sets the zero again. A switch that closes early ends in
+    // a normal homing touch, one that does not close within RESUME_APPROACH plus
+    // TOUCH_TOLERANCE in a full homing.
+    stepper.setCurrentPosition(position);
+    workOffset = offset;
+    targetMove = false;
+    homingState = VERIFY;
+    resuming = true;
+    stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
+    stepper.moveTo(mmToSteps(RESUME_APPROACH));
+}
+
+void Axis::startSlowTouch(float distance) {
+    homingState = MOVE_SLOW;
+    slowLimit = stepper.currentPosition() - mmToSteps(distance + TOUCH_TOLERANCE);
+    stepper.setMaxSpeed(mmToSteps(HOMING_SPEED / 2));
 }
 
 void Axis::probing() {
     workOffset = 0.0;
+    probeCount = 0;
+    probeApproach = false;
+    probeFastTouch = false;
+    probeArmed = false;
+    targetMove = false;
     probingState = NOT_HOMED;
 }
 
+void Axis::stopProbing() {
+    probeArmed = false;
+    stepper.halt();
+    probeApproach = false;
+    probingState = FINISHED;
+}
+
+void Axis::setProbeTouches(uint8_t touches) {
+    if (touches < 1) touches = 1;
+    if (touches > PROBE_MAX_TOUCHES) touches = PROBE_MAX_TOUCHES;
+    probeTouches = touches;
+}
+
+void Axis::setProbeSpeeds(float fast, float slow) {
+    // The probe stops the fast approach with a halt, faster than a move it loses steps
+    if (fast > MOVE_SPEED) fast = MOVE_SPEED;
+    if (slow > MOVE_SPEED) slow = MOVE_SPEED;
+    if (fast > 0.0) probeFastSpeed = fast;
+    if (slow > 0.0) probeSlowSpeed = slow;
+}
+
+float Axis::getProbeFastSpeed() {
+    return probeFastSpeed;
+}
+
+float Axis::getProbeSlowSpeed() {
+    return probeSlowSpeed;
+}
+
+ProbeStats Axis::getProbeStats() {
+    return probeStats;
+}
+
+void Axis::setMultiStepping(float doubleRate, float quadRate) {
+    stepper.setMultiStepping(doubleRate, quadRate);
+}
+
+void Axis::setResonanceBand(uint8_t index, float low, float high) {
+    stepper.setResonanceBand(index, low, high);
+}
+
+void Axis::setPositionEncoder(int pinA, int pinB, float countsPerMM) {
+    pinMode(pinA, INPUT_PULLUP);
+    pinMode(pinB, INPUT_PULLUP);
+    uint8_t oldSREG = SREG;
+    cli();
+    scaleMaskA = digitalPinToBitMask(pinA);
+    scaleMaskB = digitalPinToBitMask(pinB);
+    scaleInB = portInputRegister(digitalPinToPort(pinB));
+    scaleInA = portInputRegister(digitalPinToPort(pinA));
+    scaleState = ((*scaleInB & scaleMaskB) ? 2 : 0) | ((*scaleInA & scaleMaskA) ? 1 : 0);
+    SREG = oldSREG;
+    scaleStepsPerCount = mmToSteps(1.0) / countsPerMM;
+    followingLimit = mmToSteps(FOLLOWING_ERROR_LIMIT);
+    correctionTolerance = mmToSteps(CORRECTION_TOLERANCE);
+    zeroScale(stepper.currentPosition());
+
+    // Both channels share the pin change interrupts with the endstops
+    *digitalPinToPCMSK(pinA) |= (1 << digitalPinToPCMSKbit(pinA));
+    *digitalPinToPCMSK(pinB) |= (1 << digitalPinToPCMSKbit(pinB));
+    *digitalPinToPCICR(pinA) |= (1 << digitalPinToPCICRbit(pinA));
+    *digitalPinToPCICR(pinB) |= (1 << digitalPinToPCICRbit(pinB));
+}
+
+float Axis::getFollowingError() {
+    return stepsToMM(followingError);
+}
+
+bool Axis::hasStepLoss() {
+    return stepLoss;
+}
+
+uint8_t Axis::getScaleErrors() {
+    return scaleErrors;
+}
+
+void Axis::updateScale() {
+    if (!scaleInA) return;
+    uint8_t state = ((*scaleInB & scaleMaskB) ? 2 : 0) | ((*scaleInA & scaleMaskA) ? 1 : 0);
+    if ((state ^ scaleState) == 3 && scaleErrors < 255) scaleErrors++;
+    scaleCount += quadratureSteps[(state << 2) | scaleState];
+    scaleState = state;
+}
+
+long Axis::readScale() {
+    uint8_t oldSREG = SREG;
+    cli();
+    long count = scaleCount;
+    SREG = oldSREG;
+    return count;
+}
+
+void Axis::zeroScale(long position) {
+    uint8_t oldSREG = SREG;
+    cli();
+    scaleZero = scaleCount - static_cast<long>(position / scaleStepsPerCount);
+    scaleErrors = 0;
+    SREG = oldSREG;
+}
+
+void Axis::checkFollowing() {
+    long measured = static_cast<long>((readScale() - scaleZero) * scaleStepsPerCount);
+    long commanded = stepper.currentPosition();
+    followingError = toAxis(commanded, lastDirection) - measured;
+    if (labs(followingError) > followingLimit) stepLoss = true;
+
+    // A move that ended on its target continues from the measured position, unless
+    // an edge was missed and the measured position is a guess
+    if (probingState != FINISHED || calibrationStep >= 0 || stepper.isRunning() || commanded != plannedPos) return;
+    if (scaleErrors) return;
+    if (labs(followingError) <= correctionTolerance || corrections >= MAX_CORRECTIONS) return;
+    corrections++;
+    stepper.setCurrentPosition(toMotor(measured, lastDirection));
+    stepper.moveTo(plannedPos);
+}
+
+void Axis::setCalibration(const AxisCalibration& table) {
+    calibration = table;
+}
+
+AxisCalibration Axis::getCalibration() {
+    return calibration;
+}
+
+void Axis::startCalibration() {
+    if (homingState != FINISHED || probingState != FINISHED || fault) return;
+    memset(&calibrationWork, 0, sizeof(calibrationWork));
+    calibrationStep = 0;
+    targetMove = false;
+    planCalibrationPoint();
+}
+
+void Axis::cancelCalibration() {
+    if (calibrationStep < 0) return;
+    calibrationStep = -1;
+    calibrationApproach = false;
+    stepper.stop();
+}
+
+bool Axis::isCalibrating() {
+    return calibrationStep >= 0;
+}
+
+uint8_t Axis::getCalibrationStep() {
+    return calibrationStep < 0 ? 0 : calibrationStep;
+}
+
+float Axis::getCalibrationNominal() {
+    return stepsToMM(calibrationNominal);
+}
+
+void Axis::jog(float distance) {
+    if (calibrationStep < 0 || calibrationApproach) return;
+    stepper.setMaxSpeed(mmToSteps(PLUNGE_SPEED));
+    stepper.moveTo(stepper.targetPosition() + mmToSteps(distance));
+}
+
+bool Axis::acceptCalibrationStep() {
+    if (calibrationStep < 0) return false;
+    // Wait until the point is reached
+    if (calibrationApproach || stepper.isRunning()) return true;
+
+    long position = stepper.currentPosition();
+    if (calibrationStep < PITCH_MAP_POINTS) {
+        calibrationWork.pitch[calibrationStep] = clampInt16(position - calibrationNominal);
+    } else if (calibrationStep == PITCH_MAP_POINTS) {
+        // The gauge reads the reference here, the backlash move starts from it
+        calibrationTarget = position;
+    } else {
+        calibrationWork.backlash = clampInt16(position - calibrationTarget);
+    }
+
+    calibrationStep++;
+    if (calibrationStep == CALIBRATION_STEPS) {
+        calibration = calibrationWork;
+        calibrationStep = -1;
+        targetPos = calibrationNominal;
+        plannedPos = position;
+        return false;
+    }
+    planCalibrationPoint();
+    return true;
+}
+
+void Axis::planCalibrationPoint() {
+    stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
+    if (calibrationStep <= PITCH_MAP_POINTS) {
+        // Pitch points and the backlash reference are approached from above like
+        // the home switch, so the backlash is taken up the same way
+        uint8_t point = calibrationStep < PITCH_MAP_POINTS ? calibrationStep : PITCH_MAP_POINTS / 2;
+        calibrationNominal = pitchMap.getPoint(point);
+        calibrationTarget = calibrationNominal;
+        if (calibrationStep == PITCH_MAP_POINTS) calibrationTarget += pitchMap.correction(calibrationWork, calibrationNominal);
+        calibrationApproach = true;
+        lastDirection = -1;
+        stepper.moveTo(calibrationTarget + mmToSteps(CALIBRATION_APPROACH));
+    } else {
+        // Move up from the reference: the gauge comes short by the backlash
+        long reference = calibrationNominal;
+        calibrationNominal += mmToSteps(CALIBRATION_BACKLASH_MOVE);
+        calibrationTarget += calibrationNominal - reference
+            + pitchMap.correction(calibrationWork, calibrationNominal) - pitchMap.correction(calibrationWork, reference);
+        lastDirection = 1;
+        stepper.moveTo(calibrationTarget);
+    }
+}
+
+long Axis::planTarget() {
+    long current = toAxis(stepper.currentPosition(), lastDirection);
+    if (targetPos > current) lastDirection = 1;
+    else if (targetPos < current) lastDirection = -1;
+    plannedPos = toMotor(targetPos, lastDirection);
+    return plannedPos;
+}
+
+long Axis::toMotor(long position, int8_t direction) {
+    return pitchMap.toMotor(calibration, position, direction);
+}
+
+long Axis::toAxis(long steps, int8_t direction) {
+    return pitchMap.toAxis(calibration, steps, direction);
+}
+
+void Axis::finishProbing() {
+    // Sort a copy of the touches to get the median
+    long sorted[PROBE_MAX_TOUCHES];
+    for (uint8_t i = 0; i < probeCount; i++) {
+        long value = probeSamples[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    long median = sorted[probeCount / 2];
+    long tolerance = mmToSteps(PROBE_OUTLIER_TOLERANCE);
+
+    // Reject touches too far from the median
+    long sum = 0, minSample = 0, maxSample = 0;
+    uint8_t accepted = 0;
+    for (uint8_t i = 0; i < probeCount; i++) {
+        if (labs(sorted[i] - median) > tolerance) continue;
+        if (accepted == 0) minSample = sorted[i];
+        maxSample = sorted[i];
+        sum += sorted[i];
+        accepted++;
+    }
+
+    probeStats.touches = probeCount;
+    probeStats.rejected = probeCount - accepted;
+    probeStats.mean = stepsToMM(sum) / accepted;
+    probeStats.spread = stepsToMM(maxSample - minSample);
+    probeStats.fastTrigger = stepsToMM(probeFastTrigger);
+    probeStats.approached = probeFastTouch;
+
+    // Most touches must agree, otherwise the probe is not repeatable
+    if (accepted * 2 <= probeCount && probeCount > 1) {
+        probingState = ERROR;
+        return;
+    }
+    probingState = FINISHED;
+    // The touches are approached from below
+    lastDirection = 1;
+    workOffset = toAxis((sum + accepted / 2) / accepted, lastDirection);
+    targetPos = workOffset;
+    plannedPos = stepper.currentPosition();
+}
+
+void Axis::handleLimitInterrupt() {
+    bool stop = false;
+    for (uint8_t i = 0; i < limitAxisCount; i++) {
+        limitAxes[i]->updateScale();
+        limitAxes[i]->latchProbe();
+        if (limitAxes[i]->checkLimits()) stop = true;
+    }
+    if (!stop) return;
+
+    emergencyStopAll();
+    StepTrace::trigger(STEPTRACE_TRIGGER_LIMIT);
+}
+
+void Axis::emergencyStopAll() {
+    // Disable all drivers first, then stop the step output
+    for (uint8_t i = 0; i < limitAxisCount; i++) {
+        limitAxes[i]->emergencyStop();
+    }
+    FastStepper::haltAll();
+}
+
+bool Axis::checkLimits() {
+    // Simulated and replayed endstops latch the same emergency stop as the pins
+    long distance = stepper.distanceToGo();
+    if (getEndstopMax() && distance > 0) return true;
+    if (getEndstopMin() && distance < 0) {
+        // Homing and moves to the minimum end on the home switch
+        if (homingState != FINISHED || stepper.currentPosition() <= homeTolerance) {
+            stepper.halt();
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+void Axis::latchProbe() {
+    if (!probeArmed || !getProbe()) return;
+    stepper.halt();
+    probeLatch = stepper.currentPosition();
+    probeLatched = true;
+    probeArmed = false;
+}
+
+void Axis::armProbe() {
+    uint8_t oldSREG = SREG;
+    cli();
+    probeLatched = false;
+    probeArmed = true;
+    // A probe that closed before the move started gives no edge
+    latchProbe();
+    SREG = oldSREG;
+}
+
+bool Axis::takeProbeTouch(long& position) {
+    uint8_t oldSREG = SREG;
+    cli();
+    bool touched = probeLatched;
+    if (touched) position = probeLatch;
+    probeLatched = false;
+    SREG = oldSREG;
+    return touched;
+}
+
+void Axis::emergencyStop() {
+    *enablePort |= enableMask;
+    fault = true;
+}
+
 void Axis::moveToMax() {
     moveToAbsPos(maxPosition);
 }
@@ -267,19 +879,67 @@ void Axis::moveToPos(float position) {
     moveToTarget();
 }
 
+void Axis::moveToPos(float position, float speed) {
+    setTargetPosition(position);
+    startMove(speed);
+}
+
 void Axis::moveToAbsPos(long position) {
     setAbsTargetPosition(position);
     moveToTarget();
 }
 
 float Axis::getCurrentPosition() {
-    return stepsToMM(stepper.currentPosition() - workOffset);
+    return stepsToMM(toAxis(stepper.currentPosition(), lastDirection) - workOffset);
+}
+
+long Axis::getStepPosition() {
+    return stepper.currentPosition();
+}
+
+void Axis::traceStates() {
+    if (!StepTrace::isRecording()) {
+        tracedState = TRACE_UNKNOWN;
+        return;
+    }
+    // The first call of a capture records all states
+    bool first = tracedState == TRACE_UNKNOWN;
+    uint8_t axisState = getState();
+    if (first || axisState != tracedState) StepTrace::state(STEPTRACE_AXIS_STATE, axisState);
+    if (first || homingState != tracedHoming) StepTrace::state(STEPTRACE_HOMING_STATE, homingState);
+    if (first || probingState != tracedProbing) StepTrace::state(STEPTRACE_PROBING_STATE, probingState);
+    if (!first && ((homingState == ERROR && tracedHoming != ERROR) || (probingState == ERROR && tracedProbing != ERROR))) {
+        StepTrace::trigger(STEPTRACE_TRIGGER_ERROR);
+    }
+    tracedState = axisState;
+    tracedHoming = homingState;
+    tracedProbing = probingState;
+}
+
+long Axis::getStepWorkOffset() {
+    return workOffset;
 }
 
 float Axis::getTargetPosition() {
     return stepsToMM(targetPos - workOffset);
 }
 
+float Axis::getTravel() {
+    return stepsToMM(maxPosition - minPosition);
+}
+
+float Axis::getMoveSpeed() {
+    return MOVE_SPEED;
+}
+
+float Axis::getPlungeSpeed() {
+    return PLUNGE_SPEED;
+}
+
+float Axis::getBackoffDistance() {
+    return BACKOFF_DISTANCE;
+}
+
 float Axis::getWorkoffset() {
     return stepsToMM(workOffset);
 }
@@ -303,21 +963,66 @@ void Axis::setAbsTargetPosition(long newtargetPos) {
 }
 
 void Axis::moveToTarget() {
-    if (homingState != FINISHED || probingState != FINISHED) return;
-    stepper.setMaxSpeed(mmToSteps(MOVE_SPEED));
-    stepper.moveTo(targetPos);
+    startMove(MOVE_SPEED);
+}
+
+bool Axis::moveSynchronized(Axis* axes[], const float positions[], uint8_t count) {
+    FastStepper* steppers[FASTSTEPPER_MAX_AXES];
+    long targets[FASTSTEPPER_MAX_AXES];
+    if (count > FASTSTEPPER_MAX_AXES) return false;
+
+    for (uint8_t i = 0; i < count; i++) {
+        Axis* axis = axes[i];
+        if (axis->homingState != FINISHED || axis->probingState != FINISHED || axis->fault || axis->calibrationStep >= 0) return false;
+        axis->setTargetPosition(positions[i]);
+        axis->stepLoss = false;
+        axis->corrections = 0;
+        axis->targetMove = false;
+        axis->stepper.setMaxSpeed(axis->mmToSteps(MOVE_SPEED));
+        steppers[i] = &axis->stepper;
+        targets[i] = axis->planTarget();
+    }
+    return FastStepper::moveSynchronized(steppers, targets, count);
 }
 
 void Axis::plungeToTarget() {
-    if (homingState != FINISHED || probingState != FINISHED) return;
-    stepper.setMaxSpeed(mmToSteps(PLUNGE_SPEED));
-    stepper.moveTo(targetPos);
+    startMove(PLUNGE_SPEED);
+}
+
+void Axis::startMove(float speed) {
+    if (homingState != FINISHED || probingState != FINISHED || fault || calibrationStep >= 0) return;
+    stepLoss = false;
+    corrections = 0;
+    moveSpeed = speed;
+    feedOverride = 100;
+    targetMove = true;
+    stepper.setMaxSpeed(mmToSteps(speed));
+    stepper.moveTo(planTarget());
+}
+
+void Axis::setFeedOverride(uint8_t percent) {
+    if (percent < FEED_OVERRIDE_MIN) percent = FEED_OVERRIDE_MIN;
+    if (percent > FEED_OVERRIDE_MAX) percent = FEED_OVERRIDE_MAX;
+    // Only a running move planned by moveToPos, its speed is known; jogs, calibration
+    // and synchronized moves also show MOVE_TO_TARGET. The stepper ramps to the new
+    // speed without stopping
+    if (!hasFeedOverride()) return;
+    feedOverride = percent;
+    stepper.setMaxSpeed(mmToSteps(moveSpeed * percent / 100.0));
+}
+
+uint8_t Axis::getFeedOverride() {
+    return feedOverride;
+}
+
+bool Axis::hasFeedOverride() {
+    return targetMove && stepper.isRunning();
 }
 
 long Axis::mmToSteps(float mm) {
-    return static_cast<long>((mm / spindleLead) * stepsPerRevolution * microsteps);
+    return static_cast<long>(mm * stepsPerMM);
 }
 
 float Axis::stepsToMM(long steps) {
-    return static_cast<float>(steps) * spindleLead / (stepsPerRevolution * microsteps);
+    return static_cast<float>(steps) * mmPerStep;
 }
@@ -1,7 +1,20 @@
 #ifndef AXIS_H
 #define AXIS_H
 
-#include <AccelStepper.h>  // Include AccelStepper library
+#include "FastStepper.h"  // Integer-only stepper core
+#include "PitchMap.h"       // Lead screw pitch map and backlash
+#include "StepTrace.h"      // Step timing capture
+
+#define PROBE_MAX_TOUCHES 8    // Maximum number of touches of one probing run
+#define CALIBRATION_STEPS (PITCH_MAP_POINTS + 2) // Pitch points, backlash reference, backlash
+#define FEED_OVERRIDE_MIN 10   // Feed override range in % of the move speed
+#define FEED_OVERRIDE_MAX 200
+
+// Sensor bits of getSensors() and overrideSensors()
+#define SENSOR_ENDSTOP_MIN 0x01
+#define SENSOR_ENDSTOP_MAX 0x02
+#define SENSOR_PROBE 0x04
+#define SENSOR_ALL 0x07
 
 // Enumeration for different states of the axis
 typedef enum {
@@ -11,7 +24,8 @@ typedef enum {
     MOVE_TO_PROBE,  // Moving to probe point
     INPOSITION,     // In position reached
     MAX_REACHED,    // Maximum position reached
-    MIN_REACHED     // Minimum position reached
+    MIN_REACHED,    // Minimum position reached
+    FAULT           // Emergency stop by an endstop, cleared by homing
 } AxisState;
 
 // Enumeration for different homing states
@@ -21,62 +35,218 @@ typedef enum {
     BACKOFF,    // Backoff step
     MOVE_SLOW,  // Slow movement
     FINISHED,   // Finished homing
-    ERROR       // Error occurred
+    ERROR,      // Error occurred
+    RETRACT,    // Short retract between probe touches
+    VERIFY      // Fast move near home to verify a restored position
 } HomingState;
 
+// Statistics of the last probing run
+typedef struct {
+    uint8_t touches;    // Number of touches taken
+    uint8_t rejected;   // Number of touches rejected as outliers
+    float mean;         // Mean trigger position of the accepted touches in mm
+    float spread;       // Spread (max - min) of the accepted touches in mm
+    float fastTrigger;  // Trigger position of the fast approach in mm
+    bool approached;    // The fast approach ran into the probe, false when the run started on it
+} ProbeStats;
+
 class Axis {
 private:
-    AccelStepper stepper;   // AccelStepper object for motor control
-    float stepsPerRevolution;   // Steps per revolution of the motor
-    float microsteps;           // Microsteps of the motor
-    float spindleLead;          // Lead of the motor per revolution in mm
+    FastStepper stepper;    // FastStepper object for motor control
+    float stepsPerMM;           // Motor steps per mm of travel
+    float mmPerStep;            // Travel per motor step in mm
     float minPosition;          // Minimum reachable position of the axis in mm
     float maxPosition;          // Maximum reachable position of the axis in mm
     int endstopMinPin;          // Pin for minimum endstop
     int endstopMaxPin;          // Pin for maximum endstop
     int probingPin;             // Pin for probe point
+    volatile uint8_t* enablePort;   // Output register of the driver enable pin
+    uint8_t enableMask;             // Bit mask of the driver enable pin
+    volatile uint8_t* endstopMinIn; // Input register of the minimum endstop
+    volatile uint8_t* endstopMaxIn; // Input register of the maximum endstop
+    uint8_t endstopMinMask;         // Bit mask of the minimum endstop
+    uint8_t endstopMaxMask;         // Bit mask of the maximum endstop
+    volatile uint8_t* probeIn;      // Input register of the probe
+    uint8_t probeMask;              // Bit mask of the probe
+    long homeTolerance;             // Distance from home in steps within which the minimum endstop is expected
+    long slowLimit;                 // Lowest position of the slow homing touch in steps
+    bool resuming;                  // The homing touch verifies a restored position
+    volatile bool fault;            // Emergency stop latched by the endstop interrupt
+    volatile uint8_t* scaleInA;     // Input register of the position encoder channel A, nullptr for open loop
+    volatile uint8_t* scaleInB;     // Input register of the position encoder channel B
+    uint8_t scaleMaskA;             // Bit mask of the position encoder channel A
+    uint8_t scaleMaskB;             // Bit mask of the position encoder channel B
+    volatile uint8_t scaleState;    // Channel levels at the last edge, B << 1 | A
+    volatile long scaleCount;       // Encoder count decoded by the pin change interrupt
+    volatile uint8_t scaleErrors;   // Transitions with both channels changed since the scale was zeroed, up to 255
+    float scaleStepsPerCount;       // Axis steps per encoder count
+    long scaleZero;                 // Encoder count at the home position
+    long followingLimit;            // Following error in steps that counts as step loss
+    long correctionTolerance;       // Error in steps that is corrected at the end of a move
+    long followingError;            // Commanded minus measured position in steps
+    bool stepLoss;                  // Following error exceeded since the move started
+    uint8_t corrections;            // Corrections made at the end of the current move
+    AxisCalibration calibration;    // Pitch map and backlash applied to moves
+    AxisCalibration calibrationWork; // Calibration being measured
+    PitchMap pitchMap;              // Map points over the travel
+    int8_t lastDirection;           // Direction of the last planned move, 1 up or -1 down
+    long plannedPos;                // Motor target of the last planned move in steps
+    int8_t calibrationStep;         // Step of the guided calibration, -1 when not calibrating
+    float moveSpeed;                // Speed of the running move before the feed override in mm/s
+    uint8_t feedOverride;           // Feed override of the running move in %
+    bool targetMove;                // A move planned by moveToPos runs, the feed override applies to it
+    bool calibrationApproach;       // Approaching the calibration point from above
+    long calibrationTarget;         // Motor position of the calibration point in steps
+    long calibrationNominal;        // Position the gauge should read at the calibration point in steps
     long workOffset;            // Work offset of the axis
     AxisState state;            // Current state of the axis
     HomingState homingState;    // Homing state of the axis
     HomingState probingState;   // Probing state of the axis
     long targetPos;             // Target position of the axis
+    uint8_t probeTouches;       // Number of touches per probing run
+    uint8_t probeCount;         // Number of touches taken in the current run
+    long probeSamples[PROBE_MAX_TOUCHES]; // Trigger positions of the current run in steps
+    long probeRetract;          // Retract distance between touches in steps, tuned from the probe release
+    bool probeReleased;         // Probe released during the current retract
+    bool probeApproach;         // Slow approach to the probe started
+    long probeFastTrigger;      // Trigger position of the fast approach in steps
+    bool probeFastTouch;        // The fast approach of the current run touched the probe
+    volatile bool probeArmed;   // The pin change interrupt halts the move on the probe and latches the position
+    volatile bool probeLatched; // A touch was latched and not taken yet
+    volatile long probeLatch;   // Position of the latched touch in steps
+    float probeFastSpeed;       // Speed of the fast approach in mm/s
+    float probeSlowSpeed;       // Speed of the slow touches in mm/s
+    ProbeStats probeStats;      // Statistics of the last probing run
+    volatile uint8_t sensorOverride; // Sensors read from sensorValues instead of the pins
+    volatile uint8_t sensorValues;  // Override values of the sensors
+    uint8_t tracedState;        // Axis state of the last step trace record
+    HomingState tracedHoming;   // Homing state of the last step trace record
+    HomingState tracedProbing;  // Probing state of the last step trace record
 
-    void setupTimer();  // Private method for timer initialization
+    static Axis* limitAxes[FASTSTEPPER_MAX_AXES]; // Axes watched by the endstop interrupt
+    static uint8_t limitAxisCount;  // Number of watched axes
 
 public:
     // Constructor of the class
     Axis(int stepPin, int dirPin, int enablePin, float stepsPerRev, float microsteps, float spindleLead, float minPos, float maxPos, int endstopMin, int endstopMax, int probing);
 
     // Methods for controlling the axis
+    bool begin(bool hardwarePulses = false); // Start the step timer, call from setup(). Returns true if pulses are generated by Timer1
     void homing();              // Start homing process
+    void resume(long position, long offset); // Restore a saved step position and work offset, verified by a short homing touch or a full homing
     bool isHomed();             // Check if axis is homed
     bool isError();             // Check if error occurred
+    bool isFault();             // Check if an emergency stop is latched
+    void setDriverEnabled(bool enabled); // Switch the driver on or off, stays off while a fault is latched
     bool inPosition();          // Check if axis is in position
     bool getEndstopMax();       // Read maximum endstop
     bool getEndstopMin();       // Read minimum endstop
     bool getProbe();            // Read probe point
+    uint8_t getSensors();       // Read endstops and probe as SENSOR_* bits
+    void overrideSensors(uint8_t mask, uint8_t values); // Use values instead of the pins for the sensors in mask, 0 = all pins; endstops latch the emergency stop like the pins
     AxisState getState();       // Get current state of the axis
     HomingState getHomingState();// Get current homing state of the axis
     HomingState getProbingState(); // Get current probing state of the axis
     void handle();              // Handle current state of the axis
     void probing();             // Start probing process
+    void stopProbing();         // Halt the axis and end a probing run, the probing state goes back to FINISHED
+    void setProbeTouches(uint8_t touches); // Set number of touches per probing run
+    void setProbeSpeeds(float fast, float slow); // Set speeds in mm/s of the fast approach and the slow touches, at most the move speed
+    float getProbeFastSpeed();  // Get speed of the fast approach in mm/s
+    float getProbeSlowSpeed();  // Get speed of the slow touches in mm/s
+    ProbeStats getProbeStats(); // Get statistics of the last probing run
+    void setMultiStepping(float doubleRate, float quadRate); // Set step rates in steps/s for double and quad stepping
+    void setResonanceBand(uint8_t index, float low, float high); // Set a step rate band in steps/s the moves never cruise in
+    void setPositionEncoder(int pinA, int pinB, float countsPerMM); // Check the steps against a quadrature encoder on two pin change pins, call after begin()
+    float getFollowingError();  // Get commanded minus measured position in mm
+    bool hasStepLoss();         // Check if the following error was exceeded since the move started
+    uint8_t getScaleErrors();   // Get the encoder edges missed since homing, the axis makes no corrections while there are any
+    void setCalibration(const AxisCalibration& table); // Set pitch map and backlash
+    AxisCalibration getCalibration(); // Get pitch map and backlash
+    void startCalibration();    // Start the guided calibration of a homed axis
+    void cancelCalibration();   // Stop the calibration and keep the previous table
+    bool isCalibrating();       // Check if the calibration runs
+    uint8_t getCalibrationStep(); // Get the calibration step, 0 to CALIBRATION_STEPS - 1
+    float getCalibrationNominal(); // Get the position in mm the gauge should read
+    void jog(float distance);   // Move by a distance in mm to match the gauge
+    bool acceptCalibrationStep(); // Take the gauge reading, returns false when the calibration is done
     void moveToMax();           // Move axis to maximum position
     void moveToMin();           // Move axis to minimum position
     void moveToWorkpiece();     // Move axis to workpiece (added new method)
     void moveToPos(float position);  // Move axis to a specific position
+    void moveToPos(float position, float speed); // Move axis to a specific position with a speed in mm/s
     float getCurrentPosition(); // Get current position of the axis
+    long getStepPosition();     // Get current absolute position in steps
+    long getStepWorkOffset();   // Get work offset in steps
     float getTargetPosition();  // Get target position of the axis
     float getWorkoffset();     // Get work offset of the axis
+    float getTravel();          // Get the length of the travel in mm
+    float getMoveSpeed();       // Get the speed of moves to a target in mm/s
+    float getPlungeSpeed();     // Get the speed of plunges to a target in mm/s
+    float getBackoffDistance(); // Get the distance in mm homing and probing back off from a switch
     void setTargetPosition(float targetPos);  // Set target position of the axis
     void moveToTarget();       // Move axis to the target position with move speed
     void plungeToTarget();       // Move axis to the target position with plunge speed
+    void setFeedOverride(uint8_t percent); // Scale the speed of the running move, every move starts at 100 %
+    uint8_t getFeedOverride();  // Get feed override in %
+    bool hasFeedOverride();     // Check if the running move is a target move that takes the feed override
+
+    // Move several axes to positions in mm so that they start and arrive together,
+    // the axis with the longest way sets the speed
+    static bool moveSynchronized(Axis* axes[], const float positions[], uint8_t count);
+
+    static void handleLimitInterrupt(); // Called from the pin change interrupt of the endstops and position encoders
+    static void emergencyStopAll();     // Disable all drivers and stop all steppers, also from an interrupt
 
 private:
     void moveToAbsPos(long position);   // Move axis to an absolute position
+    void startMove(float speed);        // Plan and start the move to the target with a speed in mm/s
     void setAbsTargetPosition(long targetPos);   // Set absolute target position of the axis
+    void finishProbing();       // Evaluate the probe touches and set the work offset
+    void startSlowTouch(float distance); // Start the slow homing touch, the switch is expected within the distance in mm
+    bool checkLimits();         // Check the endstop pins in the interrupt, returns true on an emergency stop
+    void latchProbe();          // Halt and latch the position if armed and the probe is closed, interrupts off
+    void armProbe();            // Let the probe stop the running move, after it was started
+    bool takeProbeTouch(long& position); // Take the latched touch, returns false if there is none
+    void emergencyStop();       // Disable the driver and latch the fault
+    void updateScale();         // Decode the position encoder pins in the interrupt
+    long readScale();           // Get the encoder count
+    void zeroScale(long position); // Set the encoder zero so the count reads the position in steps, clears the missed edges
+    void checkFollowing();      // Compare steps and encoder, correct the position at the end of a move
+    void traceStates();         // Record state changes in the step trace and trigger it on errors
+    long planTarget();          // Apply pitch map and backlash to the target, returns the motor target
+    long toMotor(long position, int8_t direction); // Convert an axis position to motor steps
+    long toAxis(long steps, int8_t direction);     // Convert motor steps to an axis position
+    void planCalibrationPoint(); // Move to the point of the current calibration step
     // Private methods for converting mm to steps and vice versa
     long mmToSteps(float mm);
     float stepsToMM(long steps);
 };
 
+// Axis with geometry, travel and pins given as constants of a config struct:
+//
+//   struct LiftConfig {
+//       static const uint8_t stepPin = 12, dirPin = 11, enablePin = 10;
+//       static const uint8_t endstopMinPin = A2, endstopMaxPin = A3, probePin = A4;
+//       static constexpr float stepsPerRev = 200, microsteps = 8, spindleLead = 8.0;
+//       static constexpr float minPosition = 0.0, maxPosition = 119.0;
+//   };
+//   StaticAxis<LiftConfig> lift;
+//
+// The compiler checks the configuration; the axis itself is the runtime Axis, its
+// conversions and sensor reads use the factor, registers and masks of the constructor.
+template <class Config>
+class StaticAxis : public Axis {
+public:
+    static_assert(Config::stepsPerRev > 0 && Config::microsteps > 0 && Config::spindleLead > 0, "Axis geometry must be positive");
+    static_assert(Config::maxPosition > Config::minPosition, "Axis travel limits are swapped");
+    static_assert(Config::stepPin != Config::dirPin && Config::stepPin != Config::enablePin && Config::dirPin != Config::enablePin, "Axis driver pins overlap");
+    static_assert(Config::endstopMinPin != Config::endstopMaxPin, "Axis endstop pins overlap");
+
+    // Constructor of the class
+    StaticAxis()
+        : Axis(Config::stepPin, Config::dirPin, Config::enablePin, Config::stepsPerRev, Config::microsteps, Config::spindleLead,
+               Config::minPosition, Config::maxPosition, Config::endstopMinPin, Config::endstopMaxPin, Config::probePin) {}
+};
+
 #endif  // AXIS_H
@@ -0,0 +1,510 @@
+#include "FastStepper.h"
+#include "StepTrace.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Longest representable step interval in 1/256 ticks (about 30 steps/s)
+#define MAX_INTERVAL (0xFFFFL << 8)
+
+// STEP high time in timer ticks for hardware pulses
+#define PULSE_TICKS (FASTSTEPPER_PULSE_WIDTH_US * (FASTSTEPPER_TICKS_PER_SECOND / 1000000L))
+
+// Earliest compare match the scheduler programs ahead of the counter, in ticks
+#define SCHEDULE_MARGIN 8
+
+FastStepper* FastStepper::registry[FASTSTEPPER_MAX_AXES];
+uint8_t FastStepper::registryCount = 0;
+FastStepper* FastStepper::hardwareStepper = nullptr;
+bool FastStepper::timerStarted = false;
+
+ISR(TIMER1_COMPA_vect) {
+    FastStepper::handleCompare();
+}
+
+ISR(TIMER1_OVF_vect) {
+    FastStepper::handleOverflow();
+}
+
+FastStepper::FastStepper(uint8_t interface, uint8_t stepPin, uint8_t dirPin) {
+    (void)interface; // Only DRIVER is supported
+
+    this->stepPort = portOutputRegister(digitalPinToPort(stepPin));
+    this->stepMask = digitalPinToBitMask(stepPin);
+    this->dirPort = portOutputRegister(digitalPinToPort(dirPin));
+    this->dirMask = digitalPinToBitMask(dirPin);
+    this->stepTimer = digitalPinToTimer(stepPin);
+    this->position = 0;
+    this->target = 0;
+    this->n = 0;
+    this->cn = 0;
+    this->interval = 0;
+    this->lastStepTime = 0;
+    this->direction = 1;
+    this->maxSpeed = 1.0;
+    this->acceleration = 0.0;
+    this->cruise = 1.0;
+    for (uint8_t i = 0; i < FASTSTEPPER_MAX_BANDS; i++) {
+        this->bandLow[i] = 0.0;
+        this->bandHigh[i] = 0.0;
+    }
+    this->c0 = MAX_INTERVAL;
+    this->cmin = MAX_INTERVAL;
+    this->doubleInterval = 0;
+    this->quadInterval = 0;
+    this->stepsPerEvent = 1;
+    this->leader = nullptr;
+    this->nextFollower = nullptr;
+    this->followers = nullptr;
+    this->syncSteps = 0;
+    this->syncTotal = 0;
+    this->syncError = 0;
+
+    if (registryCount < FASTSTEPPER_MAX_AXES) {
+        registry[registryCount++] = this;
+    }
+
+    pinMode(stepPin, OUTPUT);
+    pinMode(dirPin, OUTPUT);
+    digitalWrite(stepPin, LOW);
+    digitalWrite(dirPin, HIGH);
+}
+
+bool FastStepper::begin(bool hardwarePulses) {
+    // Hardware pulses need the whole timer, so only a single stepper can use them
+    bool hardware = hardwarePulses && (stepTimer == TIMER1A || stepTimer == TIMER1B) && registryCount == 1;
+    if (hardware) {
+        // Timer1 in fast PWM mode with TOP = ICR1, prescaler 8: one period per step,
+        // OCR1A/OCR1B give the STEP high time at the start of each period
+        hardwareStepper = this;
+        TIMSK1 = 0;
+        TCCR1A = (1 << WGM11);
+        TCCR1B = (1 << WGM13) | (1 << WGM12) | (1 << CS11);
+        ICR1 = 0xFFFF;
+        OCR1A = PULSE_TICKS;
+        OCR1B = PULSE_TICKS;
+    } else if (!timerStarted) {
+        // Timer1 in normal mode, prescaler 8: free running 2 MHz time base,
+        // the compare A interrupt is programmed for the next due stepper
+        TIMSK1 = 0;
+        TCCR1A = 0;
+        TCCR1B = (1 << CS11);
+    }
+    timerStarted = true;
+    return hardware;
+}
+
+void FastStepper::moveTo(long absolute) {
+    uint8_t oldSREG = SREG;
+    cli();
+    // Followers are moved by their leader
+    if (!leader && target != absolute) {
+        target = absolute;
+        computeNewSpeed();
+    }
+    SREG = oldSREG;
+}
+
+void FastStepper::move(long relative) {
+    moveTo(currentPosition() + relative);
+}
+
+bool FastStepper::run() {
+    return isRunning();
+}
+
+void FastStepper::setMaxSpeed(float speed) {
+    if (speed < 1.0) speed = 1.0;
+    if (speed == maxSpeed) return;
+    maxSpeed = speed;
+    updateCruise();
+}
+
+void FastStepper::setResonanceBand(uint8_t index, float low, float high) {
+    if (index >= FASTSTEPPER_MAX_BANDS) return;
+    bandLow[index] = low < high ? low : 0.0;
+    bandHigh[index] = low < high ? high : 0.0;
+    updateCruise();
+}
+
+float FastStepper::cruiseSpeed() {
+    return cruise;
+}
+
+void FastStepper::updateCruise() {
+    // Move the speed to the nearer edge of a band it falls into, again for
+    // overlapping bands. Speeds at the edges are allowed.
+    float speed = maxSpeed;
+    for (uint8_t pass = 0; pass < FASTSTEPPER_MAX_BANDS; pass++) {
+        for (uint8_t i = 0; i < FASTSTEPPER_MAX_BANDS; i++) {
+            if (speed > bandLow[i] && speed < bandHigh[i]) {
+                speed = (speed - bandLow[i] < bandHigh[i] - speed) ? bandLow[i] : bandHigh[i];
+            }
+        }
+    }
+    if (speed < 1.0) speed = 1.0;
+    cruise = speed;
+
+    float ticks = FASTSTEPPER_TICKS_PER_SECOND * 256.0 / speed;
+    long newCmin = ticks < MAX_INTERVAL ? static_cast<long>(ticks) : MAX_INTERVAL;
+
+    // Already faster than the new max speed: advanceRamp() slows down to it
+    uint8_t oldSREG = SREG;
+    cli();
+    cmin = newCmin;
+    SREG = oldSREG;
+}
+
+void FastStepper::setAcceleration(float newAcceleration) {
+    if (newAcceleration <= 0.0 || newAcceleration == acceleration) return;
+
+    // Equation 15 of Austin's paper, with the 0.676 correction of the first step
+    float ticks = 0.676 * sqrt(2.0 / newAcceleration) * FASTSTEPPER_TICKS_PER_SECOND * 256.0;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    // Rescale the ramp counter to keep the current speed
+    if (acceleration > 0.0) {
+        n = static_cast<long>(n * (acceleration / newAcceleration));
+    }
+    acceleration = newAcceleration;
+    c0 = ticks < MAX_INTERVAL ? static_cast<long>(ticks) : MAX_INTERVAL;
+    SREG = oldSREG;
+}
+
+void FastStepper::setMultiStepping(float doubleRate, float quadRate) {
+    doubleInterval = doubleRate > 0.0 ? static_cast<long>(FASTSTEPPER_TICKS_PER_SECOND * 256.0 / doubleRate) : 0;
+    quadInterval = quadRate > 0.0 ? static_cast<long>(FASTSTEPPER_TICKS_PER_SECOND * 256.0 / quadRate) : 0;
+}
+
+void FastStepper::setCurrentPosition(long newPosition) {
+    uint8_t oldSREG = SREG;
+    cli();
+    halt();
+    position = newPosition;
+    target = newPosition;
+    SREG = oldSREG;
+}
+
+long FastStepper::currentPosition() {
+    uint8_t oldSREG = SREG;
+    cli();
+    long value = position;
+    SREG = oldSREG;
+    return value;
+}
+
+long FastStepper::targetPosition() {
+    uint8_t oldSREG = SREG;
+    cli();
+    long value = target;
+    SREG = oldSREG;
+    return value;
+}
+
+long FastStepper::distanceToGo() {
+    uint8_t oldSREG = SREG;
+    cli();
+    long value = target - position;
+    SREG = oldSREG;
+    return value;
+}
+
+bool FastStepper::isRunning() {
+    uint8_t oldSREG = SREG;
+    cli();
+    bool running = interval != 0 || target != position;
+    SREG = oldSREG;
+    return running;
+}
+
+void FastStepper::stop() {
+    uint8_t oldSREG = SREG;
+    cli();
+    if (interval) {
+        long stepsToStop = n < 0 ? -n : n;
+        moveTo(position + direction * stepsToStop);
+    }
+    SREG = oldSREG;
+}
+
+void FastStepper::halt() {
+    uint8_t oldSREG = SREG;
+    cli();
+    if (leader) {
+        // Leave the follower list of the leader
+        FastStepper** link = &leader->followers;
+        while (*link && *link != this) link = &(*link)->nextFollower;
+        if (*link) *link = nextFollower;
+        leader = nullptr;
+    }
+    if (hardwareStepper == this && interval) stopHardware();
+    releaseFollowers();
+    target = position;
+    interval = 0;
+    n = 0;
+    SREG = oldSREG;
+}
+
+bool FastStepper::moveSynchronized(FastStepper* steppers[], const long targets[], uint8_t count) {
+    if (count == 0) return false;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    for (uint8_t i = 0; i < count; i++) {
+        if (steppers[i]->isRunning() || steppers[i]->leader) {
+            SREG = oldSREG;
+            return false;
+        }
+    }
+
+    // The stepper with the most steps leads
+    uint8_t lead = 0;
+    long most = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        long steps = labs(targets[i] - steppers[i]->position);
+        if (steps > most) {
+            most = steps;
+            lead = i;
+        }
+    }
+
+    FastStepper* leadStepper = steppers[lead];
+    leadStepper->syncTotal = most;
+    for (uint8_t i = 0; i < count; i++) {
+        FastStepper* follower = steppers[i];
+        if (i == lead || follower == leadStepper) continue;
+        follower->target = targets[i];
+        follower->syncSteps = labs(targets[i] - follower->position);
+        follower->syncError = most / 2;
+        if (follower->syncSteps) follower->setDirection(targets[i] > follower->position ? 1 : -1);
+        follower->leader = leadStepper;
+        follower->nextFollower = leadStepper->followers;
+        leadStepper->followers = follower;
+    }
+    leadStepper->moveTo(targets[lead]);
+    if (!leadStepper->interval) leadStepper->releaseFollowers();
+    SREG = oldSREG;
+    return true;
+}
+
+void FastStepper::haltAll() {
+    uint8_t oldSREG = SREG;
+    cli();
+    for (uint8_t i = 0; i < registryCount; i++) {
+        registry[i]->halt();
+    }
+    SREG = oldSREG;
+}
+
+void FastStepper::handleCompare() {
+    uint16_t now = TCNT1;
+    uint16_t wait = 0xFFFF;
+    bool active = false;
+
+    for (uint8_t i = 0; i < registryCount; i++) {
+        FastStepper* stepper = registry[i];
+        if (!stepper->interval || stepper->leader) continue;
+
+        uint16_t elapsed = now - stepper->lastStepTime;
+        if (elapsed >= stepper->interval) {
+            // Keep the schedule, unless we are more than one interval late
+            stepper->lastStepTime += (elapsed - stepper->interval >= stepper->interval) ? elapsed : stepper->interval;
+            stepper->stepEvent();
+            StepTrace::step((i << STEPTRACE_AXIS_SHIFT) | stepper->stepsPerEvent, now);
+            stepper->computeNewSpeed();
+            if (!stepper->interval) {
+                stepper->releaseFollowers();
+                continue;
+            }
+            elapsed = now - stepper->lastStepTime;
+        }
+
+        uint16_t remaining = stepper->interval > elapsed ? stepper->interval - elapsed : 0;
+        if (remaining < wait) wait = remaining;
+        active = true;
+    }
+
+    if (!active) {
+        TIMSK1 &= ~(1 << OCIE1A);
+        return;
+    }
+    // Never program the compare behind the running counter
+    uint16_t due = now + wait;
+    if ((int16_t)(due - TCNT1) < SCHEDULE_MARGIN) due = TCNT1 + SCHEDULE_MARGIN;
+    OCR1A = due;
+}
+
+void FastStepper::handleOverflow() {
+    FastStepper* stepper = hardwareStepper;
+    if (!stepper) return;
+
+    // A period ended and the STEP pulse of the next one just started
+    StepTrace::step(STEPTRACE_PERIOD | 1, ICR1);
+    stepper->position += stepper->direction;
+    stepper->computeNewSpeed();
+    if (!stepper->interval) {
+        stepper->stopHardware();
+        return;
+    }
+    // Set the end of the running period, but never behind the counter
+    uint16_t now = TCNT1;
+    ICR1 = stepper->interval > now + PULSE_TICKS ? stepper->interval : now + PULSE_TICKS;
+}
+
+void FastStepper::schedule() {
+    // Run the compare interrupt right away, it picks the next due stepper
+    OCR1A = TCNT1 + SCHEDULE_MARGIN;
+    TIFR1 = (1 << OCF1A);
+    TIMSK1 |= (1 << OCIE1A);
+}
+
+void FastStepper::releaseFollowers() {
+    for (FastStepper* follower = followers; follower; follower = follower->nextFollower) {
+        follower->leader = nullptr;
+        follower->target = follower->position;
+    }
+    followers = nullptr;
+}
+
+void FastStepper::computeNewSpeed() {
+    long distanceTo = target - position;
+    long stepsToStop = n < 0 ? -n : n;  // Steps done on the ramp equal the steps needed to stop
+
+    if (distanceTo == 0 && stepsToStop <= 1) {
+        // At the target and slow enough to stop
+        interval = 0;
+        n = 0;
+        return;
+    }
+    bool starting = (interval == 0);
+
+    if (distanceTo > 0) {
+        if (n > 0) {
+            // Decelerate if we would overshoot or move the wrong way
+            if (stepsToStop >= distanceTo || direction < 0) n = -stepsToStop;
+        } else if (n < 0) {
+            // Accelerate again if there is room and we move the right way
+            if (stepsToStop < distanceTo && direction > 0) n = -n;
+        }
+    } else if (distanceTo < 0) {
+        if (n > 0) {
+            if (stepsToStop >= -distanceTo || direction > 0) n = -stepsToStop;
+        } else if (n < 0) {
+            if (stepsToStop < -distanceTo && direction < 0) n = -n;
+        }
+    } else if (n > 0) {
+        // On the target but too fast: decelerate and come back
+        n = -stepsToStop;
+    }
+
+    if (n == 0) {
+        // First step from standstill, due one initial interval from now
+        cn = c0;
+        setDirection(distanceTo > 0 ? 1 : -1);
+        n = 1;
+        lastStepTime = TCNT1;
+        if (cn < cmin) cn = cmin;
+        stepsPerEvent = 1;
+        interval = cn >> 8;
+        if (starting) {
+            if (hardwareStepper == this) startHardware();
+            else schedule();
+        }
+        return;
+    }
+
+    advanceRamp();
+
+    // Pick the steps per event from the current rate, without running past the
+    // point where deceleration has to start or past the end of the ramp
+    uint8_t steps = 1;
+    if (hardwareStepper == this) steps = 1;
+    else if (cn < quadInterval) steps = 4;
+    else if (cn < doubleInterval) steps = 2;
+    // (while accelerating every step also adds one step to the stopping distance)
+    long room = -n;
+    if (n > 0) {
+        room = (distanceTo < 0 ? -distanceTo : distanceTo) - stepsToStop;
+        if (cn > cmin) room /= 2;
+    }
+    while (steps > 1 && steps > room) steps >>= 1;
+
+    long sum = cn;
+    for (uint8_t i = 1; i < steps; i++) {
+        advanceRamp();
+        sum += cn;
+    }
+    stepsPerEvent = steps;
+
+    if (sum > MAX_INTERVAL) sum = MAX_INTERVAL;
+    interval = sum >> 8;
+    if (!interval) interval = 1;
+}
+
+void FastStepper::advanceRamp() {
+    if (n > 1 && cn < cmin) {
+        // Max speed lowered while running: decelerate down the ramp to the new
+        // speed, so the counter still tells the steps to stop
+        long next = cn + (2 * cn) / (4 * n - 1);
+        n--;
+        cn = next < cmin ? next : cmin;
+        return;
+    }
+    long next = cn - (2 * cn) / (4 * n + 1);
+    if (n > 0 && next <= cmin) {
+        // Cruising: hold the ramp counter so it still tells the steps to stop
+        cn = cmin;
+    } else {
+        cn = next;
+        n++;
+    }
+    if (cn < cmin) cn = cmin;
+    if (cn > MAX_INTERVAL) cn = MAX_INTERVAL;
+}
+
+void FastStepper::stepEvent() {
+    // Runs in the compare interrupt: all axes of one event share the pulse width
+    for (uint8_t i = 0; i < stepsPerEvent; i++) {
+        if (i) delayMicroseconds(FASTSTEPPER_PULSE_WIDTH_US);
+        *stepPort |= stepMask;
+        for (FastStepper* follower = followers; follower; follower = follower->nextFollower) {
+            follower->syncError -= follower->syncSteps;
+            if (follower->syncError < 0) {
+                follower->syncError += syncTotal;
+                *follower->stepPort |= follower->stepMask;
+                follower->position += follower->direction;
+            }
+        }
+        delayMicroseconds(FASTSTEPPER_PULSE_WIDTH_US);
+        *stepPort &= ~stepMask;
+        for (FastStepper* follower = followers; follower; follower = follower->nextFollower) {
+            *follower->stepPort &= ~follower->stepMask;
+        }
+    }
+    position += direction * stepsPerEvent;
+}
+
+void FastStepper::startHardware() {
+    // The first pulse comes at the end of the first period, like in software mode
+    ICR1 = interval > PULSE_TICKS ? interval : PULSE_TICKS + 1;
+    TCNT1 = 0;
+    TIFR1 = (1 << TOV1);
+    TCCR1A |= (stepTimer == TIMER1A) ? (1 << COM1A1) : (1 << COM1B1);
+    TIMSK1 |= (1 << TOIE1);
+}
+
+void FastStepper::stopHardware() {
+    // Let the running pulse end before the pin falls back to its port value
+    while (TCNT1 <= PULSE_TICKS) {}
+    TCCR1A &= ~((1 << COM1A1) | (1 << COM1B1));
+    TIMSK1 &= ~(1 << TOIE1);
+}
+
+void FastStepper::setDirection(int8_t dir) {
+    direction = dir;
+    uint8_t oldSREG = SREG;
+    cli();
+    if (dir > 0) *dirPort |= dirMask;
+    else *dirPort &= ~dirMask;
+    SREG = oldSREG;
+}
@@ -0,0 +1,109 @@
+#ifndef FASTSTEPPER_H
+#define FASTSTEPPER_H
+
+#include <Arduino.h>
+
+// Timer1 runs with prescaler 8 and is the time base for all step intervals
+#define FASTSTEPPER_TICKS_PER_SECOND (F_CPU / 8)
+#define FASTSTEPPER_PULSE_WIDTH_US 2   // Minimum STEP high time for the driver
+#define FASTSTEPPER_MAX_AXES 4         // Number of steppers the step timer can service
+#define FASTSTEPPER_MAX_BANDS 2        // Resonance bands per stepper
+
+// Integer-only DRIVER-mode stepper with the position semantics of AccelStepper.
+// The ramp uses Austin's recurrence c(n) = c(n-1) - 2*c(n-1) / (4n + 1) on step
+// intervals in 1/256 timer ticks, so a step costs one integer division and no float math.
+//
+// All steppers register themselves and are stepped from one Timer1 compare
+// interrupt, which always waits for the next due stepper. Above the multi-step
+// rates several pulses are emitted per timing event, which cuts the interrupt rate
+// to a half or a quarter. Steppers in a synchronized move follow a leader with
+// Bresenham's algorithm and step in the same interrupt as the leader.
+//
+// Speed ranges where the motor resonates can be set as bands. The ramp passes a band
+// with the normal acceleration, but the cruise speed is moved to the nearer band edge.
+//
+// With a single stepper on OC1A (D9) or OC1B (D10) the pulses can instead be
+// generated by Timer1 in fast PWM mode: every timer period is one step, and the
+// overflow interrupt only reloads the period for the next step.
+class FastStepper {
+public:
+    enum MotorInterfaceType {
+        DRIVER = 1      // Step and direction driver, the only supported interface
+    };
+
+    // Constructor of the class
+    FastStepper(uint8_t interface, uint8_t stepPin, uint8_t dirPin);
+
+    bool begin(bool hardwarePulses = false); // Start Timer1, call from setup(). Returns true if pulses are generated in hardware
+    void moveTo(long absolute);             // Set absolute target position in steps
+    void move(long relative);               // Set target position relative to the current position
+    bool run();                             // Returns true while running, stepping is done by the step timer
+    void setMaxSpeed(float speed);          // Set max speed in steps/s, a running move ramps to it
+    void setAcceleration(float acceleration); // Set acceleration in steps/s^2
+    void setMultiStepping(float doubleRate, float quadRate); // Set step rates in steps/s for 2 and 4 steps per event, 0 = off
+    void setResonanceBand(uint8_t index, float low, float high); // Never cruise between low and high steps/s, 0 = off
+    float cruiseSpeed();                    // Get the max speed after avoiding the resonance bands in steps/s
+    void setCurrentPosition(long position); // Set current position, stops immediately
+    long currentPosition();                 // Get current position in steps
+    long targetPosition();                  // Get target position in steps
+    long distanceToGo();                    // Get remaining steps to the target
+    bool isRunning();                       // Check if the motor is moving or has steps to go
+    void stop();                            // Decelerate to a stop as fast as possible
+    void halt();                            // Stop immediately at the current position
+
+    // Move several idle steppers so that they start and arrive together. The stepper
+    // with the longest way leads with its ramp, the others follow it. Returns false
+    // if one of them is still running.
+    static bool moveSynchronized(FastStepper* steppers[], const long targets[], uint8_t count);
+    static void haltAll();                  // Stop all steppers immediately, also from an interrupt
+
+    static void handleCompare();            // Called from the Timer1 compare interrupt
+    static void handleOverflow();           // Called from the Timer1 overflow interrupt in hardware pulse mode
+
+private:
+    volatile uint8_t* stepPort;     // Output register of the step pin
+    volatile uint8_t* dirPort;      // Output register of the direction pin
+    uint8_t stepMask;               // Bit mask of the step pin
+    uint8_t dirMask;                // Bit mask of the direction pin
+    uint8_t stepTimer;              // Timer output of the step pin (TIMER1A, TIMER1B or none)
+    long position;                  // Current position in steps
+    long target;                    // Target position in steps
+    long n;                         // Ramp step counter, negative while decelerating
+    long c0;                        // First step interval in 1/256 ticks
+    long cn;                        // Current step interval in 1/256 ticks
+    long cmin;                      // Step interval at max speed in 1/256 ticks
+    long doubleInterval;            // Step interval below which 2 steps are emitted per event
+    long quadInterval;              // Step interval below which 4 steps are emitted per event
+    uint16_t interval;              // Current event interval in ticks, 0 when stopped
+    uint8_t stepsPerEvent;          // Step pulses emitted per timing event
+    uint16_t lastStepTime;          // Timer1 count of the last step event
+    int8_t direction;               // Current direction, 1 or -1
+    float maxSpeed;                 // Max speed in steps/s
+    float acceleration;             // Acceleration in steps/s^2
+    float cruise;                   // Max speed moved out of the resonance bands in steps/s
+    float bandLow[FASTSTEPPER_MAX_BANDS];  // Lower edges of the resonance bands in steps/s
+    float bandHigh[FASTSTEPPER_MAX_BANDS]; // Upper edges of the resonance bands in steps/s
+    FastStepper* leader;            // Stepper this one follows in a synchronized move
+    FastStepper* nextFollower;      // Next stepper in the follower list of the leader
+    FastStepper* followers;         // First stepper following this one
+    long syncSteps;                 // Steps of this follower in the synchronized move
+    long syncTotal;                 // Steps of the leader in the synchronized move
+    long syncError;                 // Bresenham error term of this follower
+
+    static FastStepper* registry[FASTSTEPPER_MAX_AXES]; // All steppers serviced by the step timer
+    static uint8_t registryCount;   // Number of registered steppers
+    static FastStepper* hardwareStepper; // Stepper whose pulses are generated by Timer1
+    static bool timerStarted;       // Timer1 is configured
+
+    void updateCruise();            // Move the max speed out of the bands and set cmin
+    void computeNewSpeed();         // Calculate the interval for the next step event
+    void advanceRamp();             // Advance the ramp by one step
+    void stepEvent();               // Emit the pulses of one event for this stepper and its followers
+    void setDirection(int8_t dir);  // Set direction pin
+    void releaseFollowers();        // End a synchronized move, followers stop where they are
+    void startHardware();           // Connect the step pin to Timer1 and start the first period
+    void stopHardware();            // Disconnect the step pin from Timer1 after the last pulse
+    static void schedule();         // Let the compare interrupt pick up a new move
+};
+
+#endif  // FASTSTEPPER_H
@@ -0,0 +1,53 @@
+#include "PitchMap.h"
+
+PitchMap::PitchMap(long origin, long spacing) {
+    this->origin = origin;
+    this->spacing = spacing;
+}
+
+long PitchMap::getOrigin() {
+    return origin;
+}
+
+long PitchMap::getSpacing() {
+    return spacing;
+}
+
+long PitchMap::getPoint(uint8_t point) {
+    return origin + point * spacing;
+}
+
+long PitchMap::correction(const AxisCalibration& table, long position) {
+    // Linear interpolation between the map points
+    long offset = position - origin;
+    if (offset <= 0 || spacing <= 0) return table.pitch[0];
+    long point = offset / spacing;
+    if (point >= PITCH_MAP_POINTS - 1) return table.pitch[PITCH_MAP_POINTS - 1];
+    long fraction = offset - point * spacing;
+    long start = table.pitch[point];
+    return start + (table.pitch[point + 1] - start) * fraction / spacing;
+}
+
+long PitchMap::toMotor(const AxisCalibration& table, long position, int8_t direction) {
+    return position + correction(table, position) + (direction > 0 ? table.backlash : 0);
+}
+
+long PitchMap::toAxis(const AxisCalibration& table, long steps, int8_t direction) {
+    long motor = steps - (direction > 0 ? table.backlash : 0);
+    // Outside the map the correction is constant
+    if (spacing <= 0 || motor <= origin + table.pitch[0]) return motor - table.pitch[0];
+    uint8_t last = PITCH_MAP_POINTS - 1;
+    if (motor >= getPoint(last) + table.pitch[last]) return motor - table.pitch[last];
+
+    // Find the map segment in motor steps, the corrections are small against the spacing
+    long point = (motor - origin) / spacing;
+    if (point > last - 1) point = last - 1;
+    while (point > 0 && motor < getPoint(point) + table.pitch[point]) point--;
+    while (point < last - 1 && motor >= getPoint(point + 1) + table.pitch[point + 1]) point++;
+
+    // Interpolate back along the segment, rounded to the nearest step
+    long start = getPoint(point) + table.pitch[point];
+    long length = spacing + table.pitch[point + 1] - table.pitch[point];
+    if (length <= 0) return motor - correction(table, motor);
+    return getPoint(point) + ((motor - start) * spacing + length / 2) / length;
+}
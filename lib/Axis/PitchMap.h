@@ -0,0 +1,37 @@
+#ifndef PITCHMAP_H
+#define PITCHMAP_H
+
+#include <Arduino.h>
+
+#define PITCH_MAP_POINTS 16    // Pitch correction points evenly spaced over the travel
+
+// Lead screw calibration in steps, measured like homing with the last move going down
+typedef struct {
+    int16_t pitch[PITCH_MAP_POINTS]; // Actual minus nominal steps at the map points
+    int16_t backlash;   // Extra steps the motor leads after moving up
+} AxisCalibration;
+
+// Converts between axis positions and motor steps with a pitch map and backlash,
+// integer math only. The map points are evenly spaced from the origin; between
+// them the correction is interpolated, outside the map the nearest point applies.
+// The backlash is added after a move up. toAxis() inverts toMotor() exactly, up to
+// the rounding of one step, as long as the map is monotonic in motor steps.
+class PitchMap {
+public:
+    // Constructor of the class
+    PitchMap(long origin = 0, long spacing = 0);
+
+    long getOrigin();           // Position of the first map point in steps
+    long getSpacing();          // Distance of the map points in steps
+    long getPoint(uint8_t point); // Position of a map point in steps
+
+    long correction(const AxisCalibration& table, long position); // Interpolate the map at an axis position in steps
+    long toMotor(const AxisCalibration& table, long position, int8_t direction); // Convert an axis position to motor steps
+    long toAxis(const AxisCalibration& table, long steps, int8_t direction);     // Convert motor steps to an axis position
+
+private:
+    long origin;                // Position of the first map point in steps
+    long spacing;               // Distance of the map points in steps
+};
+
+#endif  // PITCHMAP_H
@@ -0,0 +1,94 @@
+#include "StepTrace.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+StepTraceRecord* StepTrace::ring = nullptr;
+uint8_t StepTrace::mask = 0;
+uint8_t StepTrace::decimation = 1;
+volatile uint8_t StepTrace::skip = 1;
+volatile uint8_t StepTrace::head = 0;
+volatile uint8_t StepTrace::count = 0;
+volatile bool StepTrace::recording = false;
+uint8_t StepTrace::triggers = 0;
+volatile uint8_t StepTrace::triggered = 0;
+
+void StepTrace::begin(StepTraceRecord* newRing, uint8_t size) {
+    stop();
+    if (size > STEPTRACE_MAX_SIZE) size = STEPTRACE_MAX_SIZE;
+    while (size & (size - 1)) size &= size - 1;    // round down to a power of 2
+    uint8_t oldSREG = SREG;
+    cli();
+    ring = size ? newRing : nullptr;
+    mask = size ? size - 1 : 0;
+    head = 0;
+    count = 0;
+    SREG = oldSREG;
+}
+
+void StepTrace::start(uint8_t newTriggers, uint8_t newDecimation) {
+    if (!ring) return;
+    uint8_t oldSREG = SREG;
+    cli();
+    head = 0;
+    count = 0;
+    decimation = newDecimation ? newDecimation : 1;
+    skip = 1;
+    triggers = newTriggers;
+    triggered = 0;
+    recording = true;
+    SREG = oldSREG;
+}
+
+void StepTrace::stop() {
+    recording = false;
+}
+
+bool StepTrace::isRecording() {
+    return recording;
+}
+
+uint8_t StepTrace::triggeredBy() {
+    return triggered;
+}
+
+void StepTrace::trigger(uint8_t reason) {
+    if (!recording || !(triggers & reason)) return;
+    recording = false;
+    triggered = reason;
+}
+
+void StepTrace::state(uint8_t kind, uint8_t value) {
+    uint8_t oldSREG = SREG;
+    cli();
+    step(STEPTRACE_STATE | (kind << 4) | (value & 0x0F), TCNT1);
+    SREG = oldSREG;
+}
+
+void StepTrace::dump(Print& out) {
+    stop();
+    out.print(F("# trigger "));
+    out.println(triggered);
+    out.print(F("# decimation "));
+    out.println(decimation);
+    out.println(F("index,ticks,type,axis,value"));
+    uint8_t first = (head - count) & mask;
+    for (uint8_t i = 0; i < count; i++) {
+        const StepTraceRecord& record = ring[(first + i) & mask];
+        out.print(i);
+        out.print(',');
+        out.print(record.time);
+        out.print(',');
+        if (record.info & STEPTRACE_STATE) {
+            uint8_t kind = (record.info >> 4) & 0x07;
+            out.print(kind == STEPTRACE_AXIS_STATE ? 'a' : kind == STEPTRACE_HOMING_STATE ? 'h' : 'p');
+            out.print(F(",,"));
+            out.println(record.info & 0x0F);
+        } else {
+            out.print((record.info & STEPTRACE_PERIOD) ? 'P' : 's');
+            out.print(',');
+            out.print((record.info >> STEPTRACE_AXIS_SHIFT) & 0x03);
+            out.print(',');
+            out.println(record.info & 0x07);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef STEPTRACE_H
+#define STEPTRACE_H
+
+#include <Arduino.h>
+
+#define STEPTRACE_MAX_SIZE 128      // Records used of a longer ring
+
+// Record info byte
+#define STEPTRACE_STATE 0x80        // State record: kind in bits 4-6, state in bits 0-3
+#define STEPTRACE_PERIOD 0x40       // Step record in hardware pulse mode: time is the period
+#define STEPTRACE_AXIS_SHIFT 3      // Step record: axis index in bits 3-4, pulses of the event in bits 0-2
+
+// Kinds of state records
+#define STEPTRACE_AXIS_STATE 0      // AxisState
+#define STEPTRACE_HOMING_STATE 1    // Homing state
+#define STEPTRACE_PROBING_STATE 2   // Probing state
+
+// Triggers that stop the capture
+#define STEPTRACE_TRIGGER_ERROR 0x01 // Homing or probing error
+#define STEPTRACE_TRIGGER_PROBE 0x02 // Probe touch
+#define STEPTRACE_TRIGGER_LIMIT 0x04 // Emergency stop by an endstop
+#define STEPTRACE_TRIGGER_ALL 0x07
+
+// One record: Timer1 count (2 MHz) and info byte
+typedef struct {
+    uint16_t time;
+    uint8_t info;
+} StepTraceRecord;
+
+// Raw timing capture of the step interrupt. Step events are recorded with the
+// Timer1 count at which the interrupt ran, state changes of the axes in between, into
+// a RAM ring of the sketch that keeps the last records, up to a power of 2 of its
+// size and at most STEPTRACE_MAX_SIZE. A trigger stops the capture, so the ring ends
+// with the events that led to it. Recording costs the step interrupt a few dozen
+// cycles.
+//
+// To cover a longer move with the same RAM, start() can keep only every n-th step
+// event; state records are always kept. The dump header states the decimation.
+//
+// The counter wraps every 32.8 ms; step events are never further apart, but a gap
+// before a state record may be, and so may n step events at a low speed.
+class StepTrace {
+public:
+    static void begin(StepTraceRecord* ring, uint8_t size); // Set the ring of the sketch, nothing is recorded without one
+    static void start(uint8_t triggers = STEPTRACE_TRIGGER_ALL, uint8_t decimation = 1); // Clear the ring and record every decimation-th step event until a trigger
+    static void stop();             // Stop recording
+    static bool isRecording();      // Check if recording
+    static uint8_t triggeredBy();   // Get the trigger that stopped the capture, 0 = none
+    static void trigger(uint8_t reason); // Stop recording if reason is one of the set triggers
+    static void state(uint8_t kind, uint8_t value); // Record a state change
+    static void dump(Print& out);   // Stop recording and print the records as CSV, oldest first
+
+    // Record a step event, called from the step interrupt
+    static inline void step(uint8_t info, uint16_t time) {
+        if (!recording) return;
+        if (!(info & STEPTRACE_STATE)) {
+            if (--skip) return;
+            skip = decimation;
+        }
+        ring[head].time = time;
+        ring[head].info = info;
+        head = (head + 1) & mask;
+        if (count <= mask) count++;
+    }
+
+private:
+    static StepTraceRecord* ring;   // Recorded events
+    static uint8_t mask;            // Ring size - 1
+    static uint8_t decimation;      // Step events per kept one
+    static volatile uint8_t skip;   // Step events until the next kept one
+    static volatile uint8_t head;   // Ring index of the next record
+    static volatile uint8_t count;  // Records in the ring
+    static volatile bool recording; // Capture runs
+    static uint8_t triggers;        // Triggers that stop the capture
+    static volatile uint8_t triggered; // Trigger that stopped the capture
+};
+
+#endif  // STEPTRACE_H
@@ -0,0 +1,60 @@
+#include <FastStepper.h>
+
+// Measures the max step rate per axis when 1 to 4 axes run at once,
+// independently and synchronized. Read the results from Serial.
+FastStepper stepper1(FastStepper::DRIVER, 12, 11);
+FastStepper stepper2(FastStepper::DRIVER, 10, 9);
+FastStepper stepper3(FastStepper::DRIVER, 8, 7);
+FastStepper stepper4(FastStepper::DRIVER, 6, 5);
+         // pins: STEP DIR
+
+FastStepper* steppers[] = {&stepper1, &stepper2, &stepper3, &stepper4};
+const long steps = 20000;
+
+void report(const char* mode, uint8_t axes, unsigned long time) {
+	Serial.print(mode);
+	Serial.print(" axes: ");
+	Serial.print(axes);
+	Serial.print(" steps/s per axis: ");
+	Serial.println(steps * 1000000.0 / time);
+}
+
+void setup(void) {
+	Serial.begin(115200);
+	for (uint8_t i = 0; i < 4; i++) {
+		steppers[i]->begin();
+		// Ask for far more than the step timer can deliver, so the CPU is the limit
+		steppers[i]->setMaxSpeed(100000);
+		steppers[i]->setAcceleration(1000000);
+	}
+
+	for (uint8_t axes = 1; axes <= 4; axes++) {
+		long targets[4];
+		for (uint8_t i = 0; i < axes; i++) {
+			steppers[i]->setCurrentPosition(0);
+			targets[i] = steps;
+		}
+
+		unsigned long startTime = micros();
+		for (uint8_t i = 0; i < axes; i++) {
+			steppers[i]->moveTo(steps);
+		}
+		for (uint8_t i = 0; i < axes; i++) {
+			while (steppers[i]->isRunning()) {}
+		}
+		report("independent", axes, micros() - startTime);
+
+		for (uint8_t i = 0; i < axes; i++) {
+			steppers[i]->setCurrentPosition(0);
+		}
+		startTime = micros();
+		FastStepper::moveSynchronized(steppers, targets, axes);
+		for (uint8_t i = 0; i < axes; i++) {
+			while (steppers[i]->isRunning()) {}
+		}
+		report("synchronized", axes, micros() - startTime);
+	}
+}
+
+void loop() {
+}
@@ -0,0 +1,41 @@
+#include <FastStepper.h>
+
+// Measures the max sustained step rate of a single axis.
+// Run it on a Nano or under simavr and read the result from Serial.
+FastStepper stepper(FastStepper::DRIVER, 12, 11);
+         // pins: STEP DIR
+
+// to see the speed of AccelStepper, comment out the FastStepper
+// lines above, and uncomment these 2 lines.
+//#include <AccelStepper.h>
+//AccelStepper stepper(AccelStepper::DRIVER, 12, 11);
+
+const long steps = 20000;
+
+void setup(void) {
+	Serial.begin(115200);
+#ifdef FASTSTEPPER_H
+	stepper.begin();
+#endif
+	// Ask for far more than the loop can deliver, so the loop is the limit
+	stepper.setMaxSpeed(100000);
+	stepper.setAcceleration(1000000);
+	stepper.setCurrentPosition(0);
+	stepper.moveTo(steps);
+
+	unsigned long startTime = micros();
+	while (stepper.distanceToGo() != 0) {
+		stepper.run();
+	}
+	unsigned long endTime = micros();
+
+	Serial.print("steps: ");
+	Serial.println(steps);
+	Serial.print("micros: ");
+	Serial.println(endTime - startTime);
+	Serial.print("steps/s: ");
+	Serial.println(steps * 1000000.0 / (endTime - startTime));
+}
+
+void loop() {
+}
@@ -0,0 +1,148 @@
+#include "EventLog.h"
+#include <avr/eeprom.h>
+
+// Unwritten EEPROM reads 0xFF
+#define EMPTY_SEQUENCE 0xFFFF
+#define CHECKSUM_SEED 0x5A
+
+static uint8_t checksum(const uint8_t* data, uint8_t length) {
+    uint8_t sum = CHECKSUM_SEED;
+    for (uint8_t i = 0; i < length; i++) sum += data[i];
+    return sum;
+}
+
+static uint8_t* slotAddress(uint8_t index) {
+    return (uint8_t*)(uintptr_t)(EVENTLOG_EEPROM_ADDRESS + index * EVENTLOG_SLOT_SIZE);
+}
+
+EventLog::EventLog() {
+    this->ringHead = 0;
+    this->pending = 0;
+    this->stored = 0;
+    this->nextSlot = 0;
+    this->nextSequence = 0;
+    this->flushing = false;
+    this->writeOffset = EVENTLOG_SLOT_SIZE;
+    this->lastLoop = 0;
+    this->loopMax = 0;
+}
+
+void EventLog::begin() {
+    // The newest valid slot is the one with the highest sequence number
+    EventRecord record;
+    uint16_t sequence, newest = 0;
+    stored = 0;
+    for (uint8_t i = 0; i < EVENTLOG_EEPROM_SLOTS; i++) {
+        if (!readSlot(i, record, sequence)) continue;
+        if (stored == 0 || (int16_t)(sequence - newest) > 0) {
+            newest = sequence;
+            nextSlot = (i + 1) % EVENTLOG_EEPROM_SLOTS;
+        }
+        stored++;
+    }
+    nextSequence = stored ? newest + 1 : 0;
+    if (nextSequence == EMPTY_SEQUENCE) nextSequence = 0;
+    lastLoop = micros();
+}
+
+void EventLog::log(uint8_t code, long position, uint8_t sensors) {
+    if (pending == EVENTLOG_RAM_SIZE) {
+        // Ring full: give up the oldest record, also if it is being written
+        writeOffset = EVENTLOG_SLOT_SIZE;
+        pending--;
+    }
+    EventRecord& record = ring[ringHead];
+    record.time = millis();
+    record.position = position;
+    record.loopMax = loopMax;
+    record.code = code;
+    record.sensors = sensors;
+    ringHead = (ringHead + 1) % EVENTLOG_RAM_SIZE;
+    pending++;
+    loopMax = 0;
+}
+
+void EventLog::flush() {
+    flushing = true;
+}
+
+void EventLog::update() {
+    unsigned long now = micros();
+    unsigned long loopTime = now - lastLoop;
+    lastLoop = now;
+    if (loopTime > loopMax) loopMax = loopTime > 0xFFFF ? 0xFFFF : loopTime;
+
+    if (writeOffset == EVENTLOG_SLOT_SIZE) {
+        if (pending == 0) {
+            flushing = false;
+            return;
+        }
+        if (!flushing && pending < EVENTLOG_FLUSH_BATCH) return;
+        startWrite();
+    }
+
+    // One byte per call, an EEPROM write takes 3.3 ms
+    if (!eeprom_is_ready()) return;
+    eeprom_update_byte(slotAddress(nextSlot) + writeOffset, slot[writeOffset]);
+    writeOffset++;
+    if (writeOffset < EVENTLOG_SLOT_SIZE) return;
+
+    // The oldest pending record is in EEPROM now
+    nextSlot = (nextSlot + 1) % EVENTLOG_EEPROM_SLOTS;
+    nextSequence = (nextSequence + 1 == EMPTY_SEQUENCE) ? 0 : nextSequence + 1;
+    if (stored < EVENTLOG_EEPROM_SLOTS) stored++;
+    pending--;
+}
+
+uint8_t EventLog::count() {
+    return pending + stored;
+}
+
+bool EventLog::get(uint8_t index, EventRecord& record) {
+    if (index < pending) {
+        record = ring[(ringHead + EVENTLOG_RAM_SIZE - 1 - index) % EVENTLOG_RAM_SIZE];
+        return true;
+    }
+    index -= pending;
+    if (index >= stored) return false;
+    uint16_t sequence;
+    return readSlot((nextSlot + EVENTLOG_EEPROM_SLOTS - 1 - index) % EVENTLOG_EEPROM_SLOTS, record, sequence);
+}
+
+void EventLog::dump(Print& out) {
+    out.println(F("index,time_ms,code,position,sensors,loop_us"));
+    EventRecord record;
+    for (int16_t i = count() - 1; i >= 0; i--) {
+        if (!get(i, record)) continue;
+        out.print(i);
+        out.print(',');
+        out.print(record.time);
+        out.print(',');
+        out.print(record.code);
+        out.print(',');
+        out.print(record.position);
+        out.print(',');
+        out.print(record.sensors);
+        out.print(',');
+        out.println(record.loopMax);
+    }
+}
+
+bool EventLog::readSlot(uint8_t index, EventRecord& record, uint16_t& sequence) {
+    uint8_t data[EVENTLOG_SLOT_SIZE];
+    eeprom_read_block(data, slotAddress(index), EVENTLOG_SLOT_SIZE);
+    sequence = data[0] | (data[1] << 8);
+    if (sequence == EMPTY_SEQUENCE) return false;
+    if (checksum(data, EVENTLOG_SLOT_SIZE - 1) != data[EVENTLOG_SLOT_SIZE - 1]) return false;
+    memcpy(&record, data + 2, sizeof(EventRecord));
+    return true;
+}
+
+void EventLog::startWrite() {
+    const EventRecord& record = ring[(ringHead + EVENTLOG_RAM_SIZE - pending) % EVENTLOG_RAM_SIZE];
+    slot[0] = (uint8_t)nextSequence;
+    slot[1] = (uint8_t)(nextSequence >> 8);
+    memcpy(slot + 2, &record, sizeof(EventRecord));
+    slot[EVENTLOG_SLOT_SIZE - 1] = checksum(slot, EVENTLOG_SLOT_SIZE - 1);
+    writeOffset = 0;
+}
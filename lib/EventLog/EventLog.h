@@ -0,0 +1,70 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <Arduino.h>
+
+#define EVENTLOG_EEPROM_ADDRESS 0   // First EEPROM byte of the log
+#define EVENTLOG_EEPROM_SLOTS 32    // Records kept in EEPROM
+#define EVENTLOG_RAM_SIZE 8         // Records buffered in RAM until they are written
+#define EVENTLOG_FLUSH_BATCH 4      // Buffered records that start writing without flush()
+#define EVENTLOG_SLOT_SIZE 15       // Sequence number (2), record (12), checksum (1)
+
+// Event codes
+typedef enum {
+    EVENT_NONE,         // Unused
+    EVENT_BOOT,         // Power up
+    EVENT_HOMED,        // Homing finished
+    EVENT_HOMING_ERROR, // Homing ended in ERROR
+    EVENT_PROBED,       // Probing finished
+    EVENT_PROBING_ERROR,// Probing ended in ERROR
+    EVENT_FAULT,        // Emergency stop by an endstop
+    EVENT_STEP_LOSS,    // Following error of the position encoder exceeded
+    EVENT_POWER_FAIL,   // Position saved at a supply failure, logged at the next start
+    EVENT_SCALE_ERROR   // Position encoder edges too close to decode, no more corrections
+} EventCode;
+
+// One logged event
+typedef struct {
+    uint32_t time;      // Time since power up in ms
+    int32_t position;   // Axis position in steps
+    uint16_t loopMax;   // Longest loop time since the previous event in us
+    uint8_t code;       // Event code (EVENT_*)
+    uint8_t sensors;    // Axis sensor bits (SENSOR_*)
+} EventRecord;
+
+// Fixed-size event log. Events go into a RAM ring, which is written to EEPROM in
+// batches, one byte per update() so the loop never waits for the EEPROM. The
+// EEPROM slots are written in turn and the newest one is found by its sequence
+// number, so every cell is written once per pass through the log.
+class EventLog {
+public:
+    // Constructor of the class
+    EventLog();
+
+    void begin();               // Find the newest record in EEPROM, call from setup()
+    void log(uint8_t code, long position, uint8_t sensors); // Add an event
+    void flush();               // Write all buffered events, e.g. after an error
+    void update();              // Track the loop time and write to EEPROM, call once per loop
+
+    uint8_t count();            // Number of records in RAM and EEPROM
+    bool get(uint8_t index, EventRecord& record); // Get a record, 0 = newest. Returns false if it is not valid
+    void dump(Print& out);      // Print all records as CSV, oldest first
+
+private:
+    EventRecord ring[EVENTLOG_RAM_SIZE]; // Records not yet in EEPROM
+    uint8_t ringHead;           // Ring index of the next record
+    uint8_t pending;            // Records in the ring not yet in EEPROM
+    uint8_t stored;             // Records in EEPROM
+    uint8_t nextSlot;           // EEPROM slot of the next record
+    uint16_t nextSequence;      // Sequence number of the next record
+    bool flushing;              // Write all pending records
+    uint8_t slot[EVENTLOG_SLOT_SIZE]; // EEPROM slot being written
+    uint8_t writeOffset;        // Bytes of the slot written, EVENTLOG_SLOT_SIZE when idle
+    unsigned long lastLoop;     // Time of the previous update in us
+    uint16_t loopMax;           // Longest loop time since the previous event in us
+
+    bool readSlot(uint8_t index, EventRecord& record, uint16_t& sequence); // Read and check an EEPROM slot
+    void startWrite();          // Copy the oldest pending record into the slot buffer
+};
+
+#endif  // EVENTLOG_H
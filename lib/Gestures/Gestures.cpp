@@ -0,0 +1,143 @@
+#include "Gestures.h"
+
+Gestures::Gestures() {
+    this->head = 0;
+    this->count = 0;
+    this->doubleClickTime = GESTURE_DOUBLE_CLICK_MS;
+    this->longPressTime = GESTURE_LONG_PRESS_MS;
+    this->repeatInterval = GESTURE_REPEAT_MS;
+    this->rotateWindow = GESTURE_ROTATE_WINDOW_MS;
+    this->pressed = false;
+    this->ignore = false;
+    this->longSent = false;
+    this->clickPending = false;
+    this->repeats = 0;
+    this->pressTime = 0;
+    this->clickTime = 0;
+    this->nextRepeat = 0;
+    this->started = false;
+    this->lastDetents = 0;
+    this->rotateTime = 0;
+}
+
+void Gestures::setTiming(uint16_t doubleClick, uint16_t longPress, uint16_t repeat) {
+    doubleClickTime = doubleClick;
+    longPressTime = longPress;
+    repeatInterval = repeat;
+}
+
+void Gestures::setRotateWindow(uint16_t window) {
+    rotateWindow = window;
+}
+
+void Gestures::update(bool pressed, int16_t detents) {
+    unsigned long now = millis();
+
+    if (!started) {
+        started = true;
+        lastDetents = detents;
+        rotateTime = now;
+    } else if (detents != lastDetents) {
+        rotate(detents - lastDetents, now);
+        lastDetents = detents;
+    }
+
+    if (pressed && !this->pressed) {
+        // Went down, a pending click becomes a double click at the release
+        this->pressed = true;
+        pressTime = now;
+        longSent = false;
+        repeats = 0;
+    } else if (!pressed && this->pressed) {
+        this->pressed = false;
+        if (ignore) {
+            ignore = false;
+        } else if (!longSent) {
+            if (clickPending) {
+                clickPending = false;
+                push(GESTURE_DOUBLE_CLICK, now, 0, 0);
+            } else if (doubleClickTime == 0) {
+                push(GESTURE_CLICK, now, 0, 0);
+            } else {
+                clickPending = true;
+                clickTime = now;
+            }
+        }
+    }
+
+    if (this->pressed && !ignore) {
+        if (!longSent && now - pressTime >= longPressTime) {
+            // A click before the long press still counts
+            if (clickPending) {
+                clickPending = false;
+                push(GESTURE_CLICK, clickTime, 0, 0);
+            }
+            longSent = true;
+            nextRepeat = now + repeatInterval;
+            push(GESTURE_LONG_PRESS, now, 0, 0);
+        } else if (longSent && repeatInterval && (long)(now - nextRepeat) >= 0) {
+            nextRepeat += repeatInterval;
+            if (repeats < 127) repeats++;
+            push(GESTURE_REPEAT, now, repeats, 0);
+        }
+    } else if (clickPending && now - clickTime > doubleClickTime) {
+        clickPending = false;
+        push(GESTURE_CLICK, clickTime, 0, 0);
+    }
+}
+
+bool Gestures::next(Gesture& gesture) {
+    if (count == 0) return false;
+    gesture = queue[head];
+    head = (head + 1) % GESTURE_QUEUE_SIZE;
+    count--;
+    return true;
+}
+
+void Gestures::flush() {
+    count = 0;
+    clickPending = false;
+    if (pressed) ignore = true;
+    started = false;
+}
+
+bool Gestures::isPressed() {
+    return pressed;
+}
+
+void Gestures::push(uint8_t type, unsigned long time, int8_t value, uint16_t rate) {
+    // A full queue drops the new gesture, the reader is behind anyway
+    if (count == GESTURE_QUEUE_SIZE) return;
+    Gesture& gesture = queue[(head + count) % GESTURE_QUEUE_SIZE];
+    gesture.time = time;
+    gesture.type = type;
+    gesture.count = value;
+    gesture.rate = rate;
+    count++;
+}
+
+void Gestures::rotate(int16_t delta, unsigned long now) {
+    unsigned long interval = now - rotateTime;
+    rotateTime = now;
+    // After a pause the detents were still turned within one window
+    if (interval > rotateWindow) interval = rotateWindow;
+    if (interval == 0) interval = 1;
+    uint16_t rate = min((unsigned long)abs(delta) * 1000 / interval, 0xFFFFUL);
+
+    // Merge into the newest gesture while it is an unread rotation in the same direction
+    if (count) {
+        Gesture& last = queue[(head + count - 1) % GESTURE_QUEUE_SIZE];
+        int16_t sum = last.count + delta;
+        if (last.type == GESTURE_ROTATE && (last.count > 0) == (delta > 0) && sum >= -128 && sum <= 127) {
+            last.count = sum;
+            last.rate = rate;
+            last.time = now;
+            return;
+        }
+    }
+    while (delta) {
+        int8_t part = constrain(delta, -128, 127);
+        push(GESTURE_ROTATE, now, part, rate);
+        delta -= part;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef GESTURES_H
+#define GESTURES_H
+
+#include <Arduino.h>
+
+#define GESTURE_QUEUE_SIZE 8        // Gestures waiting to be read
+
+// Default timing in ms
+#define GESTURE_DOUBLE_CLICK_MS 0   // Window for a second click, 0 = clicks without waiting
+#define GESTURE_LONG_PRESS_MS 1000  // Hold time of a long press
+#define GESTURE_REPEAT_MS 200       // Interval of the repeats after a long press, 0 = none
+#define GESTURE_ROTATE_WINDOW_MS 1000 // Longest time the detents of one rotation are spread over
+
+// Gesture types
+typedef enum {
+    GESTURE_NONE,           // No gesture
+    GESTURE_CLICK,          // Short press, reported at the release
+    GESTURE_DOUBLE_CLICK,   // Second short press within the double click window
+    GESTURE_LONG_PRESS,     // Button held for the long press time, reported while held
+    GESTURE_REPEAT,         // Button still held, one per repeat interval after the long press
+    GESTURE_ROTATE          // Encoder turned
+} GestureType;
+
+// One gesture
+typedef struct {
+    unsigned long time;     // Time of detection in ms
+    uint8_t type;           // Gesture type (GESTURE_*)
+    int8_t count;           // Detents of a rotation, number of a repeat
+    uint16_t rate;          // Rotation speed in detents/s
+} Gesture;
+
+// Turns the button level and the encoder detents into a queue of gestures. Each
+// gesture is read once; flush() drops the queue and the rest of a held press, so
+// a press that switched screens never reaches the next one, and takes the next
+// encoder count as the new base, so a jump of the count is not a rotation.
+// Rotations are merged into the newest queued one while it is not read yet. Their
+// rate is the detents over the time since the previous change, at most the rotate
+// window: a caller that reads the encoder every n ms sets the window to n, so the
+// first detents after a pause count as turned within one read.
+class Gestures {
+public:
+    // Constructor of the class
+    Gestures();
+
+    void setTiming(uint16_t doubleClick, uint16_t longPress, uint16_t repeat); // Set the timing in ms
+    void setRotateWindow(uint16_t window); // Set the longest time in ms the detents of one update are spread over
+    void update(bool pressed, int16_t detents); // Detect gestures from the debounced button and the encoder, call once per loop
+    bool next(Gesture& gesture); // Take the oldest gesture, returns false if there is none
+    void flush();               // Drop the queued gestures, ignore the button until it is released and rebase the encoder
+    bool isPressed();           // Check if the button is held
+
+private:
+    Gesture queue[GESTURE_QUEUE_SIZE]; // Gestures not yet read
+    uint8_t head;               // Queue index of the oldest gesture
+    uint8_t count;              // Gestures in the queue
+    uint16_t doubleClickTime;   // Timing in ms
+    uint16_t longPressTime;
+    uint16_t repeatInterval;
+    uint16_t rotateWindow;
+    bool pressed;               // Button held
+    bool ignore;                // Ignore the held press, it was flushed
+    bool longSent;              // Long press of the held press reported
+    bool clickPending;          // Click waiting for a second one
+    uint8_t repeats;            // Repeats of the held press
+    unsigned long pressTime;    // Time the button went down in ms
+    unsigned long clickTime;    // Time of the pending click in ms
+    unsigned long nextRepeat;   // Time of the next repeat in ms
+    bool started;               // Encoder detents read once
+    int16_t lastDetents;        // Encoder detents of the previous update
+    unsigned long rotateTime;   // Time of the previous detent change in ms
+
+    void push(uint8_t type, unsigned long time, int8_t value, uint16_t rate); // Queue a gesture
+    void rotate(int16_t delta, unsigned long now); // Queue or merge a rotation
+};
+
+#endif  // GESTURES_H
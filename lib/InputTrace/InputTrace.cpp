@@ -0,0 +1,169 @@
+#include "InputTrace.h"
+
+// Trace modes
+#define MODE_IDLE 0
+#define MODE_RECORD 1
+#define MODE_REPLAY 2
+
+InputTrace::InputTrace(Stream& stream) : stream(stream) {
+    this->mode = MODE_IDLE;
+    this->lastTime = 0;
+    this->lastWrite = 0;
+    this->lastLoop = 0;
+    this->maxLoop = 0;
+    this->lastEncoder = 0;
+    this->lastButton = true;
+    this->lastSensors = 0;
+    this->lastState = 0;
+    this->hasStart = false;
+    this->startScreen = 0;
+    this->recordLength = 0;
+}
+
+void InputTrace::startRecording(int16_t encoder, bool button, uint8_t sensors, uint16_t screen) {
+    mode = MODE_RECORD;
+    lastWrite = millis();
+    lastLoop = micros();
+    maxLoop = 0;
+    lastEncoder = encoder;
+    lastButton = button;
+    lastSensors = sensors;
+    lastState = 0xFFFF;         // The first sample writes the state
+    write(TRACE_START, screen);
+    write(TRACE_ENCODER, encoder);
+    write(TRACE_BUTTON, button);
+    write(TRACE_SENSORS, sensors);
+}
+
+void InputTrace::startReplay() {
+    mode = MODE_REPLAY;
+    lastTime = millis();
+    lastWrite = lastTime;
+    lastLoop = micros();
+    maxLoop = 0;
+    recordLength = 0;
+    lastState = 0xFFFF;
+    hasStart = false;
+}
+
+void InputTrace::stop() {
+    if (mode == MODE_RECORD) write(TRACE_END, 0);
+    mode = MODE_IDLE;
+}
+
+bool InputTrace::isRecording() {
+    return mode == MODE_RECORD;
+}
+
+bool InputTrace::isReplaying() {
+    return mode == MODE_REPLAY;
+}
+
+void InputTrace::sample(int16_t encoder, bool button, uint8_t sensors, uint16_t state) {
+    if (mode == MODE_IDLE) return;
+
+    unsigned long now = micros();
+    unsigned long loopTime = now - lastLoop;
+    lastLoop = now;
+    if (loopTime > maxLoop) maxLoop = loopTime > 0xFFFF ? 0xFFFF : loopTime;
+
+    // Inputs come from the trace while replaying
+    if (mode == MODE_RECORD) {
+        if (encoder != lastEncoder) {
+            lastEncoder = encoder;
+            write(TRACE_ENCODER, encoder);
+        }
+        if (button != lastButton) {
+            lastButton = button;
+            write(TRACE_BUTTON, button);
+        }
+        if (sensors != lastSensors) {
+            lastSensors = sensors;
+            write(TRACE_SENSORS, sensors);
+        }
+    }
+    if (state != lastState) {
+        lastState = state;
+        write(TRACE_STATE, state);
+        write(TRACE_LOOP, maxLoop);
+        maxLoop = 0;
+    }
+}
+
+void InputTrace::update() {
+    if (mode != MODE_REPLAY) return;
+
+    while (true) {
+        if (recordLength < TRACE_RECORD_SIZE) {
+            if (!stream.available()) return;
+            uint8_t value = stream.read();
+            if (recordLength == 0 && value != TRACE_SYNC) continue;
+            record[recordLength++] = value;
+            continue;
+        }
+
+        // Wait until the record is due
+        uint16_t delta = record[2] | (record[3] << 8);
+        if (millis() - lastTime < delta) return;
+        lastTime += delta;
+        recordLength = 0;
+
+        int16_t value = record[4] | (record[5] << 8);
+        switch (record[1]) {
+            case TRACE_START:
+                // Times count from here, the following records give the inputs
+                lastTime = millis();
+                startScreen = value;
+                hasStart = true;
+                break;
+            case TRACE_ENCODER:
+                lastEncoder = value;
+                break;
+            case TRACE_BUTTON:
+                lastButton = value;
+                break;
+            case TRACE_SENSORS:
+                lastSensors = value;
+                break;
+            case TRACE_END:
+                stop();
+                return;
+            default:
+                break;
+        }
+    }
+}
+
+int16_t InputTrace::encoder() {
+    return lastEncoder;
+}
+
+bool InputTrace::button() {
+    return lastButton;
+}
+
+uint8_t InputTrace::sensors() {
+    return lastSensors;
+}
+
+bool InputTrace::getStartState(uint16_t& screen) {
+    if (!hasStart) return false;
+    hasStart = false;
+    screen = startScreen;
+    return true;
+}
+
+void InputTrace::write(uint8_t type, int16_t value) {
+    // Own time base, the state records written during a replay must not delay the replayed ones
+    unsigned long now = millis();
+    unsigned long delta = now - lastWrite;
+    if (delta > 0xFFFF) delta = 0xFFFF;
+    lastWrite += delta;
+
+    uint8_t buffer[TRACE_RECORD_SIZE] = {
+        TRACE_SYNC, type,
+        (uint8_t)delta, (uint8_t)(delta >> 8),
+        (uint8_t)value, (uint8_t)(value >> 8)
+    };
+    stream.write(buffer, TRACE_RECORD_SIZE);
+}
@@ -0,0 +1,72 @@
+#ifndef INPUTTRACE_H
+#define INPUTTRACE_H
+
+#include <Arduino.h>
+
+#define TRACE_SYNC 0xFE         // First byte of every record, never part of text output
+#define TRACE_RECORD_SIZE 6     // Sync, type, time since previous record in ms (2), value (2)
+
+// Record types
+typedef enum {
+    TRACE_ENCODER = 1,  // Encoder count
+    TRACE_BUTTON,       // Button pin level
+    TRACE_SENSORS,      // Axis sensor bits (SENSOR_*)
+    TRACE_STATE,        // Screen state << 8 | axis state, recorded only
+    TRACE_LOOP,         // Longest loop time in us since the previous state record, recorded only
+    TRACE_END,          // End of the trace
+    TRACE_START         // Screen << 8 | menu line, followed by the encoder, button and sensor records
+} TraceType;
+
+// Records timestamped input events as compact binary records over a stream, and
+// replays such a trace from the same stream in place of the real inputs.
+// Records are little endian; the host has to pace a replay so the receive
+// buffer never holds more than the next few records.
+//
+// A recording starts with the full input state: a start record with the screen,
+// then the encoder, button and sensor values at that moment. A replay applies
+// them before anything else: the times count from the start record and
+// getStartState() hands the screen to the sketch. The encoder count is replayed
+// as recorded, the sketch has to take the jump from and back to the live count
+// as no rotation. stop() ends a recording with an end record.
+class InputTrace {
+public:
+    // Constructor of the class
+    InputTrace(Stream& stream);
+
+    // Start writing input changes to the stream, beginning with the current inputs and screen
+    void startRecording(int16_t encoder, bool button, uint8_t sensors, uint16_t screen);
+    void startReplay();         // Start reading inputs from the stream
+    void stop();                // Stop recording or replay
+    bool isRecording();         // Check if recording
+    bool isReplaying();         // Check if replaying
+
+    // Record changed inputs and states, call once per loop
+    void sample(int16_t encoder, bool button, uint8_t sensors, uint16_t state);
+    void update();              // Apply due replay records, call once per loop
+
+    // Replayed inputs
+    int16_t encoder();          // Get replayed encoder count
+    bool button();              // Get replayed button pin level
+    uint8_t sensors();          // Get replayed sensor bits
+    bool getStartState(uint16_t& screen); // Get the screen of a start record replayed since the last call, returns false if there was none
+
+private:
+    Stream& stream;             // Stream the trace is written to and read from
+    uint8_t mode;               // Idle, recording or replaying
+    unsigned long lastTime;     // Time of the previous replayed record in ms
+    unsigned long lastWrite;    // Time of the previous written record in ms
+    unsigned long lastLoop;     // Time of the previous sample in us
+    uint16_t maxLoop;           // Longest loop time since the previous state record in us
+    int16_t lastEncoder;        // Last recorded or replayed encoder count
+    bool lastButton;            // Last recorded or replayed button level
+    uint8_t lastSensors;        // Last recorded or replayed sensor bits
+    uint16_t lastState;         // Last recorded state
+    bool hasStart;              // A start record was replayed and not yet read
+    uint16_t startScreen;       // Screen of that start record
+    uint8_t record[TRACE_RECORD_SIZE]; // Replay record being received
+    uint8_t recordLength;       // Bytes of the replay record received
+
+    void write(uint8_t type, int16_t value); // Write one record
+};
+
+#endif  // INPUTTRACE_H
@@ -0,0 +1,253 @@
+#include "JobProgram.h"
+#include <avr/eeprom.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define JOB_MAGIC 0x70      // First EEPROM byte of a stored program
+
+JobProgram::JobProgram(Axis& axis) : axis(axis) {
+    this->count = 0;
+    this->index = 0;
+    this->running = false;
+    this->waiting = false;
+    this->moving = false;
+    this->speed = axis.getPlungeSpeed();
+    this->receiving = false;
+    this->lineLength = 0;
+    this->lineOverflow = false;
+    this->lineNumber = 0;
+    this->uploadResult = JOB_UPLOAD_OK;
+    this->rejectedLine = 0;
+    this->lastReceive = 0;
+}
+
+bool JobProgram::load(int address) {
+    const uint8_t* eeprom = (const uint8_t*)(uintptr_t)address;
+    uint8_t stored = eeprom_read_byte(eeprom + 1);
+    if (eeprom_read_byte(eeprom) != JOB_MAGIC || stored > JOB_MAX_STEPS) return false;
+    eeprom_read_block(steps, eeprom + 2, stored * sizeof(JobStep));
+    count = stored;
+    for (uint8_t i = 0; i < count; i++) steps[i] = limit(steps[i]);
+    return true;
+}
+
+void JobProgram::save(int address) {
+    uint8_t* eeprom = (uint8_t*)(uintptr_t)address;
+    eeprom_update_byte(eeprom, JOB_MAGIC);
+    eeprom_update_byte(eeprom + 1, count);
+    eeprom_update_block(steps, eeprom + 2, count * sizeof(JobStep));
+}
+
+void JobProgram::clear() {
+    stop();
+    count = 0;
+}
+
+bool JobProgram::add(uint8_t type, int16_t value) {
+    if (count >= JOB_MAX_STEPS) return false;
+    steps[count].type = type;
+    steps[count].value = value;
+    steps[count] = limit(steps[count]);
+    count++;
+    return true;
+}
+
+uint8_t JobProgram::length() {
+    return count;
+}
+
+JobStep JobProgram::get(uint8_t index) {
+    return steps[index];
+}
+
+void JobProgram::set(uint8_t index, JobStep step) {
+    if (index < count) steps[index] = limit(step);
+}
+
+void JobProgram::print(Print& out) {
+    for (uint8_t i = 0; i < count; i++) {
+        switch (steps[i].type) {
+            case JOB_MOVE:
+                out.print(F("M "));
+                out.println(steps[i].value / 100.0);
+                break;
+            case JOB_SPEED:
+                out.print(F("S "));
+                out.println(steps[i].value);
+                break;
+            case JOB_CONFIRM:
+                out.println('C');
+                break;
+            default:
+                break;
+        }
+    }
+    out.println('E');
+}
+
+void JobProgram::startReceive() {
+    clear();
+    receiving = true;
+    lineLength = 0;
+    lineOverflow = false;
+    lineNumber = 0;
+    uploadResult = JOB_UPLOAD_OK;
+    rejectedLine = 0;
+    lastReceive = millis();
+}
+
+bool JobProgram::isReceiving() {
+    return receiving;
+}
+
+uint8_t JobProgram::getUploadResult() {
+    return uploadResult;
+}
+
+uint8_t JobProgram::getRejectedLine() {
+    return rejectedLine;
+}
+
+void JobProgram::receive(char c) {
+    if (!receiving) return;
+    lastReceive = millis();
+    if (c == JOB_ABORT_CHAR) {
+        endReceive(JOB_UPLOAD_ABORTED);
+    } else if (c == '\n' || c == '\r') {
+        line[lineLength] = '\0';
+        if (lineLength) {
+            lineNumber++;
+            // The first bad line rejects the upload, the rest is read up to the end line
+            bool valid = !lineOverflow && parseLine();
+            if (!valid && uploadResult == JOB_UPLOAD_OK) {
+                uploadResult = JOB_UPLOAD_REJECTED;
+                rejectedLine = lineNumber;
+            }
+        }
+        lineLength = 0;
+        lineOverflow = false;
+    } else if (lineLength < JOB_LINE_LENGTH - 1) {
+        line[lineLength++] = c;
+    } else {
+        lineOverflow = true;
+    }
+}
+
+bool JobProgram::parseLine() {
+    char* text = line;
+    while (*text == ' ' || *text == '\t') text++;
+    char command = *text++;
+    if (command >= 'a' && command <= 'z') command -= 'a' - 'A';
+
+    // Moves and speeds need a number and nothing after it
+    double value = 0;
+    if (command == 'M' || command == 'S') {
+        char* end;
+        value = strtod(text, &end);
+        if (end == text || isnan(value) || isinf(value)) return false;
+        text = end;
+    }
+    while (*text == ' ' || *text == '\t') text++;
+    if (*text) return false;
+
+    switch (command) {
+        case 'M':
+            // Clamped before the conversion, the height has to fit into 0.01 mm steps
+            value = constrain(value, -axis.getTravel(), axis.getTravel());
+            return uploadResult != JOB_UPLOAD_OK || add(JOB_MOVE, static_cast<int16_t>(value * 100.0 + (value < 0 ? -0.5 : 0.5)));
+        case 'S':
+            if (value < 0) return false;
+            value = min(value, (double)axis.getMoveSpeed());
+            return uploadResult != JOB_UPLOAD_OK || add(JOB_SPEED, static_cast<int16_t>(value + 0.5));
+        case 'C':
+            return uploadResult != JOB_UPLOAD_OK || add(JOB_CONFIRM, 0);
+        case 'E':
+            endReceive(uploadResult);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void JobProgram::endReceive(uint8_t result) {
+    receiving = false;
+    uploadResult = result;
+}
+
+JobStep JobProgram::limit(JobStep step) {
+    if (step.type == JOB_MOVE) {
+        int16_t travel = axis.getTravel() * 100.0;
+        step.value = constrain(step.value, -travel, travel);
+    } else if (step.type == JOB_SPEED) {
+        step.value = constrain(step.value, 0, static_cast<int16_t>(axis.getMoveSpeed()));
+    }
+    return step;
+}
+
+void JobProgram::start() {
+    if (count == 0 || !axis.isHomed()) return;
+    index = 0;
+    speed = axis.getPlungeSpeed();
+    running = true;
+    waiting = false;
+    moving = false;
+}
+
+void JobProgram::stop() {
+    running = false;
+    waiting = false;
+    moving = false;
+}
+
+void JobProgram::confirm() {
+    waiting = false;
+}
+
+void JobProgram::update() {
+    // An upload without its end line must not keep the Serial port
+    if (receiving && millis() - lastReceive > JOB_RECEIVE_TIMEOUT_MS) endReceive(JOB_UPLOAD_TIMEOUT);
+    if (!running) return;
+    // Endstops count as errors in isError(), so only stop on a fault or lost home
+    if (axis.isFault() || !axis.isHomed()) {
+        stop();
+        return;
+    }
+    if (waiting) return;
+    if (moving) {
+        if (!axis.inPosition()) return;
+        moving = false;
+    }
+
+    // Run steps until one has to wait
+    while (index < count) {
+        const JobStep& step = steps[index++];
+        switch (step.type) {
+            case JOB_MOVE:
+                axis.moveToPos(step.value / 100.0, speed);
+                moving = true;
+                return;
+            case JOB_SPEED:
+                speed = step.value > 0 ? step.value : axis.getPlungeSpeed();
+                break;
+            case JOB_CONFIRM:
+                waiting = true;
+                return;
+            default:
+                index = count;
+                break;
+        }
+    }
+    running = false;
+}
+
+bool JobProgram::isRunning() {
+    return running;
+}
+
+bool JobProgram::isWaiting() {
+    return waiting;
+}
+
+uint8_t JobProgram::currentStep() {
+    return index ? index - 1 : 0;
+}
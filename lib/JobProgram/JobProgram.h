@@ -0,0 +1,99 @@
+#ifndef JOBPROGRAM_H
+#define JOBPROGRAM_H
+
+#include <Arduino.h>
+#include <Axis.h>
+
+#define JOB_MAX_STEPS 16        // Steps of one program
+#define JOB_LINE_LENGTH 16      // Longest line of a Serial upload
+#define JOB_RECEIVE_TIMEOUT_MS 10000 // Pause in an upload that aborts it
+#define JOB_ABORT_CHAR 0x1B     // ESC aborts an upload
+
+// Step types
+typedef enum {
+    JOB_END,        // End of the program
+    JOB_MOVE,       // Move to a height above the workpiece in 0.01 mm
+    JOB_SPEED,      // Speed of the following moves in mm/s, 0 = plunge speed
+    JOB_CONFIRM     // Wait until the operator confirms
+} JobStepType;
+
+// Result of the last Serial upload
+typedef enum {
+    JOB_UPLOAD_OK,
+    JOB_UPLOAD_REJECTED,    // A line was malformed or did not fit into the program
+    JOB_UPLOAD_TIMEOUT,     // No character for JOB_RECEIVE_TIMEOUT_MS
+    JOB_UPLOAD_ABORTED      // JOB_ABORT_CHAR received
+} JobUploadResult;
+
+// One program step
+typedef struct {
+    uint8_t type;   // Step type (JOB_*)
+    int16_t value;  // Height or speed
+} JobStep;
+
+// Small multi-pass program run through an axis, e.g. the passes of a deep dado:
+// move, confirm, move deeper, confirm... Each step starts as soon as the previous
+// move is in position or the operator confirmed.
+//
+// Serial upload, one step per line: "M 3.5" (height in mm), "S 10" (speed in mm/s),
+// "C" (confirm), "E" ends the upload. A line with anything else, a number that does
+// not parse completely or too many characters rejects the upload; the lines up to
+// "E" are still read, so they never reach the command parser. A pause of
+// JOB_RECEIVE_TIMEOUT_MS or JOB_ABORT_CHAR ends the upload at once. After an upload
+// that is not JOB_UPLOAD_OK the steps are incomplete and the caller reloads the
+// stored program. Heights are clamped to the travel length and speeds to the move
+// speed of the axis, when parsed, loaded or set; the axis clamps the moves to its
+// travel limits when they run.
+class JobProgram {
+public:
+    // Constructor of the class
+    JobProgram(Axis& axis);
+
+    bool load(int address);     // Read the program from EEPROM, returns false if there is none
+    void save(int address);     // Write the program to EEPROM
+
+    void clear();               // Remove all steps
+    bool add(uint8_t type, int16_t value); // Append a step, returns false if the program is full
+    uint8_t length();           // Number of steps
+    JobStep get(uint8_t index); // Get a step
+    void set(uint8_t index, JobStep step); // Replace a step
+    void print(Print& out);     // Print the program in the upload format
+
+    void startReceive();        // Start a Serial upload, replaces the program
+    bool isReceiving();         // Check if an upload runs
+    void receive(char c);       // Feed one received character
+    uint8_t getUploadResult();  // Result of the last upload (JOB_UPLOAD_*)
+    uint8_t getRejectedLine();  // Line of the last upload that rejected it, counting lines with text from 1
+
+    void start();               // Run the program from the first step
+    void stop();                // Stop the program, the axis finishes its move
+    void confirm();             // Continue after a confirm step
+    void update();              // Run the program and time out an upload, call once per loop
+    bool isRunning();           // Check if the program runs
+    bool isWaiting();           // Check if the program waits for a confirm
+    uint8_t currentStep();      // Index of the running step
+
+private:
+    Axis& axis;                 // Axis the program moves
+    JobStep steps[JOB_MAX_STEPS]; // Program steps
+    uint8_t count;              // Number of steps
+    uint8_t index;              // Next step to run
+    bool running;               // Program runs
+    bool waiting;               // Waiting for a confirm
+    bool moving;                // Waiting for the axis to get in position
+    float speed;                // Speed of the moves in mm/s
+    bool receiving;             // Serial upload runs
+    char line[JOB_LINE_LENGTH]; // Upload line being received
+    uint8_t lineLength;         // Characters of the upload line
+    bool lineOverflow;          // The upload line is longer than JOB_LINE_LENGTH - 1
+    uint8_t lineNumber;         // Lines with text of the upload
+    uint8_t uploadResult;       // Result of the last upload (JOB_UPLOAD_*)
+    uint8_t rejectedLine;       // Line that rejected the last upload, 0 = none
+    unsigned long lastReceive;  // Time of the last received character in ms
+
+    bool parseLine();           // Add the step of a received line, returns false if it is malformed
+    void endReceive(uint8_t result); // End the upload
+    JobStep limit(JobStep step); // Clamp the value of a step to the axis
+};
+
+#endif  // JOBPROGRAM_H
@@ -0,0 +1,109 @@
+#include "LcdBar.h"
+
+// A glyph key holds the filled columns (0-5) in bits 0-2 and the marker column + 1
+// (0 = no marker) in bits 3-5. Key 0 is an empty cell and shown as a space.
+#define KEY_FILL(key) ((key) & 0x07)
+#define KEY_MARKER(key) ((key) >> 3)
+#define UNKNOWN 0xFF
+
+// Pixel rows of the fill and the marker, row 7 is left free for the cursor
+#define FILL_FIRST_ROW 1
+#define FILL_LAST_ROW 5
+#define MARKER_LAST_ROW 6
+
+LcdBar::LcdBar(LiquidCrystalFast& lcd, uint8_t col, uint8_t row, uint8_t width) : lcd(lcd) {
+    this->col = col;
+    this->row = row;
+    this->width = width < LCDBAR_MAX_WIDTH ? width : LCDBAR_MAX_WIDTH;
+    this->frame = 0;
+    for (uint8_t i = 0; i < LCDBAR_GLYPHS; i++) {
+        this->slotKey[i] = UNKNOWN;
+        this->slotUsed[i] = 0;
+    }
+    invalidate();
+}
+
+void LcdBar::update(float value, float marker, float low, float high) {
+    if (high <= low) return;
+    frame++;
+    uint8_t fill = pixel(value, low, high);
+    uint8_t mark = pixel(marker, low, high);
+    if (mark == width * LCDBAR_CELL_PIXELS) mark--;
+
+    // Glyphs of all cells. Looking them up marks their slots as used, so the slots
+    // of this and the previous update are never replaced while they are shown.
+    uint8_t keys[LCDBAR_MAX_WIDTH];
+    uint8_t chars[LCDBAR_MAX_WIDTH];
+    for (uint8_t i = 0; i < width; i++) {
+        uint8_t start = i * LCDBAR_CELL_PIXELS;
+        uint8_t key = fill > start ? min(fill - start, LCDBAR_CELL_PIXELS) : 0;
+        if (mark >= start && mark < start + LCDBAR_CELL_PIXELS) key |= (mark - start + 1) << 3;
+        keys[i] = key;
+    }
+    for (uint8_t i = 0; i < width; i++) chars[i] = character(keys[i]);
+
+    // Send the changed cells, the cursor moves on by itself in a run of them
+    bool positioned = false;
+    for (uint8_t i = 0; i < width; i++) {
+        if (keys[i] == shown[i]) {
+            positioned = false;
+            continue;
+        }
+        if (!positioned) lcd.setCursor(col + i, row);
+        lcd.write(chars[i]);
+        shown[i] = keys[i];
+        positioned = true;
+    }
+}
+
+void LcdBar::invalidate() {
+    memset(shown, UNKNOWN, sizeof(shown));
+}
+
+uint8_t LcdBar::pixel(float value, float low, float high) {
+    uint8_t pixels = width * LCDBAR_CELL_PIXELS;
+    if (value <= low) return 0;
+    if (value >= high) return pixels;
+    return static_cast<uint8_t>((value - low) * pixels / (high - low) + 0.5);
+}
+
+uint8_t LcdBar::character(uint8_t key) {
+    if (key == 0) return ' ';
+
+    uint8_t slot = UNKNOWN;
+    for (uint8_t i = 0; i < LCDBAR_GLYPHS; i++) {
+        if (slotKey[i] == key) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == UNKNOWN) {
+        // Replace the slot unused for the longest time, but none of the previous
+        // update: its glyph may still be on the display
+        uint8_t age = 0;
+        for (uint8_t i = 0; i < LCDBAR_GLYPHS; i++) {
+            uint8_t unused = frame - slotUsed[i];
+            if (slotKey[i] == UNKNOWN) unused = 0xFF;
+            if (unused > 1 && unused >= age) {
+                age = unused;
+                slot = i;
+            }
+        }
+        if (slot == UNKNOWN) return ' ';
+
+        uint8_t fillBits = (0x1F << (LCDBAR_CELL_PIXELS - KEY_FILL(key))) & 0x1F;
+        uint8_t markerBits = KEY_MARKER(key) ? 0x10 >> (KEY_MARKER(key) - 1) : 0;
+        uint8_t glyph[8];
+        for (uint8_t y = 0; y < 8; y++) {
+            glyph[y] = 0;
+            if (y >= FILL_FIRST_ROW && y <= FILL_LAST_ROW) glyph[y] |= fillBits;
+            if (y <= MARKER_LAST_ROW) glyph[y] |= markerBits;
+        }
+        lcd.createChar(slot, glyph);
+        slotKey[slot] = key;
+    }
+
+    slotUsed[slot] = frame;
+    return slot;
+}
@@ -0,0 +1,42 @@
+#ifndef LCDBAR_H
+#define LCDBAR_H
+
+#include <Arduino.h>
+#include <LiquidCrystalFast.h>
+
+#define LCDBAR_MAX_WIDTH 20     // Cells of the longest bar
+#define LCDBAR_GLYPHS 8         // CGRAM slots of the LCD, all used by the bar
+#define LCDBAR_CELL_PIXELS 5    // Pixel columns per cell
+
+// Horizontal bar with a marker on one LCD row, with a resolution of one pixel
+// column. Every cell shows a glyph made of its filled columns and the marker, which
+// is generated and loaded into CGRAM when it is needed. The loaded glyphs are cached,
+// so CGRAM is only written for a glyph that is not loaded yet, and only cells whose
+// glyph changed are sent: a bar moving within one cell costs two bus bytes.
+//
+// The bar owns all CGRAM slots. After anything else was drawn over the bar,
+// invalidate() makes the next update send all cells again.
+class LcdBar {
+public:
+    // Constructor of the class
+    LcdBar(LiquidCrystalFast& lcd, uint8_t col, uint8_t row, uint8_t width);
+
+    // Draw the bar filled up to value and the marker at marker, both between low and high
+    void update(float value, float marker, float low, float high);
+    void invalidate();          // The cells were overwritten, send all on the next update
+
+private:
+    LiquidCrystalFast& lcd;     // Display of the bar
+    uint8_t col;                // First cell of the bar
+    uint8_t row;                // Row of the bar
+    uint8_t width;              // Cells of the bar
+    uint8_t shown[LCDBAR_MAX_WIDTH];   // Glyph key on the display per cell, 0xFF = unknown
+    uint8_t slotKey[LCDBAR_GLYPHS];    // Glyph key loaded per CGRAM slot, 0xFF = none
+    uint8_t slotUsed[LCDBAR_GLYPHS];   // Update of the last use per CGRAM slot
+    uint8_t frame;              // Update counter
+
+    uint8_t pixel(float value, float low, float high); // Pixel column of a value
+    uint8_t character(uint8_t key); // Get the LCD character of a glyph key, loads CGRAM if needed
+};
+
+#endif  // LCDBAR_H
@@ -0,0 +1,99 @@
+#include "LcdMirror.h"
+
+static_assert(LCDMIRROR_COLS <= 32, "A row's changed cells are kept in 32 bits");
+
+#define ESCAPE '\\'
+
+LcdMirror::LcdMirror(Print& out) : out(out) {
+    this->running = false;
+    this->cleared = false;
+    lcdClear();
+}
+
+void LcdMirror::start() {
+    // Send a clear, then every cell that is not blank
+    cleared = true;
+    for (uint8_t row = 0; row < LCDMIRROR_ROWS; row++) {
+        changed[row] = 0;
+        for (uint8_t col = 0; col < LCDMIRROR_COLS; col++) {
+            if (screen[row][col] != ' ') changed[row] |= 1UL << col;
+        }
+    }
+    running = true;
+}
+
+void LcdMirror::stop() {
+    running = false;
+}
+
+bool LcdMirror::isRunning() {
+    return running;
+}
+
+void LcdMirror::update() {
+    if (!running) return;
+    int room = out.availableForWrite();
+
+    if (cleared) {
+        if (room < 2) return;
+        out.write('#');
+        out.write('\n');
+        cleared = false;
+        return;
+    }
+
+    for (uint8_t row = 0; row < LCDMIRROR_ROWS; row++) {
+        if (!changed[row]) continue;
+
+        // First changed cell and the run of changed cells that fits into the buffer
+        uint8_t first = 0;
+        while (!(changed[row] & (1UL << first))) first++;
+        uint8_t last = first;
+        int bytes = LCDMIRROR_LINE_OVERHEAD + cost(screen[row][first]);
+        if (bytes > room) return;
+        while (last + 1 < LCDMIRROR_COLS && (changed[row] & (1UL << (last + 1)))) {
+            bytes += cost(screen[row][last + 1]);
+            if (bytes > room) break;
+            last++;
+        }
+
+        out.write('=');
+        out.print(row);
+        out.write(',');
+        out.print(first);
+        out.write(':');
+        for (uint8_t col = first; col <= last; col++) {
+            uint8_t value = screen[row][col];
+            if (cost(value) == 2) {
+                out.write(ESCAPE);
+                if (value < 8) value += '0';
+            }
+            out.write(value);
+            changed[row] &= ~(1UL << col);
+        }
+        out.write('\n');
+        return;
+    }
+}
+
+uint8_t LcdMirror::get(uint8_t col, uint8_t row) {
+    if (col >= LCDMIRROR_COLS || row >= LCDMIRROR_ROWS) return ' ';
+    return screen[row][col];
+}
+
+void LcdMirror::lcdWrite(uint8_t col, uint8_t row, uint8_t value) {
+    if (col >= LCDMIRROR_COLS || row >= LCDMIRROR_ROWS) return;
+    if (screen[row][col] == value) return;
+    screen[row][col] = value;
+    changed[row] |= 1UL << col;
+}
+
+void LcdMirror::lcdClear() {
+    memset(screen, ' ', sizeof(screen));
+    memset(changed, 0, sizeof(changed));
+    cleared = running;
+}
+
+uint8_t LcdMirror::cost(uint8_t value) {
+    return (value < 8 || value == ESCAPE) ? 2 : 1;
+}
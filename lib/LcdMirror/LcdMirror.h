@@ -0,0 +1,42 @@
+#ifndef LCDMIRROR_H
+#define LCDMIRROR_H
+
+#include <Arduino.h>
+#include <LiquidCrystalFast.h>
+
+#define LCDMIRROR_COLS 20       // Columns of the mirrored display, at most 32
+#define LCDMIRROR_ROWS 4        // Rows of the mirrored display
+#define LCDMIRROR_LINE_OVERHEAD 8 // Bytes of a line besides its characters: "=3,19:" and newline
+
+// Mirrors the LCD content to a host. Every character written to the display is kept
+// in a copy of the screen and marked as changed. update() sends one run of changed
+// cells of a row per call, as the line "=<row>,<col>:<text>", and only if it fits
+// into the transmit buffer, so the loop never waits for the serial port.
+//
+// A clear is sent as "#". Custom characters 0..7 are sent as "\0".."\7" and a
+// backslash as "\\", all other bytes as they are.
+class LcdMirror : public LiquidCrystalListener {
+public:
+    // Constructor of the class
+    LcdMirror(Print& out);
+
+    void start();               // Send the whole screen, then its changes
+    void stop();                // Stop sending
+    bool isRunning();           // Check if the mirror is sent
+    void update();              // Send changed cells, call once per loop
+    uint8_t get(uint8_t col, uint8_t row); // Get the character at a position
+
+    void lcdWrite(uint8_t col, uint8_t row, uint8_t value) override;
+    void lcdClear() override;
+
+private:
+    Print& out;                 // Stream the mirror is sent to
+    uint8_t screen[LCDMIRROR_ROWS][LCDMIRROR_COLS]; // Characters on the display
+    uint32_t changed[LCDMIRROR_ROWS]; // Cells not yet sent, one bit per column
+    bool running;               // Mirror is sent
+    bool cleared;               // A clear is not yet sent
+
+    uint8_t cost(uint8_t value); // Bytes needed to send a character
+};
+
+#endif  // LCDMIRROR_H
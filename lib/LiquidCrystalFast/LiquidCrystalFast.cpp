@@ -64,6 +64,14 @@ void LiquidCrystalFast::init(uint8_t rs, uint8_t rw, uint8_t enable, uint8_t en2
 	
 	_setCursFlag = 0;
 	_direction = LCD_Right;
+	resetBusStats();
+	_async = false;
+	_queue = nullptr;
+	_queueSize = 0;
+	_queueHead[0] = _queueHead[1] = 0;
+	_queueCount[0] = _queueCount[1] = 0;
+	_pollChip = 0;
+	_listener = nullptr;
 
 	_data_pins[0] = d0;
 	_data_pins[1] = d1;
@@ -95,6 +103,11 @@ void LiquidCrystalFast::init(uint8_t rs, uint8_t rw, uint8_t enable, uint8_t en2
 
 void LiquidCrystalFast::begin(uint8_t cols, uint8_t lines, uint8_t dotsize)
 {
+	bool async = _async;      // the init sequence needs its timing, send it directly
+	flush();
+	_async = false;
+	_chip = 0;
+	_chipcontrol[0] = _chipcontrol[1] = 0xFF;  // unknown, send on the next change
 	numcols=_numcols=cols;    //there is an implied lack of trust; the private version can't be munged up by the user.
 	numlines=_numlines=lines;
 	row_offsets[2] = cols + row_offsets[0];  //should autoadjust for 16/20 or whatever columns now
@@ -107,6 +120,7 @@ void LiquidCrystalFast::begin(uint8_t cols, uint8_t lines, uint8_t dotsize)
 		_chip = 2;
 		begin2( cols,  lines,  dotsize,_en2);//initialize the second HD44780 chip
 	}
+	_async = async;
 }
 
 void LiquidCrystalFast::begin2(uint8_t cols, uint8_t lines, uint8_t dotsize, uint8_t enable)
@@ -160,7 +174,9 @@ void LiquidCrystalFast::begin2(uint8_t cols, uint8_t lines, uint8_t dotsize, uin
 	command(LCD_FUNCTIONSET | displayfunction);  
 	
 	// turn the display on with no cursor or blinking default
-	_displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;  display();
+	_displaycontrol = LCD_DISPLAYON | LCD_CURSOROFF | LCD_BLINKOFF;
+	command(LCD_DISPLAYCONTROL | _displaycontrol);  // this chip only, the other one may not be initialized yet
+	_chipcontrol[_chip >> 1] = _displaycontrol;
 	
 	// clear it off
 	clear();
@@ -190,6 +206,7 @@ void LiquidCrystalFast::clear()
 		delayPerHome();
 	}
 	_scroll_count = 0;
+	if (_listener) _listener->lcdClear();
 }
 
 void LiquidCrystalFast::home()
@@ -204,31 +221,47 @@ void LiquidCrystalFast::home()
 // Turn the display on/off (quickly)
 void LiquidCrystalFast::noDisplay() {
 	_displaycontrol &= ~LCD_DISPLAYON;
-	commandBoth(LCD_DISPLAYCONTROL | _displaycontrol);  //both chips
+	updateControl();  //both chips
 }
 void LiquidCrystalFast::display() {
 	_displaycontrol |= LCD_DISPLAYON;
-	commandBoth(LCD_DISPLAYCONTROL | _displaycontrol);   //both chips
+	updateControl();   //both chips
 }
 
 // Turns the underline cursor on/off
 void LiquidCrystalFast::noCursor() {
 	_displaycontrol &= ~LCD_CURSORON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	updateControl();
 }
 void LiquidCrystalFast::cursor() {
 	_displaycontrol |= LCD_CURSORON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	updateControl();
 }
 
 // Turn on and off the blinking cursor
 void LiquidCrystalFast::noBlink() {
 	_displaycontrol &= ~LCD_BLINKON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	updateControl();
 }
 void LiquidCrystalFast::blink() {
 	_displaycontrol |= LCD_BLINKON;
-	command(LCD_DISPLAYCONTROL | _displaycontrol);
+	updateControl();
+}
+
+// Cursor and blink are shown on the chip the cursor is on only. Each chip remembers
+// its last control value, so nothing is sent if it did not change.
+void LiquidCrystalFast::updateControl() {
+	uint8_t chipSave = _chip;
+	uint8_t chips = (_en2 != 255) ? 2 : 1;
+	for (uint8_t i = 0; i < chips; i++) {
+		uint8_t value = _displaycontrol;
+		if ((i << 1) != chipSave) value &= ~(LCD_CURSORON | LCD_BLINKON);
+		if (value == _chipcontrol[i]) continue;
+		_chip = i << 1;
+		command(LCD_DISPLAYCONTROL | value);
+		_chipcontrol[i] = value;
+	}
+	_chip = chipSave;
 }
 
 // These commands scroll the display without changing the RAM
@@ -298,8 +331,10 @@ void LiquidCrystalFast::setCursor(uint8_t col, uint8_t row)         // this can
 	if (offset > 39) offset -= 40;                                    // if the display is autoscrolled this method does not work, however.
 	if (offset < 0) offset += 40;
 	offset |= high_bit;
-	if (_chip != (row & 0b10)) noCursor();  //turn off cursor on chip we are leaving
-	_chip = row & 0b10;                     //if it is row 0 or 1 this is 0; if it is row 2 or 3 this is 2
+	if ((_en2 != 255) && (_chip != (row & 0b10))) {
+		_chip = row & 0b10;                 //if it is row 0 or 1 this is 0; if it is row 2 or 3 this is 2
+		if (_displaycontrol & (LCD_CURSORON | LCD_BLINKON)) updateControl();  //move a visible cursor to the chip we enter
+	}
 	command(LCD_SETDDRAMADDR | (byte) offset );
 }
 
@@ -347,7 +382,10 @@ void LiquidCrystalFast::write(uint8_t value) {
 #endif
 
 	if ((_scroll_count != 0) || (_setCursFlag != 0) ) setCursor(_x,_y);   //first we call setCursor and send the character
-	if ((value != '\r') && (value != '\n') ) send(value, HIGH);
+	if ((value != '\r') && (value != '\n') ) {
+		send(value, HIGH);
+		if (_listener) _listener->lcdWrite(_x, _y, value);
+	}
 
 	_setCursFlag = 0;
 	if (_direction == LCD_Right) {                    // then we update the x & y location for the NEXT character
@@ -379,31 +417,87 @@ void LiquidCrystalFast::write(uint8_t value) {
 
 // write either command or data, with automatic 4/8-bit selection
 void LiquidCrystalFast::send(uint8_t value, uint8_t mode) {
-	uint8_t en = _enable_pin;
-	if ((_en2 != 255) && (_chip)) en = _en2;
+	bool chip2 = (_en2 != 255) && (_chip);
+	if (_async) {
+		uint8_t q = chip2 ? 1 : 0;
+		uint8_t size = queueSize();
+		while (_queueCount[q] == size) poll();	// full: wait for the LCD
+		uint8_t tail = q * size + ((_queueHead[q] + _queueCount[q]) & (size - 1));
+		_queue[tail] = mode ? (value | LCD_QUEUE_DATA) : value;
+		_queueCount[q]++;
+		return;
+	}
+
+	unsigned long start = micros();
+	uint8_t en = chip2 ? _en2 : _enable_pin;
 	if (_rw_pin == 255) {
 		delayMicroseconds(DELAYPERCHAR);
 	} else {
-		pinMode(_data_pins[0], INPUT);
-		pinMode(_data_pins[1], INPUT);
-		pinMode(_data_pins[2], INPUT);
-		pinMode(_data_pins[3], INPUT);
-		digitalWrite(_rw_pin, HIGH);
-		digitalWrite(_rs_pin, LOW);
-		uint8_t busy;
-		do {
-			digitalWrite(en, HIGH);
-			busy = digitalRead(_data_pins[3]);
-			digitalWrite(en, LOW);
-			digitalWrite(en, HIGH);
-			digitalWrite(en, LOW);
-		} while (busy == HIGH);
-		pinMode(_data_pins[0], OUTPUT);
-		pinMode(_data_pins[1], OUTPUT);
-		pinMode(_data_pins[2], OUTPUT);
-		pinMode(_data_pins[3], OUTPUT);
-		digitalWrite(_rw_pin, LOW);
+		while (busy(en)) ;
+	}
+	writeByte(value, mode, en);
+	_busMicros += micros() - start;
+}
+
+// asynchronous mode: check the busy flag once instead of waiting for it
+// 4x40 LCD: one byte per chip and call, the chip that waited goes first next time
+bool LiquidCrystalFast::poll() {
+	if (!queued()) return false;
+	unsigned long start = micros();
+	uint8_t size = queueSize();
+	uint8_t chips = (_en2 != 255) ? 2 : 1;
+	bool sent = false;
+	for (uint8_t i = 0; i < chips; i++) {
+		uint8_t q = (_pollChip + i) % chips;
+		if (!_queueCount[q]) continue;
+		uint8_t en = q ? _en2 : _enable_pin;
+		if (busy(en)) continue;
+		uint8_t entry = q * size + _queueHead[q];
+		writeByte(_queue[entry], (_queue[entry] & LCD_QUEUE_DATA) ? HIGH : LOW, en);
+		_queueHead[q] = (_queueHead[q] + 1) & (size - 1);
+		_queueCount[q]--;
+		sent = true;
 	}
+	_pollChip = (_pollChip + 1) % chips;
+	_busMicros += micros() - start;
+	return sent;
+}
+
+void LiquidCrystalFast::setAsync(uint16_t *queue, uint8_t size) {
+	flush();
+	if (size > LCD_QUEUE_MAX) size = LCD_QUEUE_MAX;
+	while (size & (size - 1)) size &= size - 1;	// round down to a power of 2
+	_queue = queue;
+	_queueSize = size;
+	_queueHead[0] = _queueHead[1] = 0;
+	_async = queue && (_rw_pin != 255) && (queueSize() > 0);
+}
+
+void LiquidCrystalFast::flush() {
+	while (queued()) poll();
+}
+
+bool LiquidCrystalFast::busy(uint8_t en) {
+	pinMode(_data_pins[0], INPUT);
+	pinMode(_data_pins[1], INPUT);
+	pinMode(_data_pins[2], INPUT);
+	pinMode(_data_pins[3], INPUT);
+	digitalWrite(_rw_pin, HIGH);
+	digitalWrite(_rs_pin, LOW);
+	digitalWrite(en, HIGH);
+	uint8_t busy = digitalRead(_data_pins[3]);
+	digitalWrite(en, LOW);
+	digitalWrite(en, HIGH);	// 2nd nibble, the address counter is not needed
+	digitalWrite(en, LOW);
+	pinMode(_data_pins[0], OUTPUT);
+	pinMode(_data_pins[1], OUTPUT);
+	pinMode(_data_pins[2], OUTPUT);
+	pinMode(_data_pins[3], OUTPUT);
+	digitalWrite(_rw_pin, LOW);
+	return busy == HIGH;
+}
+
+void LiquidCrystalFast::writeByte(uint8_t value, uint8_t mode, uint8_t en) {
 	digitalWrite(_rs_pin, mode);
 
 	digitalWrite(_data_pins[0], value & 0x10);
@@ -419,6 +513,9 @@ void LiquidCrystalFast::send(uint8_t value, uint8_t mode) {
 	digitalWrite(_data_pins[3], value & 0x08);
 	digitalWrite(en, HIGH);   // enable pulse must be >450ns
 	digitalWrite(en, LOW);
+
+	if (mode) _busChars++;
+	else _busCommands++;
 }
 
 // used during init
@@ -50,6 +50,17 @@
 
 #define DELAYPERCHAR 320
 
+// asynchronous send queue entries, see setAsync(): the byte and its flags
+#define LCD_QUEUE_DATA 0x100		// data byte (RS high)
+#define LCD_QUEUE_MAX 128		// entries used of a longer queue
+
+// gets every character written and every clear, e.g. to mirror the screen content
+class LiquidCrystalListener {
+public:
+	virtual void lcdWrite(uint8_t col, uint8_t row, uint8_t value) = 0;
+	virtual void lcdClear() = 0;
+};
+
 class LiquidCrystalFast : public Print {
 public:
 	// 6 pin connection (slow): normal LCD, single HD44780 controller
@@ -115,6 +126,26 @@ public:
 	void command(uint8_t);
 	void commandBoth(uint8_t);
 	inline LiquidCrystalFast& operator() (uint8_t x, uint8_t y) {setCursor(x,y); return *this;}  //use along w Streaming.h to support: lcd(col,line)<<"a="<<a;
+	// bus accounting, e.g. per frame: reset before drawing, read after
+	void resetBusStats() { _busChars = 0; _busCommands = 0; _busMicros = 0; }
+	uint16_t busChars() { return _busChars; }        // data bytes sent
+	uint16_t busCommands() { return _busCommands; }  // command bytes sent
+	uint32_t busMicros() { return _busMicros; }      // time spent on the bus incl. waiting for the LCD
+	// asynchronous mode, RW wired only: send() queues the bytes in the caller's buffer
+	// instead of waiting for the busy flag, and poll() writes the next one if the LCD
+	// is ready. Call poll() from loop(). The queue is used up to a power of 2 of its
+	// size, at most LCD_QUEUE_MAX; a 4x40 LCD splits it into one half per controller
+	// and poll() alternates between them, so one chip is written while the other one
+	// is busy. Size it for the largest frame drawn between two poll() calls, e.g. 128
+	// for a full 20x4 screen of 80 characters and 4 cursor commands: when the queue is
+	// full, send() falls back to waiting for the busy flag like the synchronous mode
+	// and only the bytes that fit are sent in the background. A null queue flushes
+	// and returns to the synchronous mode, which needs no queue memory.
+	void setAsync(uint16_t *queue, uint8_t size);
+	bool poll();			// write the next queued byte per chip, false if the LCD is busy or nothing is queued
+	void flush();			// write all queued bytes, waiting for the LCD
+	uint8_t queued() { return _queueCount[0] + _queueCount[1]; }  // bytes waiting in the queue
+	void setListener(LiquidCrystalListener *listener) { _listener = listener; }  // nullptr = none
 	uint8_t numlines;
 	uint8_t numcols;
 protected:
@@ -122,8 +153,12 @@ protected:
 		uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3);
 	void send(uint8_t, uint8_t);
 	void write4bits(uint8_t);
+	bool busy(uint8_t en);	// read the busy flag once
+	void writeByte(uint8_t value, uint8_t mode, uint8_t en);
+	uint8_t queueSize() { return (_en2 != 255) ? _queueSize / 2 : _queueSize; }
+	void updateControl();	// send the display control to the chips where it changed
 	void begin2(uint8_t cols, uint8_t rows, uint8_t charsize, uint8_t chip);
-	inline void delayPerHome(void) { if (_rw_pin == 255) delayMicroseconds(2900);}
+	inline void delayPerHome(void) { if (_rw_pin == 255) { delayMicroseconds(2900); _busMicros += 2900; } }
 	uint8_t _rs_pin;	// LOW: command.  HIGH: character.
 	uint8_t _rw_pin;	// LOW: write to LCD.  HIGH: read from LCD.
 	uint8_t _enable_pin; // activated by a HIGH pulse.
@@ -140,7 +175,21 @@ protected:
 	uint8_t row_offsets[4];
 	
 	uint8_t _displaycontrol;   //display on/off, cursor on/off, blink on/off
+	uint8_t _chipcontrol[2];   //display control last sent to each chip, the cursor shows only on the chip it is on
 	uint8_t _displaymode;      //text direction	
+
+	uint16_t _busChars;		// bus accounting, see resetBusStats()
+	uint16_t _busCommands;
+	uint32_t _busMicros;
+
+	bool _async;			// send() queues, see setAsync()
+	uint16_t *_queue;		// caller's buffer, value | LCD_QUEUE_DATA
+	uint8_t _queueSize;		// entries used, power of 2
+	uint8_t _queueHead[2];	// per chip, index within the chip's part of the queue
+	uint8_t _queueCount[2];
+	uint8_t _pollChip;		// chip poll() tries first, alternates
+
+	LiquidCrystalListener *_listener;
 };
 
 #endif
@@ -0,0 +1,165 @@
+/*
+  LiquidCrystalFast - Benchmark Suite
+
+ Times the typical display workloads and prints one CSV line per test
+ over Serial, so runs of different wirings and library versions can be
+ compared with a script:
+
+   mode,test,ops,total_us,us_per_op,chars,commands
+
+ Tests: full refresh, partial field updates, setCursor heavy output,
+ createChar, clear() and home(). Each test runs twice: with the RW pin
+ (busy flag polling) and without it (fixed delays, RW held low by the
+ sketch). The RW run is repeated in the asynchronous mode, where the
+ timing includes flushing the queue. The async numbers are not the time
+ the sketch saves: a test queues more bytes than the queue holds, and
+ then send() waits for the busy flag like the RW mode, so most of each
+ test runs in that fallback. Set LCD_4X40 to 1 to run the suite on a
+ 4x40 display with two controller chips, which needs the second enable
+ pin and always uses RW.
+
+ Without a display, test/test_lcd_benchmark runs this sketch on the
+ HD44780 model of lib/NativeHost (pio test -e native -f test_lcd_benchmark)
+ and prints the same CSV lines with the times of the virtual Nano.
+
+ The circuit (same as the other examples):
+ * LCD RS pin to digital pin 12
+ * LCD RW pin to digital pin 10
+ * LCD Enable pin to digital pin 11
+ * LCD Enable2 pin to digital pin 9 (4x40 only)
+ * LCD D4 pin to digital pin 5
+ * LCD D5 pin to digital pin 4
+ * LCD D6 pin to digital pin 3
+ * LCD D7 pin to digital pin 2
+ */
+
+#include <LiquidCrystalFast.h>
+
+#define LCD_4X40 0
+#define PIN_RS 12
+#define PIN_RW 10
+#define PIN_EN 11
+#define PIN_EN2 9
+
+#if LCD_4X40
+const int nRows = 4;
+const int nColumns = 40;
+LiquidCrystalFast lcdRW(PIN_RS, PIN_RW, PIN_EN, PIN_EN2, 5, 4, 3, 2);
+#else
+const int nRows = 4;
+const int nColumns = 20;
+LiquidCrystalFast lcdRW(PIN_RS, PIN_RW, PIN_EN, 5, 4, 3, 2);
+// Without RW the library waits the worst-case command times instead
+LiquidCrystalFast lcdNoRW(PIN_RS, PIN_EN, 5, 4, 3, 2);
+#endif
+
+const int repetitions = 10;
+
+// One full 20x4 frame fits, see setAsync()
+uint16_t queue[LCD_QUEUE_MAX];
+
+byte glyph[8] = {
+	0b00100, 0b01110, 0b11111, 0b00100, 0b00100, 0b00100, 0b00100, 0b00000
+};
+
+const char* mode;
+unsigned long startTime;
+
+void startTest(LiquidCrystalFast &lcd) {
+	lcd.flush();	// bytes queued before the test are not part of it
+	lcd.resetBusStats();
+	startTime = micros();
+}
+
+void endTest(LiquidCrystalFast &lcd, const __FlashStringHelper *test, unsigned int ops) {
+	lcd.flush();
+	unsigned long total = micros() - startTime;
+	Serial.print(mode);
+	Serial.write(',');
+	Serial.print(test);
+	Serial.write(',');
+	Serial.print(ops);
+	Serial.write(',');
+	Serial.print(total);
+	Serial.write(',');
+	Serial.print(total / ops);
+	Serial.write(',');
+	Serial.print(lcd.busChars());
+	Serial.write(',');
+	Serial.println(lcd.busCommands());
+}
+
+void runSuite(LiquidCrystalFast &lcd) {
+	lcd.begin(nColumns, nRows);
+	lcd.clear();
+
+	// Full refresh: every character of the screen, row by row
+	startTest(lcd);
+	for (int r = 0; r < repetitions; r++) {
+		for (int y = 0; y < nRows; y++) {
+			lcd.setCursor(0, y);
+			for (int x = 0; x < nColumns; x++) lcd.write('A' + (x + y + r) % 26);
+		}
+	}
+	endTest(lcd, F("full_refresh"), repetitions);
+
+	// Partial update: a 7 character number field, like a position readout
+	startTest(lcd);
+	for (int r = 0; r < repetitions * 10; r++) {
+		lcd.setCursor(5, 2);
+		lcd.print(r * 0.01, 2);
+		lcd.print(F("mm"));
+	}
+	endTest(lcd, F("field_update"), repetitions * 10);
+
+	// setCursor heavy: a single character at scattered positions
+	startTest(lcd);
+	for (int r = 0; r < repetitions * 10; r++) {
+		lcd.setCursor((r * 7) % nColumns, r % nRows);
+		lcd.write('*');
+	}
+	endTest(lcd, F("set_cursor"), repetitions * 10);
+
+	// createChar: all 8 custom glyphs
+	startTest(lcd);
+	for (int r = 0; r < repetitions; r++) {
+		for (int c = 0; c < 8; c++) lcd.createChar(c, glyph);
+	}
+	endTest(lcd, F("create_char"), repetitions * 8);
+	lcd.setCursor(0, 0);
+
+	startTest(lcd);
+	for (int r = 0; r < repetitions; r++) lcd.clear();
+	endTest(lcd, F("clear"), repetitions);
+
+	startTest(lcd);
+	for (int r = 0; r < repetitions; r++) lcd.home();
+	endTest(lcd, F("home"), repetitions);
+}
+
+void setup(void) {
+	Serial.begin(115200);
+	Serial.println(F("mode,test,ops,total_us,us_per_op,chars,commands"));
+
+	mode = LCD_4X40 ? "rw_4x40" : "rw";
+	runSuite(lcdRW);
+
+	// Same bytes, but queued and written by poll() whenever the LCD is ready
+	lcdRW.setAsync(queue, LCD_QUEUE_MAX);
+	mode = LCD_4X40 ? "async_4x40" : "async";
+	runSuite(lcdRW);
+	lcdRW.setAsync(nullptr, 0);
+
+#if !LCD_4X40
+	// Hold RW low so the display never drives the data lines
+	pinMode(PIN_RW, OUTPUT);
+	digitalWrite(PIN_RW, LOW);
+	mode = "norw";
+	runSuite(lcdNoRW);
+#endif
+
+	Serial.println(F("done"));
+}
+
+void loop() {
+}
@@ -0,0 +1,72 @@
+#include "Bounce2.h"
+
+Debouncer::Debouncer() : previous_millis(0), interval_millis(10), state(0),
+    stateChangeLastTime(0), durationOfPreviousState(0) {}
+
+void Debouncer::interval(uint16_t interval_millis) {
+    this->interval_millis = interval_millis;
+}
+
+void Debouncer::begin() {
+    state = 0;
+    if (readCurrentState()) {
+        setStateFlag(DEBOUNCED_STATE | UNSTABLE_STATE);
+    }
+    previous_millis = millis();
+}
+
+bool Debouncer::update() {
+    unsetStateFlag(CHANGED_STATE);
+    bool currentState = readCurrentState();
+
+    // A new reading restarts the interval, a reading held for the interval is taken
+    if (currentState != getStateFlag(UNSTABLE_STATE)) {
+        previous_millis = millis();
+        toggleStateFlag(UNSTABLE_STATE);
+    } else if (millis() - previous_millis >= interval_millis) {
+        if (currentState != getStateFlag(DEBOUNCED_STATE)) {
+            previous_millis = millis();
+            changeState();
+        }
+    }
+    return changed();
+}
+
+unsigned long Debouncer::currentDuration() const {
+    return millis() - stateChangeLastTime;
+}
+
+unsigned long Debouncer::previousDuration() const {
+    return durationOfPreviousState;
+}
+
+inline void Debouncer::changeState() {
+    toggleStateFlag(DEBOUNCED_STATE);
+    setStateFlag(CHANGED_STATE);
+    durationOfPreviousState = millis() - stateChangeLastTime;
+    stateChangeLastTime = millis();
+}
+
+bool Debouncer::read() const {
+    return getStateFlag(DEBOUNCED_STATE);
+}
+
+bool Debouncer::rose() const {
+    return getStateFlag(DEBOUNCED_STATE) && getStateFlag(CHANGED_STATE);
+}
+
+bool Debouncer::fell() const {
+    return !getStateFlag(DEBOUNCED_STATE) && getStateFlag(CHANGED_STATE);
+}
+
+Bounce::Bounce() : pin(0) {}
+
+void Bounce::attach(int pin) {
+    this->pin = pin;
+    begin();
+}
+
+void Bounce::attach(int pin, int mode) {
+    setPinMode(pin, mode);
+    this->attach(pin);
+}
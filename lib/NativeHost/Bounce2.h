@@ -0,0 +1,72 @@
+#ifndef Bounce2_h
+#define Bounce2_h
+
+#include <Arduino.h>
+
+// Bounce2 2.7x on the host, with the default stable interval algorithm: the state
+// changes after the input held its new level for the interval.
+class Debouncer {
+public:
+    Debouncer();
+    void interval(uint16_t interval_millis);
+    bool update();
+    bool read() const;
+    bool fell() const;
+    bool rose() const;
+    bool changed() const { return getStateFlag(CHANGED_STATE); }
+    unsigned long currentDuration() const;
+    unsigned long previousDuration() const;
+    unsigned long duration() const { return currentDuration(); }
+
+protected:
+    void begin();
+    virtual bool readCurrentState() = 0;
+
+private:
+    static const uint8_t DEBOUNCED_STATE = 0b00000001;
+    static const uint8_t UNSTABLE_STATE = 0b00000010;
+    static const uint8_t CHANGED_STATE = 0b00000100;
+
+    unsigned long previous_millis;
+    uint16_t interval_millis;
+    uint8_t state;
+    unsigned long stateChangeLastTime;
+    unsigned long durationOfPreviousState;
+
+    inline void changeState();
+    inline void setStateFlag(const uint8_t flag) { state |= flag; }
+    inline void unsetStateFlag(const uint8_t flag) { state &= ~flag; }
+    inline void toggleStateFlag(const uint8_t flag) { state ^= flag; }
+    inline bool getStateFlag(const uint8_t flag) const { return (state & flag) != 0; }
+};
+
+class Bounce : public Debouncer {
+public:
+    Bounce();
+    void attach(int pin, int mode);
+    void attach(int pin);
+    int getPin() const { return pin; }
+
+protected:
+    uint8_t pin;
+
+    virtual bool readCurrentState() { return digitalRead(pin); }
+    virtual void setPinMode(int pin, int mode) { pinMode(pin, mode); }
+};
+
+namespace Bounce2 {
+class Button : public Bounce {
+public:
+    Button() : stateForPressed(1) {}
+    void setPressedState(bool state) { stateForPressed = state; }
+    bool getPressedState() const { return stateForPressed; }
+    bool isPressed() const { return read() == getPressedState(); }
+    bool pressed() const { return changed() && (read() == getPressedState()); }
+    bool released() const { return changed() && (read() != getPressedState()); }
+
+private:
+    bool stateForPressed;
+};
+}
+
+#endif
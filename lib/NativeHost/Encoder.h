@@ -0,0 +1,61 @@
+#ifndef Encoder_h_
+#define Encoder_h_
+
+#include <NativeHost.h>
+
+// PJRC Encoder on the virtual pins. Counts every quadrature edge when it happens,
+// like the interrupt version on D2/D3, with the state table of the library.
+class Encoder : public HostPinListener {
+public:
+    Encoder(uint8_t pin1, uint8_t pin2) {
+        this->pin1 = pin1;
+        this->pin2 = pin2;
+        this->position = 0;
+        pinMode(pin1, INPUT_PULLUP);
+        pinMode(pin2, INPUT_PULLUP);
+        delayMicroseconds(2000);
+        this->state = (hostPinLevel(pin1) ? 1 : 0) | (hostPinLevel(pin2) ? 2 : 0);
+    }
+
+    int32_t read() {
+        return position;
+    }
+
+    void write(int32_t p) {
+        position = p;
+    }
+
+    int32_t readAndReset() {
+        int32_t p = position;
+        position = 0;
+        return p;
+    }
+
+    void pinChanged(uint8_t pin, bool level) {
+        if (pin != pin1 && pin != pin2) return;
+        uint8_t s = state & 3;
+        if (hostPinLevel(pin1)) s |= 4;
+        if (hostPinLevel(pin2)) s |= 8;
+        switch (s) {
+            case 0: case 5: case 10: case 15:
+                break;
+            case 1: case 7: case 8: case 14:
+                position++; break;
+            case 2: case 4: case 11: case 13:
+                position--; break;
+            case 3: case 12:
+                position += 2; break;
+            default:
+                position -= 2; break;
+        }
+        state = s >> 2;
+    }
+
+private:
+    uint8_t pin1;
+    uint8_t pin2;
+    uint8_t state;
+    int32_t position;
+};
+
+#endif
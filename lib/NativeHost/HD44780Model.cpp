@@ -0,0 +1,223 @@
+#include "HD44780Model.h"
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+
+HD44780Model::HD44780Model(uint8_t cols, uint8_t rows, uint8_t rs, uint8_t rw, uint8_t enable, uint8_t en2,
+                           uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7) {
+    this->cols = cols;
+    this->rows = rows;
+    this->rs = rs;
+    this->rw = rw;
+    this->enable[0] = enable;
+    this->enable[1] = en2;
+    this->data[0] = d4;
+    this->data[1] = d5;
+    this->data[2] = d6;
+    this->data[3] = d7;
+
+    // Power on reset: display cleared and off, 8-bit interface, one line, increment
+    for (uint8_t i = 0; i < 2; i++) {
+        Chip& chip = chips[i];
+        memset(chip.ddram, ' ', sizeof(chip.ddram));
+        memset(chip.cgram, 0, sizeof(chip.cgram));
+        chip.address = 0;
+        chip.cgramSelected = false;
+        chip.eightBit = true;
+        chip.twoLines = false;
+        chip.increment = true;
+        chip.shiftOnWrite = false;
+        chip.control = 0;
+        chip.shift = 0;
+        chip.lowNibble = false;
+        chip.highNibble = 0;
+        chip.busyUntil = 0;
+    }
+    resetStats();
+}
+
+uint8_t HD44780Model::getChar(uint8_t col, uint8_t row) {
+    // 4x40: two lines per controller; one controller: lines 2 and 3 continue 0 and 1
+    uint8_t index = 0;
+    uint8_t line = row;
+    uint8_t offset = col;
+    if (enable[1] != 255) {
+        index = row >> 1;
+        line = row & 1;
+    } else if (row >= 2) {
+        line = row - 2;
+        offset += cols;
+    }
+    Chip& chip = chips[index];
+    if (!chip.twoLines) return chip.ddram[(offset + chip.shift) % 80];
+    return chip.ddram[(line ? 0x40 : 0) + (offset + chip.shift) % 40];
+}
+
+void HD44780Model::getLine(uint8_t row, char* text) {
+    for (uint8_t col = 0; col < cols; col++) {
+        uint8_t value = getChar(col, row);
+        text[col] = value < 8 ? value | 0x08 : value;
+    }
+    text[cols] = '\0';
+}
+
+uint8_t HD44780Model::getGlyphRow(uint8_t location, uint8_t row, uint8_t chip) {
+    return chips[chip].cgram[((location & 0x07) << 3) | (row & 0x07)];
+}
+
+uint8_t HD44780Model::getControl(uint8_t chip) {
+    return chips[chip].control;
+}
+
+uint8_t HD44780Model::getAddress(uint8_t chip) {
+    return chips[chip].address;
+}
+
+bool HD44780Model::isBusy(uint8_t chip) {
+    return hostCycles() < chips[chip].busyUntil;
+}
+
+void HD44780Model::resetStats() {
+    memset(&stats, 0, sizeof(stats));
+    active = false;
+    firstPulse = 0;
+    lastEnd = 0;
+}
+
+HD44780Stats HD44780Model::getStats() {
+    HD44780Stats result = stats;
+    if (active) result.busMicros = (lastEnd - firstPulse) / CYCLES_PER_US;
+    return result;
+}
+
+void HD44780Model::pinChanged(uint8_t pin, bool level) {
+    uint8_t index;
+    if (pin == enable[0]) index = 0;
+    else if (pin == enable[1] && pin != 255) index = 1;
+    else return;
+
+    Chip& chip = chips[index];
+    bool reading = (rw != 255) && hostPinLevel(rw);
+    if (level) {
+        if (!active) {
+            active = true;
+            firstPulse = hostCycles();
+        }
+        if (reading) drive(chip);
+    } else if (reading) {
+        // Reads take two pulses in 4-bit mode, busy flag with AC6-4 first
+        release();
+        if (chip.eightBit || chip.lowNibble) stats.reads++;
+        if (!chip.eightBit) chip.lowNibble = !chip.lowNibble;
+    } else {
+        latch(chip);
+    }
+}
+
+void HD44780Model::drive(Chip& chip) {
+    uint8_t value = (isBusy(&chip - chips) ? 0x80 : 0) | (chip.address & 0x7F);
+    uint8_t nibble = (chip.eightBit || !chip.lowNibble) ? value >> 4 : value & 0x0F;
+    for (uint8_t i = 0; i < 4; i++) {
+        hostDrive(data[i], nibble & (1 << i));
+    }
+}
+
+void HD44780Model::release() {
+    for (uint8_t i = 0; i < 4; i++) {
+        hostRelease(data[i]);
+    }
+}
+
+void HD44780Model::latch(Chip& chip) {
+    uint8_t nibble = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (hostPinLevel(data[i])) nibble |= 1 << i;
+    }
+    bool isData = hostPinLevel(rs);
+
+    // D3-D0 are not connected, an 8-bit transfer has them low
+    if (chip.eightBit) {
+        execute(chip, nibble << 4, isData);
+    } else if (!chip.lowNibble) {
+        chip.highNibble = nibble;
+        chip.lowNibble = true;
+    } else {
+        chip.lowNibble = false;
+        execute(chip, (chip.highNibble << 4) | nibble, isData);
+    }
+}
+
+void HD44780Model::execute(Chip& chip, uint8_t value, bool isData) {
+    uint64_t now = hostCycles();
+    if (now < chip.busyUntil) {
+        stats.violations++;
+        return;
+    }
+
+    uint16_t micros = HD44780_INSTRUCTION_US;
+    if (isData) {
+        if (chip.cgramSelected) {
+            chip.cgram[chip.address & 0x3F] = value & 0x1F;
+        } else {
+            chip.ddram[chip.address & 0x7F] = value;
+            if (chip.shiftOnWrite) {
+                uint8_t width = chip.twoLines ? 40 : 80;
+                chip.shift = (chip.shift + (chip.increment ? 1 : width - 1)) % width;
+            }
+        }
+        moveAddress(chip, chip.increment);
+        micros = HD44780_DATA_US;
+        stats.bytes++;
+    } else {
+        if (value & 0x80) {
+            chip.address = value & 0x7F;
+            chip.cgramSelected = false;
+        } else if (value & 0x40) {
+            chip.address = value & 0x3F;
+            chip.cgramSelected = true;
+        } else if (value & 0x20) {
+            chip.eightBit = value & 0x10;
+            chip.twoLines = value & 0x08;
+            chip.lowNibble = false;
+        } else if (value & 0x10) {
+            if (value & 0x08) {
+                // Display shift: to the left the window moves on by one address
+                uint8_t width = chip.twoLines ? 40 : 80;
+                chip.shift = (chip.shift + ((value & 0x04) ? width - 1 : 1)) % width;
+            } else {
+                moveAddress(chip, value & 0x04);
+            }
+        } else if (value & 0x08) {
+            chip.control = value & 0x07;
+        } else if (value & 0x04) {
+            chip.increment = value & 0x02;
+            chip.shiftOnWrite = value & 0x01;
+        } else if (value & 0x02) {
+            chip.address = 0;
+            chip.cgramSelected = false;
+            chip.shift = 0;
+            micros = HD44780_HOME_US;
+        } else if (value & 0x01) {
+            memset(chip.ddram, ' ', sizeof(chip.ddram));
+            chip.address = 0;
+            chip.cgramSelected = false;
+            chip.shift = 0;
+            chip.increment = true;
+            micros = HD44780_HOME_US;
+        }
+        stats.commands++;
+    }
+    chip.busyUntil = now + (uint64_t)micros * CYCLES_PER_US;
+    if (chip.busyUntil > lastEnd) lastEnd = chip.busyUntil;
+}
+
+void HD44780Model::moveAddress(Chip& chip, bool forward) {
+    if (chip.cgramSelected) {
+        chip.address = (chip.address + (forward ? 1 : 63)) & 0x3F;
+    } else if (!chip.twoLines) {
+        chip.address = (chip.address + (forward ? 1 : 79)) % 80;
+    } else if (forward) {
+        chip.address = chip.address == 0x27 ? 0x40 : chip.address == 0x67 ? 0x00 : chip.address + 1;
+    } else {
+        chip.address = chip.address == 0x40 ? 0x27 : chip.address == 0x00 ? 0x67 : chip.address - 1;
+    }
+}
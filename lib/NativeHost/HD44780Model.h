@@ -0,0 +1,82 @@
+#ifndef HD44780MODEL_H
+#define HD44780MODEL_H
+
+#include <NativeHost.h>
+
+#define HD44780_INSTRUCTION_US 37   // Execution time of most instructions at 270 kHz
+#define HD44780_HOME_US 1520        // Clear display and return home
+#define HD44780_DATA_US 41          // Data write incl. the address counter update
+
+// Bus activity since resetStats(), e.g. per frame
+typedef struct {
+    uint16_t bytes;             // Data bytes written
+    uint16_t commands;          // Instructions written
+    uint16_t reads;             // Busy flag reads
+    uint16_t violations;        // Bytes sent while the controller was busy, ignored
+    uint32_t busMicros;         // First EN pulse to the end of the last instruction
+} HD44780Stats;
+
+// HD44780 character LCD on the virtual pins, as LiquidCrystalFast drives it in
+// 4-bit mode. Decodes the transfers latched on the falling EN edge, 8-bit ones until
+// the function set selects 4 bits, and keeps DDRAM, CGRAM, address counter, entry
+// mode and display shift. With RW wired, a high EN while RW is high puts the busy
+// flag and address counter on D7-D4. Each instruction keeps the controller busy for
+// its datasheet time; a byte that arrives earlier is counted as a violation and
+// dropped, which garbles the screen like on a real display.
+//
+// A 4x40 display has two controllers with one EN pin each (en2), two lines each.
+class HD44780Model : public HostPinListener {
+public:
+    // Pins in the order of LiquidCrystalFast, rw and en2 are 255 when not wired
+    HD44780Model(uint8_t cols, uint8_t rows, uint8_t rs, uint8_t rw, uint8_t enable, uint8_t en2,
+                 uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7);
+
+    uint8_t getChar(uint8_t col, uint8_t row);  // Character code shown at a cell
+    void getLine(uint8_t row, char* text);      // Visible row, text needs cols + 1 bytes; CGRAM codes 0-7 as 8-15
+    uint8_t getGlyphRow(uint8_t location, uint8_t row, uint8_t chip = 0); // Pixel row of a CGRAM character
+    uint8_t getControl(uint8_t chip = 0);       // Display on/off control: display, cursor, blink bits
+    uint8_t getAddress(uint8_t chip = 0);       // Address counter
+    bool isBusy(uint8_t chip = 0);              // An instruction is still executing
+
+    void resetStats();                          // Start counting, e.g. before drawing a frame
+    HD44780Stats getStats();                    // Counts since resetStats()
+
+    void pinChanged(uint8_t pin, bool level);
+
+private:
+    typedef struct {
+        uint8_t ddram[128];     // By DDRAM address: 0x00-0x27 and 0x40-0x67 with two lines
+        uint8_t cgram[64];
+        uint8_t address;        // Address counter
+        bool cgramSelected;     // The address counter points into CGRAM
+        bool eightBit;          // Interface width, 8 bits after power on
+        bool twoLines;
+        bool increment;         // Entry mode: the address counter counts up
+        bool shiftOnWrite;      // Entry mode: the display shifts with each data write
+        uint8_t control;        // Display, cursor and blink
+        uint8_t shift;          // Display shift, 0-39 (0-79 in one line mode)
+        bool lowNibble;         // 4-bit mode: the next transfer is the low nibble
+        uint8_t highNibble;     // High nibble received
+        uint64_t busyUntil;     // CPU cycle when the running instruction ends
+    } Chip;
+
+    Chip chips[2];
+    uint8_t cols;
+    uint8_t rows;
+    uint8_t rs;
+    uint8_t rw;
+    uint8_t enable[2];          // EN pin per controller
+    uint8_t data[4];            // D4-D7
+    HD44780Stats stats;
+    bool active;                // A pulse was seen since resetStats()
+    uint64_t firstPulse;
+    uint64_t lastEnd;
+
+    void latch(Chip& chip);             // EN fell with RW low: take a nibble or a byte
+    void execute(Chip& chip, uint8_t value, bool isData);
+    void moveAddress(Chip& chip, bool forward);
+    void drive(Chip& chip);             // EN rose with RW high: put the busy flag or address on the bus
+    void release();
+};
+
+#endif
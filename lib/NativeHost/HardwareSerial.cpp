@@ -0,0 +1,80 @@
+#include "NativeHost.h"
+
+// Serial output of a host build goes to stdout
+class StandardOutput : public Print {
+public:
+    size_t write(uint8_t value) {
+        return fputc(value, stdout) == EOF ? 0 : 1;
+    }
+    using Print::write;
+};
+
+static StandardOutput standardOutput;
+
+HardwareSerial Serial;
+
+HardwareSerial::HardwareSerial() {
+    output = &standardOutput;
+    end();
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    byteCycles = F_CPU * 10 / baud;     // Start bit, 8 data bits, stop bit
+}
+
+void HardwareSerial::end() {
+    byteCycles = F_CPU * 10 / 9600;
+    txDone = 0;
+    rxHead = 0;
+    rxCount = 0;
+}
+
+int HardwareSerial::available() {
+    return rxCount;
+}
+
+int HardwareSerial::peek() {
+    return rxCount ? rxBuffer[rxHead] : -1;
+}
+
+int HardwareSerial::read() {
+    if (!rxCount) return -1;
+    uint8_t value = rxBuffer[rxHead];
+    rxHead = (rxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+    rxCount--;
+    return value;
+}
+
+int HardwareSerial::txPending() {
+    uint64_t now = hostCycles();
+    if (txDone <= now) return 0;
+    return (txDone - now + byteCycles - 1) / byteCycles;
+}
+
+int HardwareSerial::availableForWrite() {
+    return SERIAL_TX_BUFFER_SIZE - 1 - txPending();
+}
+
+void HardwareSerial::flush() {
+    while (txPending()) hostAdvance(byteCycles);
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+    // A full buffer waits for the byte on the wire, like the AVR core
+    while (txPending() >= SERIAL_TX_BUFFER_SIZE - 1) hostAdvance(byteCycles / 4);
+    hostAdvance(HOST_PIN_IO_CYCLES);
+    uint64_t now = hostCycles();
+    txDone = (txDone > now ? txDone : now) + byteCycles;
+    if (output) output->write(value);
+    return 1;
+}
+
+void HardwareSerial::receive(uint8_t value) {
+    if (rxCount == SERIAL_RX_BUFFER_SIZE) return;   // Overrun, the byte is lost
+    rxBuffer[(rxHead + rxCount) % SERIAL_RX_BUFFER_SIZE] = value;
+    rxCount++;
+}
+
+void HardwareSerial::setOutput(Print* output) {
+    this->output = output;
+}
@@ -0,0 +1,43 @@
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include "Stream.h"
+
+#define SERIAL_RX_BUFFER_SIZE 64
+#define SERIAL_TX_BUFFER_SIZE 64
+
+// Serial port of the virtual Nano. Received bytes come from hostSerialInput(), sent
+// bytes go to the Print set with hostSerialOutput() (stdout by default). Sending is
+// paced by the baud rate: write() waits for room in the transmit buffer like on the
+// Nano, and availableForWrite() reports the free space.
+class HardwareSerial : public Stream {
+public:
+    HardwareSerial();
+    void begin(unsigned long baud);
+    void end();
+    virtual int available();
+    virtual int peek();
+    virtual int read();
+    virtual int availableForWrite();
+    virtual void flush();
+    virtual size_t write(uint8_t);
+    using Print::write;
+    operator bool() { return true; }
+
+    void receive(uint8_t value);    // Host side: put a byte into the receive buffer
+    void setOutput(Print* output);  // Host side: where sent bytes go, nullptr = drop
+
+private:
+    unsigned long byteCycles;       // CPU cycles per byte at the baud rate
+    unsigned long long txDone;      // Cycle when the transmit buffer runs empty
+    uint8_t rxBuffer[SERIAL_RX_BUFFER_SIZE];
+    uint8_t rxHead;
+    uint8_t rxCount;
+    Print* output;
+
+    int txPending();                // Bytes still in the transmit buffer
+};
+
+extern HardwareSerial Serial;
+
+#endif
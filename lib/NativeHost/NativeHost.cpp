@@ -0,0 +1,582 @@
+#include "NativeHost.h"
+#include <avr/eeprom.h>
+
+#define EEPROM_WRITE_CYCLES 54400UL     // Erase and write, 3.4 ms
+#define EEPROM_HALF_CYCLES 28800UL      // Erase only or write only, 1.8 ms
+#define ANALOG_READ_CYCLES 1664         // 13 ADC clocks at 125 kHz
+#define PORT_PINS_B 0x3F                // PB6/PB7 hold the crystal
+#define PORT_PINS_C 0x3F                // PC6 is RESET
+
+// Interrupt vectors, the ones the firmware does not define stay null. The linker
+// does not pull in an object for a weak reference: the object with the ISR has to
+// be linked for another reason, as Axis and PowerFail are by their users.
+extern "C" {
+void PCINT0_vect(void) __attribute__((weak));
+void PCINT1_vect(void) __attribute__((weak));
+void PCINT2_vect(void) __attribute__((weak));
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER1_COMPB_vect(void) __attribute__((weak));
+void TIMER1_OVF_vect(void) __attribute__((weak));
+void ANALOG_COMP_vect(void) __attribute__((weak));
+}
+
+HostRegister SREG(HOST_REGISTER_SREG);
+HostRegister TIFR1(HOST_REGISTER_TIFR1);
+HostRegister PCIFR(HOST_REGISTER_PCIFR);
+HostRegister EECR(HOST_REGISTER_EECR);
+HostRegister ACSR(HOST_REGISTER_ACSR);
+HostTimerCount TCNT1;
+
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t OCR1A, OCR1B, ICR1;
+volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+volatile uint16_t EEAR;
+volatile uint8_t EEDR;
+volatile uint8_t ADCSRA, ADCSRB, ADMUX;
+
+// Ports in the order B, C, D, the same order as PCINT0-2
+static volatile uint8_t* const portRegisters[3] = {&PORTB, &PORTC, &PORTD};
+static volatile uint8_t* const modeRegisters[3] = {&DDRB, &DDRC, &DDRD};
+static volatile uint8_t* const inputRegisters[3] = {&PINB, &PINC, &PIND};
+static volatile uint8_t* const maskRegisters[3] = {&PCMSK0, &PCMSK1, &PCMSK2};
+static const uint8_t portPins[3] = {PORT_PINS_B, PORT_PINS_C, 0xFF};
+
+static uint64_t now;                    // CPU cycles since reset
+static uint8_t sreg = _BV(SREG_I);      // Interrupts are on after the core's init()
+static uint8_t tifr1;
+static uint8_t pcifr;
+static uint8_t eecr;
+static uint8_t acsr;
+static uint8_t driven[3];               // Input pins driven from outside, per port
+static uint8_t drivenLevels[3];
+static uint8_t levels[3];               // Pin levels at the last sync
+static bool syncing;
+static bool resync;
+static HostPinListener* listeners;
+static uint16_t timerCount;             // TCNT1
+static uint64_t timerBase;              // Cycle of the last Timer1 tick
+static uint64_t eepromDone;             // Cycle when the running EEPROM write ends
+static uint8_t eeprom[HOST_EEPROM_SIZE];
+static int analogValues[NUM_ANALOG_INPUTS];
+static unsigned long randomState = 1;
+
+static bool pinPort(uint8_t pin, uint8_t& port, uint8_t& mask) {
+    if (pin < 8) {
+        port = 2;
+        mask = _BV(pin);
+    } else if (pin < 14) {
+        port = 0;
+        mask = _BV(pin - 8);
+    } else if (pin < 20) {
+        port = 1;
+        mask = _BV(pin - 14);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static uint8_t portPin(uint8_t port, uint8_t bit) {
+    return port == 0 ? 8 + bit : port == 1 ? 14 + bit : bit;
+}
+
+// Outputs follow PORT, inputs the drive from outside, else the pull-up
+static uint8_t portLevels(uint8_t port) {
+    uint8_t mode = *modeRegisters[port];
+    uint8_t out = *portRegisters[port];
+    uint8_t input = (driven[port] & drivenLevels[port]) | (~driven[port] & out);
+    return ((mode & out) | (~mode & input)) & portPins[port];
+}
+
+HostPinListener::HostPinListener() {
+    next = listeners;
+    listeners = this;
+}
+
+HostPinListener::~HostPinListener() {
+    for (HostPinListener** link = &listeners; *link; link = &(*link)->next) {
+        if (*link == this) {
+            *link = next;
+            break;
+        }
+    }
+}
+
+void hostSyncPins() {
+    // A listener that drives pins gets its changes handled in the next pass
+    if (syncing) {
+        resync = true;
+        return;
+    }
+    syncing = true;
+    do {
+        resync = false;
+        for (uint8_t port = 0; port < 3; port++) {
+            uint8_t level = portLevels(port);
+            *inputRegisters[port] = level;
+            uint8_t changed = level ^ levels[port];
+            if (!changed) continue;
+            levels[port] = level;
+            if (changed & *maskRegisters[port]) pcifr |= _BV(port);
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                if (!(changed & _BV(bit))) continue;
+                for (HostPinListener* listener = listeners; listener; listener = listener->next) {
+                    listener->pinChanged(portPin(port, bit), level & _BV(bit));
+                }
+            }
+        }
+    } while (resync);
+    syncing = false;
+}
+
+// Timer1 with the prescaler, the TOP of the waveform mode and the flags at compare
+// matches and at the wrap. Phase correct modes count up only.
+static uint16_t timerPrescaler() {
+    static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return prescalers[TCCR1B & 0x07];
+}
+
+static uint16_t timerTop() {
+    uint8_t mode = ((TCCR1B >> 1) & 0x0C) | (TCCR1A & 0x03);
+    switch (mode) {
+        case 1: case 5: return 0x00FF;
+        case 2: case 6: return 0x01FF;
+        case 3: case 7: return 0x03FF;
+        case 4: case 9: case 11: case 15: return OCR1A;
+        case 8: case 10: case 12: case 14: return ICR1;
+        default: return 0xFFFF;
+    }
+}
+
+static void timerMatch(uint32_t from, uint32_t to) {
+    if (OCR1A > from && OCR1A <= to) tifr1 |= _BV(OCF1A);
+    if (OCR1B > from && OCR1B <= to) tifr1 |= _BV(OCF1B);
+}
+
+static void timerSync() {
+    uint16_t prescaler = timerPrescaler();
+    if (!prescaler) {
+        timerBase = now;
+        return;
+    }
+    uint64_t ticks = (now - timerBase) / prescaler;
+    timerBase += ticks * prescaler;
+    uint16_t top = timerTop();
+    while (ticks) {
+        // Past TOP after a change of TOP the counter runs up to MAX
+        uint32_t wrap = timerCount <= top ? top : 0xFFFF;
+        uint32_t toWrap = wrap - timerCount;
+        if (ticks <= toWrap) {
+            timerMatch(timerCount, timerCount + ticks);
+            timerCount += ticks;
+            break;
+        }
+        timerMatch(timerCount, wrap);
+        if (OCR1A == 0) tifr1 |= _BV(OCF1A);
+        if (OCR1B == 0) tifr1 |= _BV(OCF1B);
+        tifr1 |= _BV(TOV1);
+        timerCount = 0;
+        ticks -= toWrap + 1;
+    }
+}
+
+static uint32_t ticksTo(uint16_t target, uint16_t top) {
+    if (target > timerCount) return target - timerCount;
+    return (uint32_t)(top - timerCount) + 1 + target;
+}
+
+// Cycles until the next enabled Timer1 interrupt, UINT64_MAX if there is none
+static uint64_t timerEvent() {
+    uint16_t prescaler = timerPrescaler();
+    if (!prescaler) return UINT64_MAX;
+    uint16_t top = timerTop();
+    uint32_t ticks = UINT32_MAX;
+    if ((TIMSK1 & _BV(OCIE1A)) && OCR1A <= top) ticks = min(ticks, ticksTo(OCR1A, top));
+    if ((TIMSK1 & _BV(OCIE1B)) && OCR1B <= top) ticks = min(ticks, ticksTo(OCR1B, top));
+    if (TIMSK1 & _BV(TOIE1)) ticks = min(ticks, ticksTo(0, top));
+    if (ticks == UINT32_MAX) return UINT64_MAX;
+    return ticks * (uint64_t)prescaler - (now - timerBase);
+}
+
+// Run the pending interrupt with the highest priority, false if there is none
+static bool dispatch() {
+    if (!(sreg & _BV(SREG_I))) return false;
+    void (*handler)(void);
+    if ((PCICR & _BV(PCIE0)) && (pcifr & _BV(PCIF0))) {
+        pcifr &= ~_BV(PCIF0);
+        handler = PCINT0_vect;
+    } else if ((PCICR & _BV(PCIE1)) && (pcifr & _BV(PCIF1))) {
+        pcifr &= ~_BV(PCIF1);
+        handler = PCINT1_vect;
+    } else if ((PCICR & _BV(PCIE2)) && (pcifr & _BV(PCIF2))) {
+        pcifr &= ~_BV(PCIF2);
+        handler = PCINT2_vect;
+    } else if ((TIMSK1 & _BV(OCIE1A)) && (tifr1 & _BV(OCF1A))) {
+        tifr1 &= ~_BV(OCF1A);
+        handler = TIMER1_COMPA_vect;
+    } else if ((TIMSK1 & _BV(OCIE1B)) && (tifr1 & _BV(OCF1B))) {
+        tifr1 &= ~_BV(OCF1B);
+        handler = TIMER1_COMPB_vect;
+    } else if ((TIMSK1 & _BV(TOIE1)) && (tifr1 & _BV(TOV1))) {
+        tifr1 &= ~_BV(TOV1);
+        handler = TIMER1_OVF_vect;
+    } else if ((acsr & _BV(ACIE)) && (acsr & _BV(ACI))) {
+        acsr &= ~_BV(ACI);
+        handler = ANALOG_COMP_vect;
+    } else {
+        return false;
+    }
+    sreg &= ~_BV(SREG_I);
+    if (handler) handler();
+    now += HOST_ISR_CYCLES;
+    // Pins written by the handler change at its exit, an upper bound for latencies
+    hostSyncPins();
+    sreg |= _BV(SREG_I);
+    return true;
+}
+
+static void runInterrupts() {
+    timerSync();
+    while (dispatch()) {
+        timerSync();
+    }
+}
+
+void hostAdvance(uint32_t cycles) {
+    hostSyncPins();
+    runInterrupts();
+    uint64_t end = now + cycles;
+    while (now < end) {
+        uint64_t event = timerEvent();
+        now = (event < end - now) ? now + max(event, (uint64_t)1) : end;
+        // Interrupts take their time from the running code, a delay gets longer
+        uint64_t start = now;
+        runInterrupts();
+        end += now - start;
+    }
+}
+
+uint64_t hostCycles() {
+    return now;
+}
+
+void hostReset() {
+    now = 0;
+    sreg = _BV(SREG_I);
+    tifr1 = pcifr = eecr = acsr = 0;
+    for (uint8_t port = 0; port < 3; port++) {
+        *portRegisters[port] = *modeRegisters[port] = *inputRegisters[port] = 0;
+        *maskRegisters[port] = 0;
+        driven[port] = drivenLevels[port] = levels[port] = 0;
+    }
+    PCICR = 0;
+    TCCR1A = TCCR1B = TCCR1C = TIMSK1 = 0;
+    OCR1A = OCR1B = ICR1 = 0;
+    GPIOR0 = GPIOR1 = GPIOR2 = 0;
+    EEAR = 0;
+    EEDR = 0;
+    ADCSRA = ADCSRB = ADMUX = 0;
+    timerCount = 0;
+    timerBase = 0;
+    eepromDone = 0;
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    memset(analogValues, 0, sizeof(analogValues));
+    randomState = 1;
+    listeners = nullptr;
+    Serial.end();
+}
+
+void hostDrive(uint8_t pin, bool level) {
+    uint8_t port, mask;
+    if (!pinPort(pin, port, mask)) return;
+    driven[port] |= mask;
+    if (level) drivenLevels[port] |= mask;
+    else drivenLevels[port] &= ~mask;
+    hostSyncPins();
+}
+
+void hostRelease(uint8_t pin) {
+    uint8_t port, mask;
+    if (!pinPort(pin, port, mask)) return;
+    driven[port] &= ~mask;
+    hostSyncPins();
+}
+
+bool hostPinLevel(uint8_t pin) {
+    uint8_t port, mask;
+    if (!pinPort(pin, port, mask)) return false;
+    return portLevels(port) & mask;
+}
+
+void hostSetAnalog(uint8_t channel, int value) {
+    if (channel >= A0) channel -= A0;
+    if (channel < NUM_ANALOG_INPUTS) analogValues[channel] = value;
+}
+
+void hostSetSupplyLow(bool low) {
+    if (low == (bool)(acsr & _BV(ACO))) return;
+    if (low) acsr |= _BV(ACO);
+    else acsr &= ~_BV(ACO);
+    // ACIS1:0 = 00 toggle, 10 falling, 11 rising output edge
+    uint8_t edge = acsr & (_BV(ACIS1) | _BV(ACIS0));
+    if (edge == 0 || (edge == _BV(ACIS1) && !low) || (edge == (_BV(ACIS1) | _BV(ACIS0)) && low)) {
+        acsr |= _BV(ACI);
+    }
+    hostAdvance(0);
+}
+
+void hostSerialInput(const char* text) {
+    while (*text) Serial.receive(*text++);
+}
+
+void hostSerialOutput(Print* output) {
+    Serial.setOutput(output);
+}
+
+uint8_t* hostEeprom() {
+    return eeprom;
+}
+
+// EEPROM programming as started through EECR, the cell changes at once, the
+// EEPROM stays busy for the programming time
+static void eepromProgram(uint8_t mode) {
+    uint8_t& cell = eeprom[EEAR & (HOST_EEPROM_SIZE - 1)];
+    switch (mode) {
+        case 0: cell = EEDR; break;
+        case 1: cell = 0xFF; break;
+        case 2: cell &= EEDR; break;
+    }
+    eepromDone = now + (mode == 0 ? EEPROM_WRITE_CYCLES : EEPROM_HALF_CYCLES);
+}
+
+uint8_t hostRegisterRead(uint8_t id) {
+    switch (id) {
+        case HOST_REGISTER_SREG:
+            return sreg;
+        case HOST_REGISTER_TIFR1:
+            hostAdvance(HOST_REGISTER_CYCLES);
+            return tifr1;
+        case HOST_REGISTER_PCIFR:
+            hostAdvance(HOST_REGISTER_CYCLES);
+            return pcifr;
+        case HOST_REGISTER_EECR:
+            hostAdvance(HOST_REGISTER_CYCLES);
+            return (eecr & ~_BV(EEPE)) | (now < eepromDone ? _BV(EEPE) : 0);
+        case HOST_REGISTER_ACSR:
+            return acsr;
+    }
+    return 0;
+}
+
+void hostRegisterWrite(uint8_t id, uint8_t value) {
+    switch (id) {
+        case HOST_REGISTER_SREG:
+            sreg = value;
+            if (sreg & _BV(SREG_I)) runInterrupts();
+            break;
+        case HOST_REGISTER_TIFR1:
+            timerSync();
+            tifr1 &= ~value;
+            break;
+        case HOST_REGISTER_PCIFR:
+            pcifr &= ~value;
+            break;
+        case HOST_REGISTER_EECR:
+            // EEPE starts programming only with EEMPE set before and the EEPROM idle
+            if ((value & _BV(EEPE)) && (eecr & _BV(EEMPE)) && now >= eepromDone) {
+                eepromProgram((eecr >> EEPM0) & 0x03);
+                value &= ~_BV(EEMPE);
+            }
+            if (value & _BV(EERE)) EEDR = eeprom[EEAR & (HOST_EEPROM_SIZE - 1)];
+            eecr = value & (_BV(EEPM1) | _BV(EEPM0) | _BV(EEMPE) | _BV(EERIE));
+            break;
+        case HOST_REGISTER_ACSR:
+            // ACO is read only, ACI is cleared by writing one
+            acsr = (value & ~(_BV(ACO) | _BV(ACI))) | (acsr & _BV(ACO)) | (acsr & ~value & _BV(ACI));
+            if (sreg & _BV(SREG_I)) runInterrupts();
+            break;
+    }
+}
+
+uint16_t hostTimer1Read() {
+    hostAdvance(HOST_REGISTER_CYCLES);
+    timerSync();
+    return timerCount;
+}
+
+void hostTimer1Write(uint16_t value) {
+    timerSync();
+    timerCount = value;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+    eeprom_busy_wait();
+    return eeprom[(uintptr_t)address & (HOST_EEPROM_SIZE - 1)];
+}
+
+uint16_t eeprom_read_word(const uint16_t* address) {
+    const uint8_t* bytes = (const uint8_t*)address;
+    return eeprom_read_byte(bytes) | (eeprom_read_byte(bytes + 1) << 8);
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        ((uint8_t*)destination)[i] = eeprom_read_byte((const uint8_t*)source + i);
+    }
+}
+
+// Like avr-libc: the programming mode in EECR is left as it is, erase and write
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+    eeprom_busy_wait();
+    EEAR = (uintptr_t)address;
+    EEDR = value;
+    uint8_t oldSREG = SREG;
+    cli();
+    EECR |= _BV(EEMPE);
+    EECR |= _BV(EEPE);
+    SREG = oldSREG;
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value) {
+    if (eeprom_read_byte(address) != value) eeprom_write_byte(address, value);
+}
+
+void eeprom_update_word(uint16_t* address, uint16_t value) {
+    eeprom_update_byte((uint8_t*)address, value);
+    eeprom_update_byte((uint8_t*)address + 1, value >> 8);
+}
+
+void eeprom_write_block(const void* source, void* destination, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        eeprom_write_byte((uint8_t*)destination + i, ((const uint8_t*)source)[i]);
+    }
+}
+
+void eeprom_update_block(const void* source, void* destination, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        eeprom_update_byte((uint8_t*)destination + i, ((const uint8_t*)source)[i]);
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    uint8_t port, mask;
+    if (!pinPort(pin, port, mask)) return;
+    if (mode == OUTPUT) {
+        *modeRegisters[port] |= mask;
+    } else {
+        *modeRegisters[port] &= ~mask;
+        if (mode == INPUT_PULLUP) *portRegisters[port] |= mask;
+        else *portRegisters[port] &= ~mask;
+    }
+    hostAdvance(HOST_PIN_IO_CYCLES);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    uint8_t port, mask;
+    if (!pinPort(pin, port, mask)) return;
+    if (val == LOW) *portRegisters[port] &= ~mask;
+    else *portRegisters[port] |= mask;
+    hostAdvance(HOST_PIN_IO_CYCLES);
+}
+
+int digitalRead(uint8_t pin) {
+    uint8_t port, mask;
+    if (!pinPort(pin, port, mask)) return LOW;
+    hostAdvance(HOST_PIN_IO_CYCLES);
+    hostSyncPins();
+    return (*inputRegisters[port] & mask) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+    if (pin >= A0) pin -= A0;
+    hostAdvance(ANALOG_READ_CYCLES);
+    return pin < NUM_ANALOG_INPUTS ? analogValues[pin] : 0;
+}
+
+unsigned long millis() {
+    hostAdvance(HOST_TIME_CYCLES);
+    return now / (F_CPU / 1000);
+}
+
+// Timer0 resolution of the AVR core: 4 us
+unsigned long micros() {
+    hostAdvance(HOST_TIME_CYCLES);
+    return now / (F_CPU / 250000) * 4;
+}
+
+void delay(unsigned long ms) {
+    unsigned long start = micros();
+    while (ms > 0) {
+        yield();
+        while (ms > 0 && (micros() - start) >= 1000) {
+            ms--;
+            start += 1000;
+        }
+    }
+}
+
+void delayMicroseconds(unsigned int us) {
+    hostAdvance(us * (F_CPU / 1000000));
+}
+
+void yield() {
+}
+
+// random() of avr-libc, so random(min, max) gives the sequence of the Nano
+static long avrRandom() {
+    long x = randomState;
+    if (x == 0) x = 123459876L;
+    long hi = x / 127773L;
+    long lo = x % 127773L;
+    x = 16807L * lo - 2836L * hi;
+    if (x < 0) x += 0x7FFFFFFFL;
+    randomState = x;
+    return x % 0x80000000UL;
+}
+
+long random(long howbig) {
+    if (howbig == 0) return 0;
+    return avrRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) return howsmall;
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+    if (seed != 0) randomState = seed;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+uint8_t digitalPinToPort(uint8_t pin) {
+    return pin < 8 ? PD : pin < 14 ? PB : pin < 20 ? PC : NOT_A_PIN;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+    uint8_t port, mask;
+    return pinPort(pin, port, mask) ? mask : 0;
+}
+
+uint8_t digitalPinToTimer(uint8_t pin) {
+    return pin == 9 ? TIMER1A : pin == 10 ? TIMER1B : NOT_ON_TIMER;
+}
+
+volatile uint8_t* portOutputRegister(uint8_t port) {
+    return port == PB ? &PORTB : port == PC ? &PORTC : port == PD ? &PORTD : nullptr;
+}
+
+volatile uint8_t* portInputRegister(uint8_t port) {
+    return port == PB ? &PINB : port == PC ? &PINC : port == PD ? &PIND : nullptr;
+}
+
+volatile uint8_t* portModeRegister(uint8_t port) {
+    return port == PB ? &DDRB : port == PC ? &DDRC : port == PD ? &DDRD : nullptr;
+}
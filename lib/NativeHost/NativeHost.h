@@ -0,0 +1,57 @@
+#ifndef NATIVEHOST_H
+#define NATIVEHOST_H
+
+#include <Arduino.h>
+
+// Host side of the virtual ATmega328P behind env:native.
+//
+// Time is a 16 MHz cycle counter that only moves when the firmware calls into the
+// core or reads a timed register: digitalWrite/digitalRead/pinMode cost
+// HOST_PIN_IO_CYCLES, millis/micros HOST_TIME_CYCLES, delays their length. While
+// time moves, Timer1 counts, and due interrupts run with HOST_ISR_CYCLES for entry,
+// exit and the work that does not call the core. Numbers measured this way are
+// estimates of the Nano timing: the costs are those of the AVR core functions, code
+// between the calls is free.
+//
+// Pins have the levels of the port registers where they are outputs and of the
+// host drive where they are inputs (pull-up or low without one). Listeners get
+// every level change, e.g. a display model on the LCD pins, and pin changes set the
+// PCINT flags.
+
+#define HOST_PIN_IO_CYCLES 56       // digitalWrite, digitalRead and pinMode of the AVR core
+#define HOST_TIME_CYCLES 60         // millis and micros
+#define HOST_ISR_CYCLES 200         // Entry, exit and body of an interrupt handler
+#define HOST_REGISTER_CYCLES 2      // Reading TCNT1, EECR and the other registers with side effects
+#define HOST_EEPROM_SIZE 1024
+
+// Gets the level changes of all pins
+class HostPinListener {
+public:
+    HostPinListener();
+    virtual ~HostPinListener();
+    virtual void pinChanged(uint8_t pin, bool level) = 0;
+
+private:
+    HostPinListener* next;          // Registered listeners form a list
+
+    friend void hostSyncPins();
+};
+
+void hostReset();                   // Power-on state: clock 0, registers, pins, Serial, EEPROM (erased); drops the listeners
+uint64_t hostCycles();              // CPU cycles since hostReset()
+void hostAdvance(uint32_t cycles);  // Let time pass and run the interrupts that fall due
+void hostSyncPins();                // Take pin levels from the registers, notify listeners, set PCINT flags
+
+void hostDrive(uint8_t pin, bool level);    // Drive an input pin from outside
+void hostRelease(uint8_t pin);      // Stop driving, the pin floats or is pulled up
+bool hostPinLevel(uint8_t pin);     // Current level of a pin
+void hostSetAnalog(uint8_t channel, int value);   // Value analogRead() returns, 0-1023
+
+void hostSetSupplyLow(bool low);    // Analog comparator output, true = supply below the bandgap
+
+void hostSerialInput(const char* text);     // Bytes the firmware receives on Serial
+void hostSerialOutput(Print* output);       // Where Serial output goes, nullptr = drop (stdout by default)
+
+uint8_t* hostEeprom();              // EEPROM content, HOST_EEPROM_SIZE bytes
+
+#endif
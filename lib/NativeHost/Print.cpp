@@ -0,0 +1,175 @@
+#include "Arduino.h"
+#include "Print.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++)) n++;
+        else break;
+    }
+    return n;
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh) {
+    return write(reinterpret_cast<const char *>(ifsh));
+}
+
+size_t Print::print(const char str[]) {
+    return write(str);
+}
+
+size_t Print::print(char c) {
+    return write(c);
+}
+
+size_t Print::print(unsigned char b, int base) {
+    return print((unsigned long)b, base);
+}
+
+size_t Print::print(int n, int base) {
+    return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base) {
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(long n, int base) {
+    if (base == 0) {
+        return write(n);
+    } else if (base == 10) {
+        if (n < 0) {
+            int t = print('-');
+            n = -n;
+            return printNumber(n, 10) + t;
+        }
+        return printNumber(n, 10);
+    } else {
+        return printNumber(n, base);
+    }
+}
+
+size_t Print::print(unsigned long n, int base) {
+    if (base == 0) return write(n);
+    else return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+    return printFloat(n, digits);
+}
+
+size_t Print::println(const __FlashStringHelper *ifsh) {
+    size_t n = print(ifsh);
+    n += println();
+    return n;
+}
+
+size_t Print::println(void) {
+    return write("\r\n");
+}
+
+size_t Print::println(const char c[]) {
+    size_t n = print(c);
+    n += println();
+    return n;
+}
+
+size_t Print::println(char c) {
+    size_t n = print(c);
+    n += println();
+    return n;
+}
+
+size_t Print::println(unsigned char b, int base) {
+    size_t n = print(b, base);
+    n += println();
+    return n;
+}
+
+size_t Print::println(int num, int base) {
+    size_t n = print(num, base);
+    n += println();
+    return n;
+}
+
+size_t Print::println(unsigned int num, int base) {
+    size_t n = print(num, base);
+    n += println();
+    return n;
+}
+
+size_t Print::println(long num, int base) {
+    size_t n = print(num, base);
+    n += println();
+    return n;
+}
+
+size_t Print::println(unsigned long num, int base) {
+    size_t n = print(num, base);
+    n += println();
+    return n;
+}
+
+size_t Print::println(double num, int digits) {
+    size_t n = print(num, digits);
+    n += println();
+    return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+
+    *str = '\0';
+
+    if (base < 2) base = 10;
+
+    do {
+        char c = n % base;
+        n /= base;
+
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+
+    return write(str);
+}
+
+// double is 32 bit on the AVR: the digits are computed in float to print the same
+size_t Print::printFloat(double value, uint8_t digits) {
+    size_t n = 0;
+    float number = value;
+
+    if (isnan(number)) return print("nan");
+    if (isinf(number)) return print("inf");
+    if (number > 4294967040.0f) return print("ovf");
+    if (number < -4294967040.0f) return print("ovf");
+
+    if (number < 0.0f) {
+        n += print('-');
+        number = -number;
+    }
+
+    float rounding = 0.5f;
+    for (uint8_t i = 0; i < digits; ++i) {
+        rounding /= 10.0f;
+    }
+
+    number += rounding;
+
+    unsigned long int_part = (unsigned long)number;
+    float remainder = number - (float)int_part;
+    n += print(int_part);
+
+    if (digits > 0) {
+        n += print('.');
+    }
+
+    while (digits-- > 0) {
+        remainder *= 10.0f;
+        unsigned int toPrint = (unsigned int)(remainder);
+        n += print(toPrint);
+        remainder -= toPrint;
+    }
+
+    return n;
+}
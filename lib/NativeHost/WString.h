@@ -0,0 +1,9 @@
+#ifndef WString_h
+#define WString_h
+
+// Strings in flash are plain strings on the host
+class __FlashStringHelper;
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+#define F(string_literal) (FPSTR(PSTR(string_literal)))
+
+#endif
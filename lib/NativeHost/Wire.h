@@ -0,0 +1,22 @@
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+// No I2C devices on the virtual Nano: transmissions are not acknowledged
+class TwoWire : public Stream {
+public:
+    void begin() {}
+    void beginTransmission(uint8_t) {}
+    uint8_t endTransmission(bool = true) { return 2; }
+    uint8_t requestFrom(uint8_t, uint8_t) { return 0; }
+    size_t write(uint8_t) { return 0; }
+    using Print::write;
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef NATIVEHOST_AVR_EEPROM_H
+#define NATIVEHOST_AVR_EEPROM_H
+
+// avr-libc EEPROM functions on the 1 KB EEPROM of the virtual Nano. Like on the
+// MCU they wait for a running write, and a write keeps the EEPROM busy for 3.4 ms.
+#include <stddef.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+
+#define eeprom_is_ready() bit_is_clear(EECR, EEPE)
+#define eeprom_busy_wait() do {} while (!eeprom_is_ready())
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+uint16_t eeprom_read_word(const uint16_t* address);
+void eeprom_read_block(void* destination, const void* source, size_t size);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+void eeprom_update_word(uint16_t* address, uint16_t value);
+void eeprom_write_block(const void* source, void* destination, size_t size);
+void eeprom_update_block(const void* source, void* destination, size_t size);
+
+#endif
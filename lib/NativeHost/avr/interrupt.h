@@ -0,0 +1,14 @@
+#ifndef NATIVEHOST_AVR_INTERRUPT_H
+#define NATIVEHOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+// An ISR is a plain function the virtual CPU calls by its vector name when the
+// interrupt is enabled and flagged, in the priority order of the ATmega328P. Only
+// the vectors of this firmware are dispatched, see NativeHost.cpp.
+#define ISR(vector, ...) extern "C" void vector(void)
+
+#define sei() (SREG |= _BV(SREG_I))
+#define cli() (SREG &= (uint8_t)~_BV(SREG_I))
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef NATIVEHOST_AVR_IO_H
+#define NATIVEHOST_AVR_IO_H
+
+// ATmega328P registers of the virtual Nano. Ports, timer compare values and the
+// other registers without side effects are plain variables; pin levels are taken
+// from them at the next pin sync (any core call or timed register access). The
+// registers below with a class type act on access: SREG dispatches pending
+// interrupts when I is set again, TCNT1 and EECR take time when read so busy
+// waits end, and the flag registers clear the bits written as one.
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+uint8_t hostRegisterRead(uint8_t id);
+void hostRegisterWrite(uint8_t id, uint8_t value);
+uint16_t hostTimer1Read();
+void hostTimer1Write(uint16_t value);
+
+enum {
+    HOST_REGISTER_SREG,
+    HOST_REGISTER_TIFR1,
+    HOST_REGISTER_PCIFR,
+    HOST_REGISTER_EECR,
+    HOST_REGISTER_ACSR
+};
+
+class HostRegister {
+public:
+    constexpr explicit HostRegister(uint8_t id) : id(id) {}
+    operator uint8_t() const { return hostRegisterRead(id); }
+    HostRegister& operator=(uint8_t value) { hostRegisterWrite(id, value); return *this; }
+    HostRegister& operator|=(uint8_t value) { return *this = (uint8_t)(*this | value); }
+    HostRegister& operator&=(uint8_t value) { return *this = (uint8_t)(*this & value); }
+    HostRegister& operator^=(uint8_t value) { return *this = (uint8_t)(*this ^ value); }
+private:
+    uint8_t id;
+};
+
+class HostTimerCount {
+public:
+    operator uint16_t() const { return hostTimer1Read(); }
+    HostTimerCount& operator=(uint16_t value) { hostTimer1Write(value); return *this; }
+};
+
+extern HostRegister SREG;
+extern HostRegister TIFR1;
+extern HostRegister PCIFR;
+extern HostRegister EECR;
+extern HostRegister ACSR;
+extern HostTimerCount TCNT1;
+
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern volatile uint16_t OCR1A, OCR1B, ICR1;
+extern volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t EEDR;
+extern volatile uint8_t ADCSRA, ADCSRB, ADMUX;
+
+#define SREG_I 7
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+
+#define WGM10 0
+#define WGM11 1
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+#define EEPM0 4
+#define EEPM1 5
+
+#define ACIS0 0
+#define ACIS1 1
+#define ACIC 2
+#define ACIE 3
+#define ACI 4
+#define ACO 5
+#define ACBG 6
+#define ACD 7
+
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define ACME 6
+#define REFS0 6
+#define REFS1 7
+
+#define E2END 0x3FF
+#define RAMEND 0x8FF
+
+#endif
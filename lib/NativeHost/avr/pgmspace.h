@@ -0,0 +1,24 @@
+#ifndef NATIVEHOST_AVR_PGMSPACE_H
+#define NATIVEHOST_AVR_PGMSPACE_H
+
+// The host has one address space: flash data is ordinary constant data
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+#define pgm_read_float(address) (*(const float *)(address))
+#define pgm_read_ptr(address) (*(void * const *)(address))
+
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+
+#endif
@@ -0,0 +1,130 @@
+#include "PowerFail.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+#define COMMIT_BYTE 0xA5            // Last byte of a complete record
+#define SUPPLY_MUX 6                // ADC multiplexer input of the divided supply (A6)
+
+// EEPROM programming modes (EEPM1:0)
+#define MODE_ERASE_WRITE 0
+#define MODE_WRITE_ONLY (1 << EEPM1)
+
+PowerFail* PowerFail::instance = nullptr;
+
+ISR(ANALOG_COMP_vect) {
+    PowerFail::handleInterrupt();
+}
+
+static void eepromProgram(uint16_t address, uint8_t value, uint8_t mode) {
+    while (EECR & (1 << EEPE)) {}
+    EEAR = address;
+    EEDR = value;
+    uint8_t oldSREG = SREG;
+    cli();
+    EECR = mode;
+    EECR |= (1 << EEMPE);
+    EECR |= (1 << EEPE);
+    SREG = oldSREG;
+}
+
+static long readLong(const uint8_t* bytes) {
+    return (int32_t)((uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24));
+}
+
+static void eepromDone() {
+    // Back to erase and write, which the EEPROM functions of avr-libc expect
+    while (EECR & (1 << EEPE)) {}
+    EECR = 0;
+}
+
+PowerFail::PowerFail(Axis& axis, int address) : axis(axis) {
+    this->address = address;
+    this->hasSaved = false;
+    this->tripped = false;
+    this->erasePending = 0;
+    this->saved.position = 0;
+    this->saved.workOffset = 0;
+    this->saved.homed = false;
+}
+
+void PowerFail::begin() {
+    uint8_t record[POWERFAIL_RECORD_SIZE];
+    eeprom_read_block(record, (const void*)(uintptr_t)address, POWERFAIL_RECORD_SIZE);
+    hasSaved = record[POWERFAIL_RECORD_SIZE - 1] == COMMIT_BYTE;
+    if (hasSaved) {
+        saved.position = readLong(record);
+        saved.workOffset = readLong(record + 4);
+        saved.homed = record[8] & POWERFAIL_FLAG_HOMED;
+    }
+    erasePending = POWERFAIL_RECORD_SIZE;
+
+    // Bandgap on the positive input, A6 through the ADC multiplexer on the negative one
+    ADCSRA &= ~(1 << ADEN);
+    ADCSRB |= (1 << ACME);
+    ADMUX = (ADMUX & ~0x0F) | SUPPLY_MUX;
+    instance = this;
+    arm();
+}
+
+bool PowerFail::getSnapshot(PowerFailSnapshot& snapshot) {
+    snapshot = saved;
+    return hasSaved;
+}
+
+bool PowerFail::isTripped() {
+    return tripped;
+}
+
+void PowerFail::update() {
+    if (tripped) {
+        // A short dip: the record was written, but the MCU kept running
+        if (ACSR & (1 << ACO)) return;
+        erasePending = POWERFAIL_RECORD_SIZE;
+        tripped = false;
+        arm();
+        return;
+    }
+
+    // One cell per call like the event log, the commit byte first
+    if (erasePending == 0 || !eeprom_is_ready()) return;
+    eeprom_update_byte((uint8_t*)(uintptr_t)(address + erasePending - 1), 0xFF);
+    erasePending--;
+}
+
+void PowerFail::handleInterrupt() {
+    if (instance) instance->save();
+}
+
+void PowerFail::save() {
+    // Once per dip, update() arms again
+    ACSR &= ~(1 << ACIE);
+    Axis::emergencyStopAll();
+    tripped = true;
+
+    long position = axis.getStepPosition();
+    long offset = axis.getStepWorkOffset();
+
+    // Another write may just be set up by the EEPROM functions, leave them their registers
+    uint16_t oldAddress = EEAR;
+    uint8_t oldData = EEDR;
+    uint8_t record[POWERFAIL_RECORD_SIZE] = {
+        (uint8_t)position, (uint8_t)(position >> 8), (uint8_t)(position >> 16), (uint8_t)(position >> 24),
+        (uint8_t)offset, (uint8_t)(offset >> 8), (uint8_t)(offset >> 16), (uint8_t)(offset >> 24),
+        (uint8_t)(axis.isHomed() ? POWERFAIL_FLAG_HOMED : 0),
+        COMMIT_BYTE
+    };
+    for (uint8_t i = 0; i < POWERFAIL_RECORD_SIZE; i++) {
+        eepromProgram(address + i, record[i], i < erasePending ? MODE_ERASE_WRITE : MODE_WRITE_ONLY);
+    }
+    eepromDone();
+    EEAR = oldAddress;
+    EEDR = oldData;
+}
+
+void PowerFail::arm() {
+    // Interrupt when the comparator output rises: supply below the bandgap
+    ACSR = (1 << ACBG) | (1 << ACIS1) | (1 << ACIS0);
+    ACSR |= (1 << ACI);
+    ACSR |= (1 << ACIE);
+}
@@ -0,0 +1,158 @@
+#include "ProbeTuner.h"
+
+ProbeTuner::ProbeTuner(Axis& axis) : axis(axis) {
+    this->phase = PROBETUNE_IDLE;
+    this->tolerance = 0.0;
+    this->fastTolerance = 0.0;
+    this->previousFast = 0.0;
+    this->previousSlow = 0.0;
+    this->bestFast = 0.0;
+    this->bestSlow = 0.0;
+    this->speed = 0.0;
+    this->run = 0;
+    this->rejected = 0;
+    for (uint8_t i = 0; i < PROBETUNE_RUNS; i++) this->results[i] = 0.0;
+    this->retracting = false;
+    this->probing = false;
+}
+
+void ProbeTuner::start(float tolerance, float fastTolerance) {
+    if (isRunning() || !axis.isHomed()) return;
+    this->tolerance = tolerance;
+    this->fastTolerance = fastTolerance;
+    previousFast = axis.getProbeFastSpeed();
+    previousSlow = axis.getProbeSlowSpeed();
+    bestFast = previousFast;
+    bestSlow = 0.0;
+    phase = PROBETUNE_SLOW;
+    speed = PROBETUNE_SLOW_FIRST;
+    run = 0;
+    rejected = 0;
+    retracting = false;
+    probing = false;
+}
+
+void ProbeTuner::stop() {
+    if (!isRunning()) return;
+    // Also halts the retract before a run
+    axis.stopProbing();
+    retracting = false;
+    probing = false;
+    axis.setProbeSpeeds(previousFast, previousSlow);
+    phase = PROBETUNE_IDLE;
+}
+
+void ProbeTuner::update() {
+    if (!isRunning()) return;
+
+    if (!retracting && !probing) {
+        axis.moveToPos(axis.getCurrentPosition() - axis.getBackoffDistance() - PROBETUNE_RETRACT_MARGIN,
+                       axis.getMoveSpeed());
+        retracting = true;
+        return;
+    }
+
+    if (retracting) {
+        if (axis.isFault()) {
+            finish(PROBETUNE_FAILED);
+            return;
+        }
+        if (!axis.inPosition()) return;
+        retracting = false;
+        if (phase == PROBETUNE_SLOW) axis.setProbeSpeeds(previousFast, speed);
+        else axis.setProbeSpeeds(speed, bestSlow);
+        axis.probing();
+        probing = true;
+        return;
+    }
+
+    HomingState state = axis.getProbingState();
+    if (state == ERROR || axis.isFault()) {
+        finish(PROBETUNE_FAILED);
+        return;
+    }
+    if (state != FINISHED) return;
+    probing = false;
+
+    ProbeStats stats = axis.getProbeStats();
+    if (!stats.approached) {
+        if (++rejected >= PROBETUNE_RUNS) finish(PROBETUNE_FAILED);
+        return;
+    }
+    results[run] = phase == PROBETUNE_SLOW ? stats.mean : stats.fastTrigger;
+    if (++run >= PROBETUNE_RUNS) finishSpeed();
+}
+
+bool ProbeTuner::isRunning() {
+    return phase == PROBETUNE_SLOW || phase == PROBETUNE_FAST;
+}
+
+ProbeTunePhase ProbeTuner::getPhase() {
+    return phase;
+}
+
+float ProbeTuner::getSpeed() {
+    return speed;
+}
+
+uint8_t ProbeTuner::getRun() {
+    return run;
+}
+
+float ProbeTuner::getSpread() {
+    return spread(results, run);
+}
+
+float ProbeTuner::spread(const float* results, uint8_t count) {
+    if (!count) return 0.0;
+    float low = results[0];
+    float high = results[0];
+    for (uint8_t i = 1; i < count; i++) {
+        if (results[i] < low) low = results[i];
+        if (results[i] > high) high = results[i];
+    }
+    return high - low;
+}
+
+float ProbeTuner::nextSpeed(float speed, float spread, float tolerance, float last, float& best) {
+    if (spread > tolerance) return 0.0;
+    best = speed;
+    float next = speed * PROBETUNE_FACTOR;
+    return next <= last ? next : 0.0;
+}
+
+void ProbeTuner::finishSpeed() {
+    float spread = ProbeTuner::spread(results, run);
+    run = 0;
+    rejected = 0;
+
+    if (phase == PROBETUNE_SLOW) {
+        float next = nextSpeed(speed, spread, tolerance, PROBETUNE_SLOW_LAST, bestSlow);
+        if (!bestSlow) {
+            finish(PROBETUNE_FAILED);
+        } else if (next) {
+            speed = next;
+        } else {
+            phase = PROBETUNE_FAST;
+            speed = PROBETUNE_FAST_FIRST;
+            bestFast = 0.0;
+        }
+        return;
+    }
+
+    // The approach stops on the probe without a ramp, faster than a move it loses steps
+    float next = nextSpeed(speed, spread, fastTolerance, min((float)PROBETUNE_FAST_LAST, axis.getMoveSpeed()), bestFast);
+    if (!bestFast) {
+        finish(PROBETUNE_FAILED);
+    } else if (next) {
+        speed = next;
+    } else {
+        finish(PROBETUNE_DONE);
+    }
+}
+
+void ProbeTuner::finish(ProbeTunePhase result) {
+    if (result == PROBETUNE_DONE) axis.setProbeSpeeds(bestFast, bestSlow);
+    else axis.setProbeSpeeds(previousFast, previousSlow);
+    phase = result;
+}
@@ -0,0 +1,69 @@
+#ifndef PROBETUNER_H
+#define PROBETUNER_H
+
+#include <Arduino.h>
+#include <Axis.h>
+
+#define PROBETUNE_RUNS 5            // Probing runs per tested speed
+#define PROBETUNE_SLOW_FIRST 0.25   // Slowest tested touch speed in mm/s
+#define PROBETUNE_SLOW_LAST 4.0     // Fastest tested touch speed in mm/s
+#define PROBETUNE_FAST_FIRST 4.0    // Slowest tested approach speed in mm/s
+#define PROBETUNE_FAST_LAST 20.0    // Fastest tested approach speed in mm/s, at most the move speed of the axis
+#define PROBETUNE_FACTOR 1.5        // Speed increase from one tested speed to the next
+#define PROBETUNE_RETRACT_MARGIN 1.0 // Retract beyond the probing back off before each run in mm
+
+// Tuning phases
+typedef enum {
+    PROBETUNE_IDLE,     // Not running
+    PROBETUNE_SLOW,     // Testing touch speeds, the approach speed is kept
+    PROBETUNE_FAST,     // Testing approach speeds with the chosen touch speed
+    PROBETUNE_DONE,     // Finished, the speeds are set
+    PROBETUNE_FAILED    // The slowest speed was not repeatable or probing failed
+} ProbeTunePhase;
+
+// Finds the fastest probe speeds that are still repeatable. Each speed, slowest first,
+// gets PROBETUNE_RUNS probing runs, and the spread (max - min) of the results must
+// stay within the tolerance: the probed position for the touch speed, the trigger
+// position of the approach for the approach speed. The first speed that fails ends
+// the phase and the previous one is kept. Before each run the carriage retracts
+// clear of the probe, and runs that still start on it have no fast approach to
+// measure: they are discarded, and as many discarded runs as PROBETUNE_RUNS fail
+// the tuning.
+class ProbeTuner {
+public:
+    // Constructor of the class
+    ProbeTuner(Axis& axis);
+
+    void start(float tolerance, float fastTolerance); // Start tuning a homed axis, tolerances in mm
+    void stop();                // Halt the run, cancel and restore the previous speeds
+    void update();              // Run the probing runs, call once per loop
+    bool isRunning();           // Check if tuning runs
+    ProbeTunePhase getPhase();  // Get the tuning phase
+    float getSpeed();           // Get the tested speed in mm/s
+    uint8_t getRun();           // Get the number of finished runs of the tested speed
+    float getSpread();          // Get the spread of the runs of the tested speed so far in mm
+
+    static float spread(const float* results, uint8_t count); // Get max - min of the results, 0 without any
+    static float nextSpeed(float speed, float spread, float tolerance, float last, float& best); // Judge a tested speed, keep it in best when repeatable, get the next speed to test or 0 to end the phase
+
+private:
+    Axis& axis;                 // Axis with the probe
+    ProbeTunePhase phase;       // Tuning phase
+    float tolerance;            // Allowed spread of the probed position in mm
+    float fastTolerance;        // Allowed spread of the approach trigger in mm
+    float previousFast;         // Speeds before tuning in mm/s
+    float previousSlow;
+    float bestFast;             // Fastest repeatable speeds so far in mm/s
+    float bestSlow;
+    float speed;                // Tested speed in mm/s
+    uint8_t run;                // Finished runs of the tested speed
+    uint8_t rejected;           // Discarded runs of the tested speed
+    float results[PROBETUNE_RUNS]; // Results of the runs of the tested speed in mm
+    bool retracting;            // The retract before a run was started
+    bool probing;               // A probing run was started
+
+    void finishSpeed();         // Judge the tested speed and pick the next one
+    void finish(ProbeTunePhase result); // Set the chosen or the previous speeds
+};
+
+#endif  // PROBETUNER_H
@@ -1,9 +1,18 @@
 #include <Arduino.h>
+#include <avr/eeprom.h>
 #include <Wire.h>
 #include <Encoder.h>
 #include <LiquidCrystalFast.h>
 #include <Axis.h>
 #include <Bounce2.h>
+#include <InputTrace.h>
+#include <EventLog.h>
+#include <JobProgram.h>
+#include <LcdMirror.h>
+#include <LcdBar.h>
+#include <PowerFail.h>
+#include <ProbeTuner.h>
+#include <Gestures.h>
 
 // Pins used
 // Encoder
@@ -12,9 +21,44 @@
 #define BUTTON_PIN  A0 // A2 Encoder click pin
 
 // Stepper driver
+// Set STEP_HW_PULSES to 1 to generate the step pulses with Timer1. STEP must then
+// be wired to OC1A (D9) or OC1B (D10); the default wiring swaps STEP and ENABLE.
+#define STEP_HW_PULSES 0
+#if STEP_HW_PULSES
+#define STEP_PIN 10 // OC1B
+#define DIR_PIN 11
+#define ENABLE_PIN 12
+#else
 #define STEP_PIN 12
 #define DIR_PIN 11
 #define ENABLE_PIN 10
+#endif
+
+// Stepper geometry
+#define MOTOR_STEPS 200
+#define MICROSTEPS 8
+#define SPINDLE_LEAD 8.0
+
+// Step rates in steps/s above which 2 or 4 step pulses are emitted per timing event
+#define MULTISTEP_DOUBLE_RATE 3000
+#define MULTISTEP_QUAD_RATE 6000
+
+// Step rates in steps/s where the motor resonates (200 steps x 8 microsteps on the
+// 8 mm lead: 200 steps/s = 1 mm/s). Moves accelerate through a band and cruise at
+// its nearer edge instead. Find the bands by listening while jogging; 0 = off.
+#define RESONANCE_BAND_LOW 0
+#define RESONANCE_BAND_HIGH 0
+
+// Optional position encoder (glass scale or motor shaft encoder) to detect and
+// correct step loss. The Nano has no free external interrupt pins, so the axis decodes
+// it in the pin change interrupt it shares with the endstops (A1/A5 on PCINT1). That
+// interrupt waits for a running step interrupt, so the edges must stay about 200 us
+// apart: 200 counts/mm give 250 us at the 20 mm/s move speed. Closer edges are
+// logged as ScaleErr and end the corrections until the next homing.
+#define SCALE_ENABLED 0
+#define SCALE_A_PIN A1
+#define SCALE_B_PIN A5
+#define SCALE_COUNTS_PER_MM 200.0
 
 // Endstops and Probe
 #define ENDSTOP_MIN_PIN A2
@@ -32,7 +76,57 @@
 // Encoder steps per click
 #define ENC_STEPS 4
 #define DISPLAY_REFRESH_INTERVAL_MS 200
+#define BAR_REFRESH_INTERVAL_MS 20 // Position bar on the main screen while the lift moves
 #define ENCODER_READ_INTERVAL_MS 50
+// No screen uses double clicks or hold repeats, both are off: clicks are reported at
+// the release and a held button gives one long press
+#define DOUBLE_CLICK_MS 0 // Window for a double click, 0 = no double clicks
+#define LONG_PRESS_MS 1000
+#define HOLD_REPEAT_MS 0 // Interval of the repeats after a long press, 0 = no repeats
+#define FEED_OVERRIDE_STEP 5 // Feed override change per encoder detent in %
+#define LCD_FRAME_STATS 0 // Print LCD bus bytes and time of every status frame over Serial
+
+// Step timing capture of the 'c' command: records kept in RAM, 3 bytes each (a power
+// of 2 up to 128), and every how many step events one is kept. Raise the decimation
+// rather than the records to see a whole move, RAM is short on the Nano.
+#define STEPTRACE_RECORDS 64
+#define STEPTRACE_DECIMATION 1
+
+// Number of touches per probing run
+#define PROBE_TOUCHES 3
+
+// Probe speed tuning: allowed spread of the probed position and of the fast approach trigger in mm
+#define PROBE_TUNE_TOLERANCE 0.02
+#define PROBE_TUNE_FAST_TOLERANCE 0.2
+// Values of _lastTuneRun besides the run numbers: nothing shown yet, result shown
+#define TUNE_RUN_NONE 0xFF
+#define TUNE_RUN_RESULT 0xFE
+
+// Simulated probe instead of the probe pin, e.g. to check the tuning statistics in simavr.
+// Closes at the surface height above home plus a random offset of up to +-noise per touch.
+#define PROBE_SIM 0
+#define PROBE_SIM_SURFACE 40.0
+#define PROBE_SIM_NOISE 0.005
+#define PROBE_SIM_HYSTERESIS 0.05 // Retract in mm before the simulated probe opens again
+
+// Lead screw calibration in EEPROM, behind the event log
+#define CALIBRATION_EEPROM_ADDRESS 512
+#define CALIBRATION_MAGIC 0xCA
+#define CALIBRATION_JOG_MM 0.01 // Jog per encoder click while calibrating
+
+// Multi-pass job program in EEPROM, behind the calibration
+#define JOB_EEPROM_ADDRESS 560
+#define JOB_PASS_STEP 100 // Height added by "Add pass" in 0.01 mm
+
+// Position snapshot at a supply failure, behind the job program. Needs the supply
+// divided down to about 1.5 V on A6, falling below 1.1 V when the supply fails.
+// The next start then verifies the position near home instead of homing.
+#define POWERFAIL_ENABLED 0
+#define POWERFAIL_EEPROM_ADDRESS 610
+
+// Tuned probe speeds in EEPROM, behind the power fail snapshot (610-619)
+#define PROBE_SPEEDS_EEPROM_ADDRESS 620
+#define PROBE_SPEEDS_MAGIC 0x5B
 
 // ***************************************************************************************************************
 //                  Program start
@@ -40,20 +134,67 @@
 
 LiquidCrystalFast lcd(LCD_RS, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
 Encoder encoder(LE_ENCA, LE_ENCB);
-Bounce buttonOk = Bounce();
-Axis lift(STEP_PIN, DIR_PIN, ENABLE_PIN, 200, 8, 8, 0.0, 119.0, ENDSTOP_MIN_PIN, ENDSTOP_MAX_PIN, PROBE_PIN);
+InputTrace trace(Serial);
+EventLog eventLog;
+LcdMirror mirror(Serial);
+StepTraceRecord stepTraceRing[STEPTRACE_RECORDS];
+
+// Button that reads its level from the input trace while replaying
+class TraceBounce : public Bounce {
+protected:
+  bool readCurrentState() {
+    return trace.isReplaying() ? trace.button() : Bounce::readCurrentState();
+  }
+};
+
+TraceBounce buttonOk = TraceBounce();
+Gestures gestures;
+
+// Lift geometry and pins, checked at compile time
+struct LiftConfig {
+  static const uint8_t stepPin = STEP_PIN, dirPin = DIR_PIN, enablePin = ENABLE_PIN;
+  static const uint8_t endstopMinPin = ENDSTOP_MIN_PIN, endstopMaxPin = ENDSTOP_MAX_PIN, probePin = PROBE_PIN;
+  static constexpr float stepsPerRev = MOTOR_STEPS, microsteps = MICROSTEPS, spindleLead = SPINDLE_LEAD;
+  static constexpr float minPosition = 0.0, maxPosition = 119.0;
+};
+StaticAxis<LiftConfig> lift;
+JobProgram job(lift);
+ProbeTuner probeTuner(lift);
+LcdBar positionBar(lcd, 0, 1, 20); // Replaces the homing/probing line during moves
+#if POWERFAIL_ENABLED
+PowerFail powerFail(lift, POWERFAIL_EEPROM_ADDRESS);
+#endif
 
 // Global Variables
 bool buttonPressed = false;
-long _lastEncoderPosition = 0;
-unsigned long _lastEncoderRead = 0, _lastDisplayUpdate = 0;
+Gesture gesture; // Gesture of the current loop, GESTURE_NONE if there is none
+int16_t _encoderDetents = 0; // Encoder detents of the last read
+unsigned long _lastEncoderRead = 0, _lastDisplayUpdate = 0, _lastBarUpdate = 0;
 bool motorEnabled = false; // Flag for motor enable/disable
+HomingState _lastProbingState = FINISHED;
+HomingState _lastHomingState = NOT_HOMED;
+bool _lastFault = false;
+bool _lastStepLoss = false;
+bool _lastScaleError = false;
+int eventLogOffset = 0; // First record shown on the event log screen
+int jobIndex = 0;       // Selected line of the job screen
+int jobOffset = 0;      // First line shown on the job screen
+bool jobEditing = false; // Encoder changes the selected step
+uint8_t _lastJobStep = 0xFF; // Job step shown on the job run screen
+bool _lastJobWaiting = false; // Confirm prompt shown on the job run screen
+bool _lastJobReceiving = false; // Job upload ran in the previous loop
+bool _lastReplaying = false; // Inputs came from the trace in the previous loop
+uint8_t _lastTuneRun = TUNE_RUN_NONE; // Run shown on the probe tuning screen
+uint8_t _lastFeedOverride = 0; // Feed override shown on the main screen, 0 = none
 
 // LCD Texts
-const char axisStateText[][14] PROGMEM = {"None", "Go to Target", "Go to Home", "Go to Probe", "In Position", "Max!", "Min!"};
-const char homingStateText[][10] PROGMEM = {"None", "Move Fast", "Backoff", "Move slow", "Homed", "Error"};
-const char probingStateText[][10] PROGMEM = {"None", "Move Fast", "Backoff", "Move slow", "Probed", "Error"};
-const char menuOptions[][20] PROGMEM = {"Probing", "Homing", "Move to Max", "Move to Min", "Move to Workpiece", "Motor On/Off", "Back"};
+const char axisStateText[][14] PROGMEM = {"None", "Go to Target", "Go to Home", "Go to Probe", "In Position", "Max!", "Min!", "E-Stop!"};
+const char homingStateText[][10] PROGMEM = {"None", "Move Fast", "Backoff", "Move slow", "Homed", "Error", "Retract", "Verify"};
+const char probingStateText[][10] PROGMEM = {"None", "Move Fast", "Backoff", "Move slow", "Probed", "Error", "Retract", "Verify"};
+const char menuOptions[][20] PROGMEM = {"Probing", "Homing", "Move to Max", "Move to Min", "Move to Workpiece", "Motor On/Off", "Probe Stats", "Event Log", "Calibrate", "Job", "Tune Probe", "Back"};
+const char eventText[][9] PROGMEM = {"-", "Boot", "Homed", "HomeErr", "Probed", "ProbeErr", "E-Stop", "StepLoss", "PowerOff", "ScaleErr"};
+#define EVENT_TEXTS (int)(sizeof(eventText) / sizeof(eventText[0]))
+#define MENU_ITEMS (int)(sizeof(menuOptions) / sizeof(menuOptions[0]))
 
 enum State {
   MAIN_SCREEN,
@@ -63,7 +204,13 @@ enum State {
   MOVE_TO_MAX,
   MOVE_TO_MIN,
   MOVE_TO_WORKPIECE,
-  MOTOR_TOGGLE
+  MOTOR_TOGGLE,
+  PROBE_STATS_SCREEN,
+  EVENT_LOG_SCREEN,
+  CALIBRATION_SCREEN,
+  JOB_SCREEN,
+  JOB_RUN_SCREEN,
+  TUNE_SCREEN
 };
 
 State currentState = MAIN_SCREEN;
@@ -73,13 +220,38 @@ int menuScrollOffset = 0; // Offset for scrolling the menu
 // Function prototypes
 int readEncoder(bool accelerated);
 void displayMenu();
+void displayProbeStats();
+void displayEventLog();
+void displayCalibration();
+void displayJob();
+void displayJobRun();
+void displayProbeTune();
+void selectJobLine();
+void loadCalibration();
+void saveCalibration();
+void loadProbeSpeeds();
+void saveProbeSpeeds();
+void simulateProbe();
+void logEvents();
+void printProbeStats();
+void printLcdFrameStats();
+void handleSerial();
+void finishJobUpload();
+void restoreScreen(uint16_t screen);
+long readEncoderCount();
+void readEncoderDetents();
+void flushGestures();
 void lcd_print_P(const char* str);
 
 void setup(void)
 {
   buttonOk.attach(BUTTON_PIN, INPUT_PULLUP);
   buttonOk.interval(5); // interval in ms
+  gestures.setTiming(DOUBLE_CLICK_MS, LONG_PRESS_MS, HOLD_REPEAT_MS);
+  // The detents of one read are the rotation of at most one read interval
+  gestures.setRotateWindow(ENCODER_READ_INTERVAL_MS);
 
+  lcd.setListener(&mirror);
   lcd.begin(20, 4);
   lcd.setCursor(0, 0);
   lcd.print(F("RouterLift V1.00"));
@@ -87,20 +259,94 @@ void setup(void)
   lcd.print(F("Starting up..."));
   lcd.setCursor(0, 2);
 
+  lift.begin(STEP_HW_PULSES);
+  StepTrace::begin(stepTraceRing, STEPTRACE_RECORDS);
+  lift.setProbeTouches(PROBE_TOUCHES);
+  lift.setMultiStepping(MULTISTEP_DOUBLE_RATE, MULTISTEP_QUAD_RATE);
+  lift.setResonanceBand(0, RESONANCE_BAND_LOW, RESONANCE_BAND_HIGH);
+  loadCalibration();
+  loadProbeSpeeds();
+  job.load(JOB_EEPROM_ADDRESS);
+#if SCALE_ENABLED
+  lift.setPositionEncoder(SCALE_A_PIN, SCALE_B_PIN, SCALE_COUNTS_PER_MM);
+#endif
+
+  eventLog.begin();
+  eventLog.log(EVENT_BOOT, lift.getStepPosition(), lift.getSensors());
+
+#if POWERFAIL_ENABLED
+  PowerFailSnapshot snapshot;
+  powerFail.begin();
+  if (powerFail.getSnapshot(snapshot)) {
+    eventLog.log(EVENT_POWER_FAIL, snapshot.position, snapshot.homed);
+    if (snapshot.homed) lift.resume(snapshot.position, snapshot.workOffset);
+  }
+#endif
+
   Serial.begin(115200);
-  _lastEncoderPosition = encoder.read() / ENC_STEPS;
-  _lastEncoderRead = millis();
+  readEncoderDetents();
   _lastDisplayUpdate = millis();
 }
 
 void loop(void)
 {
+#ifdef SIMAVR
+  // Loop marker and axis states for the simavr trace, see simtrace.c
+  GPIOR1++;
+  GPIOR2 = (lift.getHomingState() << 4) | lift.getProbingState();
+#endif
+  handleSerial();
+  if (trace.isReplaying()) {
+    trace.update();
+    lift.overrideSensors(trace.isReplaying() ? SENSOR_ALL : 0, trace.sensors());
+    uint16_t screen;
+    if (trace.getStartState(screen)) restoreScreen(screen);
+  }
+  // The encoder and button jump between the live and the replayed inputs
+  if (trace.isReplaying() != _lastReplaying) {
+    _lastReplaying = trace.isReplaying();
+    flushGestures();
+  }
+#if PROBE_SIM
+  if (!trace.isReplaying()) simulateProbe();
+#endif
+
   lift.handle();
+  job.update();
+  if (job.isReceiving() != _lastJobReceiving) {
+    _lastJobReceiving = job.isReceiving();
+    if (!_lastJobReceiving) finishJobUpload();
+  }
+  probeTuner.update();
+#if POWERFAIL_ENABLED
+  powerFail.update();
+#endif
   buttonOk.update();
+  // One gesture per loop, each screen sees only the gestures made while it is shown
+  if (millis() - _lastEncoderRead >= ENCODER_READ_INTERVAL_MS) readEncoderDetents();
+  gestures.update(buttonOk.read() == LOW, _encoderDetents);
+  if (!gestures.next(gesture)) gesture.type = GESTURE_NONE;
+  State loopState = currentState;
+
+  // Report the result of a finished probing run
+  HomingState probingState = lift.getProbingState();
+  if (probingState != _lastProbingState && (probingState == FINISHED || probingState == ERROR)) {
+    printProbeStats();
+    // The many runs of the probe tuning would flush the older events out of the log
+    if (currentState != TUNE_SCREEN || probingState == ERROR)
+      eventLog.log(probingState == FINISHED ? EVENT_PROBED : EVENT_PROBING_ERROR, lift.getStepPosition(), lift.getSensors());
+    if (probingState == ERROR) eventLog.flush();
+  }
+  _lastProbingState = probingState;
+  logEvents();
+
+  if (currentState != MAIN_SCREEN) positionBar.invalidate(); // Other screens draw over the bar
 
   switch (currentState) {
     case MAIN_SCREEN:
       if ((lift.inPosition() || lift.isError()) && (millis() - _lastDisplayUpdate > DISPLAY_REFRESH_INTERVAL_MS)) {
+        lcd.resetBusStats();
+        positionBar.invalidate();
         lcd.setCursor(0, 0);
         lcd.print(F("Status:             "));
         lcd.setCursor(7, 0);
@@ -115,6 +361,7 @@ void loop(void)
 
         lcd.setCursor(0, 2);
         lcd.print(F("Soll:               "));
+        _lastFeedOverride = 0;
         lcd.setCursor(5, 2);
         lcd.print(lift.getTargetPosition());
         lcd.print(F("mm"));
@@ -127,19 +374,45 @@ void loop(void)
         lcd.print(lift.getWorkoffset());
         lcd.print(F("mm"));
         _lastDisplayUpdate = millis();
+#if LCD_FRAME_STATS
+        printLcdFrameStats();
+#endif
+      } else if (!lift.inPosition() && !lift.isError() && (millis() - _lastBarUpdate > BAR_REFRESH_INTERVAL_MS)) {
+        // Current position filled, target as marker, over the whole travel; only changed cells are sent
+        float offset = lift.getWorkoffset();
+        positionBar.update(lift.getCurrentPosition(), lift.getTargetPosition(),
+                           LiftConfig::minPosition - offset, LiftConfig::maxPosition - offset);
+        if (lift.hasFeedOverride() && lift.getFeedOverride() != _lastFeedOverride) {
+          // Behind the target, e.g. "F 80%"
+          _lastFeedOverride = lift.getFeedOverride();
+          lcd.setCursor(15, 2);
+          lcd.print('F');
+          if (_lastFeedOverride < 100) lcd.print(' ');
+          if (_lastFeedOverride < 10) lcd.print(' ');
+          lcd.print(_lastFeedOverride);
+          lcd.print('%');
+        }
+        _lastBarUpdate = millis();
       }
 
-      if (lift.isHomed()) {
+      if (lift.getState() == MOVE_TO_TARGET) {
+        // While moving to the target the encoder overrides the feed instead, other
+        // moves have no speed to scale
+        int encoderMove = readEncoder(false);
+        if (encoderMove != 0 && lift.hasFeedOverride()) {
+          lift.setFeedOverride(constrain(lift.getFeedOverride() + encoderMove * FEED_OVERRIDE_STEP, FEED_OVERRIDE_MIN, FEED_OVERRIDE_MAX));
+        }
+      } else if (lift.isHomed()) {
         lift.setTargetPosition(lift.getTargetPosition() + (readEncoder(true) * 0.01));
       }
 
-      if (buttonOk.rose() && buttonOk.previousDuration() < 1000) {
+      if (gesture.type == GESTURE_CLICK) {
         if(lift.getWorkoffset() > 0.0 && lift.getTargetPosition() > 0.0) {
           lift.plungeToTarget();
         }
         else
           lift.moveToTarget();
-      } else if (buttonOk.read() == LOW && buttonOk.currentDuration() > 1000) {
+      } else if (gesture.type == GESTURE_LONG_PRESS) {
         currentState = MENU_SCREEN;
         currentMenuIndex = 0;
         menuScrollOffset = 0; // Reset scroll offset
@@ -152,11 +425,11 @@ void loop(void)
       int encoderMove = readEncoder(false);
       if (encoderMove != 0) {
         int newIndex = currentMenuIndex + encoderMove;
-        if (newIndex >= 0 && newIndex < 7) {
+        if (newIndex >= 0 && newIndex < MENU_ITEMS) {
           currentMenuIndex = newIndex;
           if (currentMenuIndex >= 3) {
             // Handle scrolling when reaching the fourth menu option
-            if (encoderMove > 0 && menuScrollOffset < 3) {
+            if (encoderMove > 0 && menuScrollOffset < MENU_ITEMS - 4) {
               menuScrollOffset += encoderMove;
             } else if (encoderMove < 0 && menuScrollOffset > 0) {
               menuScrollOffset += encoderMove;
@@ -166,7 +439,7 @@ void loop(void)
         displayMenu();
       }
 
-      if (buttonOk.fell()) {
+      if (gesture.type == GESTURE_CLICK) {
         if (currentMenuIndex == 0) {
           currentState = PROBING;
         } else if (currentMenuIndex == 1) {
@@ -180,7 +453,36 @@ void loop(void)
         } else if (currentMenuIndex == 5) {
           currentState = MOTOR_TOGGLE;
           motorEnabled = !motorEnabled; // Toggle motor enable flag
-          digitalWrite(ENABLE_PIN, motorEnabled ? HIGH : LOW); // Enable or disable motor
+          lift.setDriverEnabled(!motorEnabled); // Enable or disable motor, a set flag switches the driver off
+        } else if (currentMenuIndex == 6) {
+          currentState = PROBE_STATS_SCREEN;
+          displayProbeStats();
+        } else if (currentMenuIndex == 7) {
+          currentState = EVENT_LOG_SCREEN;
+          eventLogOffset = 0;
+          displayEventLog();
+        } else if (currentMenuIndex == 9) {
+          currentState = JOB_SCREEN;
+          jobIndex = 0;
+          jobOffset = 0;
+          jobEditing = false;
+          displayJob();
+        } else if (currentMenuIndex == 10) {
+          probeTuner.start(PROBE_TUNE_TOLERANCE, PROBE_TUNE_FAST_TOLERANCE);
+          if (probeTuner.isRunning()) {
+            currentState = TUNE_SCREEN;
+            displayProbeTune();
+          } else {
+            currentState = MAIN_SCREEN;
+          }
+        } else if (currentMenuIndex == 8) {
+          lift.startCalibration();
+          if (lift.isCalibrating()) {
+            currentState = CALIBRATION_SCREEN;
+            displayCalibration();
+          } else {
+            currentState = MAIN_SCREEN;
+          }
         } else {
           currentState = MAIN_SCREEN;
         }
@@ -217,17 +519,251 @@ void loop(void)
       currentState = MAIN_SCREEN; // Return to main screen after toggling motor
       break;
 
+    case PROBE_STATS_SCREEN:
+      if (gesture.type == GESTURE_CLICK) {
+        currentState = MAIN_SCREEN;
+      }
+      break;
+
+    case EVENT_LOG_SCREEN:
+    {
+      int encoderMove = readEncoder(false);
+      if (encoderMove != 0) {
+        int newOffset = eventLogOffset + encoderMove;
+        if (newOffset >= 0 && newOffset < eventLog.count()) {
+          eventLogOffset = newOffset;
+          displayEventLog();
+        }
+      }
+      if (gesture.type == GESTURE_CLICK) {
+        currentState = MAIN_SCREEN;
+      }
+      break;
+    }
+
+    case CALIBRATION_SCREEN:
+    {
+      // Jog until the gauge reads the nominal position, short press takes it, hold cancels
+      int encoderMove = readEncoder(false);
+      if (encoderMove != 0) {
+        lift.jog(encoderMove * CALIBRATION_JOG_MM);
+      }
+      if (gesture.type == GESTURE_CLICK) {
+        if (!lift.acceptCalibrationStep()) {
+          saveCalibration();
+          currentState = MAIN_SCREEN;
+        } else {
+          displayCalibration();
+        }
+      } else if (gesture.type == GESTURE_LONG_PRESS) {
+        lift.cancelCalibration();
+        currentState = MAIN_SCREEN;
+      }
+      break;
+    }
+
+    case JOB_SCREEN:
+    {
+      // Lines: run, the steps, add pass, clear, save
+      int lines = job.length() + 4;
+      int encoderMove = readEncoder(false);
+      if (encoderMove != 0) {
+        if (jobEditing) {
+          JobStep step = job.get(jobIndex - 1);
+          step.value += encoderMove * (step.type == JOB_MOVE ? 10 : 1);
+          job.set(jobIndex - 1, step);
+        } else {
+          jobIndex = constrain(jobIndex + encoderMove, 0, lines - 1);
+        }
+        displayJob();
+      }
+      if (gesture.type == GESTURE_CLICK) {
+        selectJobLine();
+      } else if (gesture.type == GESTURE_LONG_PRESS) {
+        // Leave without saving
+        job.load(JOB_EEPROM_ADDRESS);
+        currentState = MAIN_SCREEN;
+      }
+      break;
+    }
+
+    case JOB_RUN_SCREEN:
+      if (!job.isRunning()) {
+        currentState = MAIN_SCREEN;
+        break;
+      }
+      if (job.currentStep() != _lastJobStep || job.isWaiting() != _lastJobWaiting) {
+        displayJobRun();
+      }
+      // Short press starts the next pass, hold stops the job
+      if (gesture.type == GESTURE_CLICK) {
+        job.confirm();
+      } else if (gesture.type == GESTURE_LONG_PRESS) {
+        job.stop();
+        currentState = MAIN_SCREEN;
+      }
+      break;
+
+    case TUNE_SCREEN:
+      if (!probeTuner.isRunning()) {
+        // Store and show the result once, it stays on the screen until the button is pressed
+        if (_lastTuneRun != TUNE_RUN_RESULT) {
+          if (probeTuner.getPhase() == PROBETUNE_DONE) saveProbeSpeeds();
+          displayProbeTune();
+          _lastTuneRun = TUNE_RUN_RESULT;
+        }
+        if (gesture.type == GESTURE_CLICK) currentState = MAIN_SCREEN;
+        break;
+      }
+      if (probeTuner.getRun() != _lastTuneRun) displayProbeTune();
+      // Hold cancels and restores the previous speeds
+      if (gesture.type == GESTURE_LONG_PRESS) {
+        probeTuner.stop();
+        // The aborted run is no probing result to report
+        _lastProbingState = lift.getProbingState();
+        currentState = MAIN_SCREEN;
+      }
+      break;
+
+    default:
+      break;
+  }
+  // A press that changed the screen must not reach the new one
+  if (currentState != loopState) flushGestures();
+
+  eventLog.update();
+
+  if (trace.isRecording() || trace.isReplaying()) {
+    trace.sample(readEncoderCount(), digitalRead(BUTTON_PIN), lift.getSensors(), (currentState << 8) | lift.getState());
+  } else {
+    mirror.update(); // The serial port belongs to the trace while it runs
+  }
+}
+
+void handleSerial() {
+  // While replaying the serial input belongs to the trace
+  if (trace.isReplaying() || !Serial.available()) return;
+
+  if (job.isReceiving()) {
+    while (Serial.available() && job.isReceiving()) {
+      job.receive(Serial.read());
+    }
+    return;
+  }
+
+  switch (Serial.read()) {
+    case 'r': // Record inputs
+      trace.startRecording(readEncoderCount(), digitalRead(BUTTON_PIN), lift.getSensors(), (currentState << 8) | currentMenuIndex);
+      break;
+    case 'p': // Replay inputs
+      trace.startReplay();
+      break;
+    case 's': // Stop recording
+      trace.stop();
+      break;
+    case 'e': // Dump the event log
+      eventLog.dump(Serial);
+      break;
+    case 'j': // Upload a job program
+      job.startReceive();
+      break;
+    case 'l': // List the job program
+      job.print(Serial);
+      break;
+    case 'c': // Capture step timing until an error, probe touch or limit
+      StepTrace::start(STEPTRACE_TRIGGER_ALL, STEPTRACE_DECIMATION);
+      break;
+    case 'd': // Dump the step timing capture
+      StepTrace::dump(Serial);
+      break;
+    case 'm': // Mirror the display on or off
+      if (mirror.isRunning()) mirror.stop();
+      else mirror.start();
+      break;
+    default:
+      break;
+  }
+}
+
+// Save a finished job upload or report why it was rejected
+void finishJobUpload() {
+  // Only a complete upload replaces the stored program
+  uint8_t result = job.getUploadResult();
+  if (result == JOB_UPLOAD_OK) {
+    job.save(JOB_EEPROM_ADDRESS);
+    Serial.println(F("Job saved"));
+    return;
+  }
+  job.clear();
+  job.load(JOB_EEPROM_ADDRESS);
+  if (result == JOB_UPLOAD_REJECTED) {
+    Serial.print(F("Job rejected at line "));
+    Serial.println(job.getRejectedLine());
+  } else if (result == JOB_UPLOAD_TIMEOUT) {
+    Serial.println(F("Job upload timed out"));
+  } else {
+    Serial.println(F("Job upload aborted"));
+  }
+}
+
+// Show the screen a replayed trace was recorded on, lists other than the menu at
+// their first line. Screens of a calibration, job run or probe tuning need the run
+// behind them and fall back to the main screen.
+void restoreScreen(uint16_t screen) {
+  currentState = (State)(screen >> 8);
+  currentMenuIndex = constrain((int)(screen & 0xFF), 0, MENU_ITEMS - 1);
+  menuScrollOffset = constrain(currentMenuIndex - 3, 0, MENU_ITEMS - 4);
+  flushGestures();
+  lcd.clear();
+  _lastDisplayUpdate = 0;
+  switch (currentState) {
+    case MENU_SCREEN:
+      displayMenu();
+      break;
+    case PROBE_STATS_SCREEN:
+      displayProbeStats();
+      break;
+    case EVENT_LOG_SCREEN:
+      eventLogOffset = 0;
+      displayEventLog();
+      break;
+    case JOB_SCREEN:
+      jobIndex = 0;
+      jobOffset = 0;
+      jobEditing = false;
+      displayJob();
+      break;
+    case CALIBRATION_SCREEN:
+    case JOB_RUN_SCREEN:
+    case TUNE_SCREEN:
+      currentState = MAIN_SCREEN;
+      break;
     default:
       break;
   }
 }
 
+long readEncoderCount() {
+  return trace.isReplaying() ? trace.encoder() : encoder.read();
+}
+
+void readEncoderDetents() {
+  _lastEncoderRead = millis();
+  _encoderDetents = readEncoderCount() / ENC_STEPS;
+}
+
+void flushGestures() {
+  gestures.flush();
+  // The gestures rebase the encoder on the next update, which must see the current count
+  readEncoderDetents();
+}
+
 void displayMenu() {
   lcd.clear();
   for (int i = 0; i < 4; i++) {
     int menuIndex = i + menuScrollOffset;
     lcd.setCursor(0, i);
-    if (menuIndex >= 0 && menuIndex < 7) {
+    if (menuIndex >= 0 && menuIndex < MENU_ITEMS) {
       if (menuIndex == currentMenuIndex) {
         lcd.print(F("> "));
       } else {
@@ -238,39 +774,301 @@ void displayMenu() {
   }
 }
 
-int readEncoder(bool accelerated)
-{
-  if (millis() - _lastEncoderRead > ENCODER_READ_INTERVAL_MS)
-  {
-    int16_t currentEncoderPosition = encoder.read() / ENC_STEPS;
-    if (currentEncoderPosition != _lastEncoderPosition)
-    {
-      int encoderMove = currentEncoderPosition - _lastEncoderPosition;
-      _lastEncoderPosition = currentEncoderPosition;
+void displayProbeStats() {
+  ProbeStats stats = lift.getProbeStats();
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  lcd.print(F("Probe n="));
+  lcd.print(stats.touches);
+  lcd.print(F(" rej="));
+  lcd.print(stats.rejected);
+  lcd.setCursor(0, 1);
+  lcd.print(F("Mean:   "));
+  lcd.print(stats.mean, 3);
+  lcd.print(F("mm"));
+  lcd.setCursor(0, 2);
+  lcd.print(F("Spread: "));
+  lcd.print(stats.spread, 3);
+  lcd.print(F("mm"));
+  lcd.setCursor(0, 3);
+  lcd_print_P(probingStateText[lift.getProbingState()]);
+}
 
-      int encoderAccelerated = 0;
-      if (abs(encoderMove) >= 6)
-      {
-        encoderAccelerated = encoderMove * 500;
-      }
-      else if (abs(encoderMove) >= 4)
-      {
-        encoderAccelerated = encoderMove * 50;
-      }
-      else if (abs(encoderMove) >= 2)
-      {
-        encoderAccelerated = encoderMove * 10;
+void displayEventLog() {
+  EventRecord record;
+  lcd.clear();
+  for (int i = 0; i < 4; i++) {
+    int index = eventLogOffset + i;
+    if (!eventLog.get(index, record)) continue;
+    lcd.setCursor(0, i);
+    lcd.print(index);
+    lcd.setCursor(3, i);
+    lcd_print_P(eventText[record.code < EVENT_TEXTS ? record.code : EVENT_NONE]);
+    lcd.setCursor(12, i);
+    lcd.print(record.position);
+  }
+}
+
+void displayCalibration() {
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  lcd.print(F("Calibrate "));
+  lcd.print(lift.getCalibrationStep() + 1);
+  lcd.print('/');
+  lcd.print(CALIBRATION_STEPS);
+  lcd.setCursor(0, 1);
+  lcd.print(F("Gauge: "));
+  lcd.print(lift.getCalibrationNominal(), 3);
+  lcd.print(F("mm"));
+  lcd.setCursor(0, 2);
+  lcd.print(F("Turn: jog"));
+  lcd.setCursor(0, 3);
+  lcd.print(F("Press: ok Hold: end"));
+}
+
+void displayJob() {
+  int lines = job.length() + 4;
+  if (jobIndex < jobOffset) jobOffset = jobIndex;
+  if (jobIndex >= jobOffset + 4) jobOffset = jobIndex - 3;
+
+  lcd.clear();
+  for (int i = 0; i < 4 && jobOffset + i < lines; i++) {
+    int line = jobOffset + i;
+    lcd.setCursor(0, i);
+    if (line == jobIndex) {
+      lcd.print(jobEditing ? F("* ") : F("> "));
+    } else {
+      lcd.print(F("  "));
+    }
+    if (line == 0) {
+      lcd.print(F("Run job"));
+    } else if (line <= job.length()) {
+      JobStep step = job.get(line - 1);
+      lcd.print(line);
+      if (step.type == JOB_MOVE) {
+        lcd.print(F(" Move "));
+        lcd.print(step.value / 100.0);
+        lcd.print(F("mm"));
+      } else if (step.type == JOB_SPEED) {
+        lcd.print(F(" Speed "));
+        lcd.print(step.value);
+        lcd.print(F("mm/s"));
+      } else {
+        lcd.print(F(" Confirm"));
       }
-      else
-      {
-        encoderAccelerated = encoderMove;
+    } else if (line == job.length() + 1) {
+      lcd.print(F("Add pass"));
+    } else if (line == job.length() + 2) {
+      lcd.print(F("Clear"));
+    } else {
+      lcd.print(F("Save"));
+    }
+  }
+}
+
+void selectJobLine() {
+  int count = job.length();
+  if (jobIndex == 0) {
+    job.start();
+    if (job.isRunning()) {
+      currentState = JOB_RUN_SCREEN;
+      _lastJobStep = 0xFF;
+      return;
+    }
+  } else if (jobIndex <= count) {
+    // Heights and speeds are edited with the encoder, confirms have no value
+    JobStep step = job.get(jobIndex - 1);
+    if (step.type == JOB_MOVE || step.type == JOB_SPEED) jobEditing = !jobEditing;
+  } else if (jobIndex == count + 1) {
+    // Confirm, then one pass deeper than the last one
+    int16_t height = 0;
+    for (int i = count - 1; i >= 0; i--) {
+      if (job.get(i).type == JOB_MOVE) {
+        height = job.get(i).value;
+        break;
       }
-      _lastEncoderRead = millis();
-      return accelerated ? encoderAccelerated : encoderMove;
     }
-    _lastEncoderRead = millis();
+    if (count > 0) job.add(JOB_CONFIRM, 0);
+    job.add(JOB_MOVE, height + JOB_PASS_STEP);
+    jobIndex = job.length();
+  } else if (jobIndex == count + 2) {
+    job.clear();
+    jobIndex = 0;
+  } else {
+    job.save(JOB_EEPROM_ADDRESS);
+    currentState = MAIN_SCREEN;
+    return;
   }
-  return 0;
+  displayJob();
+}
+
+void displayJobRun() {
+  _lastJobStep = job.currentStep();
+  _lastJobWaiting = job.isWaiting();
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  lcd.print(F("Job step "));
+  lcd.print(_lastJobStep + 1);
+  lcd.print('/');
+  lcd.print(job.length());
+  lcd.setCursor(0, 1);
+  lcd.print(F("Soll: "));
+  lcd.print(lift.getTargetPosition());
+  lcd.print(F("mm"));
+  lcd.setCursor(0, 2);
+  if (_lastJobWaiting) lcd.print(F("Press: next pass"));
+  lcd.setCursor(0, 3);
+  lcd.print(F("Hold: stop"));
+}
+
+void displayProbeTune() {
+  _lastTuneRun = probeTuner.getRun();
+  ProbeTunePhase phase = probeTuner.getPhase();
+  lcd.clear();
+  lcd.setCursor(0, 0);
+  if (phase == PROBETUNE_DONE) {
+    lcd.print(F("Probe tuned"));
+  } else if (phase == PROBETUNE_FAILED) {
+    lcd.print(F("Tuning failed"));
+  } else {
+    lcd.print(phase == PROBETUNE_SLOW ? F("Tune slow ") : F("Tune fast "));
+    lcd.print(probeTuner.getSpeed());
+    lcd.print(F("mm/s"));
+  }
+  lcd.setCursor(0, 1);
+  if (probeTuner.isRunning()) {
+    lcd.print(F("Run "));
+    lcd.print(_lastTuneRun + 1);
+    lcd.print('/');
+    lcd.print(PROBETUNE_RUNS);
+    lcd.setCursor(0, 2);
+    lcd.print(F("Spread: "));
+    lcd.print(probeTuner.getSpread(), 3);
+    lcd.print(F("mm"));
+    lcd.setCursor(0, 3);
+    lcd.print(F("Hold: cancel"));
+  } else {
+    lcd.print(F("Fast: "));
+    lcd.print(lift.getProbeFastSpeed());
+    lcd.print(F("mm/s"));
+    lcd.setCursor(0, 2);
+    lcd.print(F("Slow: "));
+    lcd.print(lift.getProbeSlowSpeed());
+    lcd.print(F("mm/s"));
+    lcd.setCursor(0, 3);
+    lcd.print(F("Press: back"));
+  }
+}
+
+void loadCalibration() {
+  if (eeprom_read_byte((const uint8_t*)CALIBRATION_EEPROM_ADDRESS) != CALIBRATION_MAGIC) return;
+  AxisCalibration calibration;
+  eeprom_read_block(&calibration, (const void*)(CALIBRATION_EEPROM_ADDRESS + 1), sizeof(calibration));
+  lift.setCalibration(calibration);
+}
+
+void saveCalibration() {
+  AxisCalibration calibration = lift.getCalibration();
+  eeprom_update_block(&calibration, (void*)(CALIBRATION_EEPROM_ADDRESS + 1), sizeof(calibration));
+  eeprom_update_byte((uint8_t*)CALIBRATION_EEPROM_ADDRESS, CALIBRATION_MAGIC);
+}
+
+void loadProbeSpeeds() {
+  if (eeprom_read_byte((const uint8_t*)PROBE_SPEEDS_EEPROM_ADDRESS) != PROBE_SPEEDS_MAGIC) return;
+  float speeds[2];
+  eeprom_read_block(speeds, (const void*)(PROBE_SPEEDS_EEPROM_ADDRESS + 1), sizeof(speeds));
+  lift.setProbeSpeeds(speeds[0], speeds[1]);
+}
+
+void saveProbeSpeeds() {
+  float speeds[2] = {lift.getProbeFastSpeed(), lift.getProbeSlowSpeed()};
+  eeprom_update_block(speeds, (void*)(PROBE_SPEEDS_EEPROM_ADDRESS + 1), sizeof(speeds));
+  eeprom_update_byte((uint8_t*)PROBE_SPEEDS_EEPROM_ADDRESS, PROBE_SPEEDS_MAGIC);
+}
+
+#if PROBE_SIM
+void simulateProbe() {
+  // Closes at a new random height for every touch, the loop time adds the speed dependent part
+  static float threshold = PROBE_SIM_SURFACE;
+  static bool touching = false;
+  float position = lift.getStepPosition() / (MOTOR_STEPS * MICROSTEPS / SPINDLE_LEAD);
+  if (!touching && position >= threshold) {
+    touching = true;
+  } else if (touching && position < threshold - PROBE_SIM_HYSTERESIS) {
+    touching = false;
+    threshold = PROBE_SIM_SURFACE + random(-1000, 1001) * (PROBE_SIM_NOISE / 1000.0);
+  }
+  lift.overrideSensors(SENSOR_PROBE, touching ? SENSOR_PROBE : 0);
+}
+#endif
+
+void logEvents() {
+  // Log the results of homing runs, emergency stops and step loss, probing is logged with its report
+  HomingState homingState = lift.getHomingState();
+  if (homingState != _lastHomingState && homingState == FINISHED) {
+    eventLog.log(EVENT_HOMED, lift.getStepPosition(), lift.getSensors());
+  } else if (homingState != _lastHomingState && homingState == ERROR) {
+    eventLog.log(EVENT_HOMING_ERROR, lift.getStepPosition(), lift.getSensors());
+    eventLog.flush();
+  }
+  _lastHomingState = homingState;
+
+  bool fault = lift.isFault();
+  if (fault && !_lastFault) {
+    eventLog.log(EVENT_FAULT, lift.getStepPosition(), lift.getSensors());
+    eventLog.flush();
+  }
+  _lastFault = fault;
+
+  bool stepLoss = lift.hasStepLoss();
+  if (stepLoss && !_lastStepLoss) {
+    eventLog.log(EVENT_STEP_LOSS, lift.getStepPosition(), lift.getSensors());
+    eventLog.flush();
+  }
+  _lastStepLoss = stepLoss;
+
+  bool scaleError = lift.getScaleErrors() != 0;
+  if (scaleError && !_lastScaleError) {
+    eventLog.log(EVENT_SCALE_ERROR, lift.getStepPosition(), lift.getSensors());
+    eventLog.flush();
+  }
+  _lastScaleError = scaleError;
+}
+
+void printProbeStats() {
+  ProbeStats stats = lift.getProbeStats();
+  char buffer[10];
+  strcpy_P(buffer, probingStateText[lift.getProbingState()]);
+  Serial.print(F("Probe: "));
+  Serial.print(buffer);
+  Serial.print(F(" n="));
+  Serial.print(stats.touches);
+  Serial.print(F(" rejected="));
+  Serial.print(stats.rejected);
+  Serial.print(F(" mean="));
+  Serial.print(stats.mean, 3);
+  Serial.print(F(" spread="));
+  Serial.println(stats.spread, 3);
+}
+
+void printLcdFrameStats() {
+  Serial.print(F("LCD frame: chars="));
+  Serial.print(lcd.busChars());
+  Serial.print(F(" commands="));
+  Serial.print(lcd.busCommands());
+  Serial.print(F(" us="));
+  Serial.println(lcd.busMicros());
+}
+
+int readEncoder(bool accelerated)
+{
+  // Detents of this loop's rotation, fast turns move further, like 2, 4 or 6 detents per read
+  if (gesture.type != GESTURE_ROTATE) return 0;
+  if (!accelerated) return gesture.count;
+  if (gesture.rate >= 6 * 1000 / ENCODER_READ_INTERVAL_MS) return gesture.count * 500;
+  if (gesture.rate >= 4 * 1000 / ENCODER_READ_INTERVAL_MS) return gesture.count * 50;
+  if (gesture.rate >= 2 * 1000 / ENCODER_READ_INTERVAL_MS) return gesture.count * 10;
+  return gesture.count;
 }
 
 void lcd_print_P(const char* str) {
@@ -0,0 +1,321 @@
+/*
+ * Host replayer for input traces, only built with env:native.
+ *
+ * Runs the firmware of main.cpp on the virtual Nano of lib/NativeHost and replays
+ * a trace recorded with the 'r' command on the device, on the virtual clock, so a
+ * replay takes no wall time and gives the same result on every run:
+ *
+ *   pio run -e native
+ *   .pio/build/native/program trace.bin [--boot <ms>] [--height <mm>]
+ *
+ * The firmware first boots for --boot ms (default 10000) with the carriage at
+ * --height mm above the min endstop (default 10), so it homes like on the bench.
+ * Then it gets the 'p' command and the records, paced like the host has to pace
+ * them: never more in the receive buffer than fits. Records other than inputs
+ * (state, loop) are skipped by the firmware; an end record is added when the
+ * trace has none.
+ *
+ * Report lines on stdout, times in ms from the start record:
+ *
+ *   state <ms> screen <n> axis <n> loop_max_us <us> [recorded <ms>]
+ *   move <ms> <duration ms> axis <end state> [recorded <duration ms>]
+ *   loops <count> loop_mean_us <us> loop_max_us <us>
+ *   diverged <index> replayed <screen>/<axis> recorded <screen>/<axis> at <ms>
+ *   lcd <row text>                      custom characters as '#'
+ *
+ * The first difference to the recorded state sequence is reported once, or
+ * "matches" when there is none. Text the firmware prints is passed through with
+ * a "> " prefix. Pins and geometry follow the default wiring in main.cpp.
+ */
+#ifdef NATIVE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include <NativeHost.h>
+#include <HD44780Model.h>
+#include <InputTrace.h>
+
+extern void setup(void);
+extern void loop(void);
+extern InputTrace trace;
+
+#define STEP_PIN 12
+#define DIR_PIN 11
+#define ENDSTOP_MIN_PIN A2
+#define ENDSTOP_MAX_PIN A3
+#define PROBE_PIN A4
+#define LCD_RS 4
+#define LCD_EN 5
+#define LCD_D4 6
+#define LCD_D5 7
+#define LCD_D6 8
+#define LCD_D7 9
+#define STEPS_PER_MM 200	// MOTOR_STEPS * MICROSTEPS / SPINDLE_LEAD
+
+#define MAX_RECORDS 16384
+#define MAX_STATES 1024
+#define MAX_LINE 120
+#define DEFAULT_BOOT_MS 10000
+#define DEFAULT_HEIGHT_MM 10.0
+#define TIMEOUT_MS 70000	// Replay time after the last fed record before giving up, above the longest record gap
+#define INPOSITION 4		// AxisState of a finished move, see Axis.h
+#define CYCLES_PER_MS (F_CPU / 1000)
+
+typedef struct {
+	unsigned long ms;	// Time from the start record
+	uint16_t state;		// Screen << 8 | axis state
+	uint16_t loopMax;	// Longest loop in us before the state change
+} state_t;
+
+// Carriage on the STEP and DIR pins, closes the min endstop at or below 0
+class Carriage : public HostPinListener {
+public:
+	long steps;
+
+	Carriage(long steps) : steps(steps) {
+		endstop = steps <= 0;
+		hostDrive(ENDSTOP_MIN_PIN, endstop);
+	}
+
+	void pinChanged(uint8_t pin, bool level) {
+		if (pin != STEP_PIN || !level) return;
+		steps += hostPinLevel(DIR_PIN) ? 1 : -1;
+		update();
+	}
+
+private:
+	bool endstop;
+
+	void update() {
+		bool reached = steps <= 0;
+		if (reached == endstop) return;
+		endstop = reached;
+		hostDrive(ENDSTOP_MIN_PIN, reached);
+	}
+};
+
+// Firmware output: state records of the replay, the rest is text
+class Capture : public Print {
+public:
+	state_t states[MAX_STATES];
+	int count = 0;
+	uint64_t zero = 0;	// Cycle of the start record
+
+	size_t write(uint8_t value) {
+		if (length > 0 || value == TRACE_SYNC) {
+			record[length++] = value;
+			if (length == TRACE_RECORD_SIZE) {
+				length = 0;
+				decode();
+			}
+			return 1;
+		}
+		if (value == '\n') {
+			text[textLength] = 0;
+			printf("> %s\n", text);
+			textLength = 0;
+		} else if (value != '\r' && textLength < MAX_LINE - 1) {
+			text[textLength++] = value;
+		}
+		return 1;
+	}
+
+private:
+	uint8_t record[TRACE_RECORD_SIZE];
+	int length = 0;
+	char text[MAX_LINE];
+	int textLength = 0;
+
+	void decode() {
+		uint16_t value = record[4] | (record[5] << 8);
+		if (record[1] == TRACE_STATE && count < MAX_STATES) {
+			states[count].ms = (hostCycles() - zero) / CYCLES_PER_MS;
+			states[count].state = value;
+			states[count].loopMax = 0;
+			count++;
+		} else if (record[1] == TRACE_LOOP && count > 0) {
+			states[count - 1].loopMax = value;
+		}
+	}
+};
+
+static uint8_t records[MAX_RECORDS][TRACE_RECORD_SIZE];
+static int recordCount;
+static state_t recorded[MAX_STATES];
+static int recordedCount;
+
+// Records of the trace file from the start record on, text between them is skipped
+static bool load(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		perror(path);
+		return false;
+	}
+	uint8_t record[TRACE_RECORD_SIZE];
+	int length = 0;
+	unsigned long ms = 0;
+	bool started = false;
+	int value;
+	while ((value = fgetc(file)) != EOF && recordCount < MAX_RECORDS - 1) {
+		if (length == 0 && value != TRACE_SYNC) continue;
+		record[length++] = value;
+		if (length < TRACE_RECORD_SIZE) continue;
+		length = 0;
+		if (record[1] == TRACE_START) started = true;
+		if (!started) continue;
+		ms += record[2] | (record[3] << 8);
+		if (record[1] == TRACE_STATE && recordedCount < MAX_STATES) {
+			recorded[recordedCount].ms = ms;
+			recorded[recordedCount].state = record[4] | (record[5] << 8);
+			recordedCount++;
+		} else if (record[1] == TRACE_LOOP && recordedCount > 0) {
+			recorded[recordedCount - 1].loopMax = record[4] | (record[5] << 8);
+		}
+		memcpy(records[recordCount++], record, TRACE_RECORD_SIZE);
+		if (record[1] == TRACE_END) break;
+	}
+	fclose(file);
+	if (recordCount == 0) {
+		fprintf(stderr, "%s: no start record\n", path);
+		return false;
+	}
+	if (records[recordCount - 1][1] != TRACE_END) {
+		static const uint8_t end[TRACE_RECORD_SIZE] = {TRACE_SYNC, TRACE_END, 0, 0, 0, 0};
+		memcpy(records[recordCount++], end, TRACE_RECORD_SIZE);
+	}
+	return true;
+}
+
+static bool moving(uint16_t state) {
+	uint8_t axis = state & 0xFF;
+	return axis > 0 && axis < INPOSITION;
+}
+
+// Duration of the move starting at a state, -1 when it does not end in the trace
+static long moveTime(const state_t *states, int count, int start, uint8_t &end) {
+	for (int i = start + 1; i < count; i++) {
+		if (!moving(states[i].state)) {
+			end = states[i].state & 0xFF;
+			return states[i].ms - states[start].ms;
+		}
+	}
+	return -1;
+}
+
+static void report(const Capture &capture, uint64_t loops, uint64_t loopCycles, uint64_t loopMax) {
+	for (int i = 0; i < capture.count; i++) {
+		const state_t &state = capture.states[i];
+		printf("state %lu screen %u axis %u loop_max_us %u", state.ms, state.state >> 8,
+		       state.state & 0xFF, state.loopMax);
+		if (i < recordedCount) printf(" recorded %lu", recorded[i].ms);
+		printf("\n");
+	}
+
+	// Moves in order, the n-th replayed one against the n-th recorded one
+	int recordedMove = 0;
+	for (int i = 0; i < capture.count; i++) {
+		if (!moving(capture.states[i].state) || (i > 0 && moving(capture.states[i - 1].state))) continue;
+		uint8_t end = 0;
+		long duration = moveTime(capture.states, capture.count, i, end);
+		if (duration < 0) continue;
+		printf("move %lu %ld axis %u", capture.states[i].ms, duration, end);
+		for (; recordedMove < recordedCount; recordedMove++) {
+			if (moving(recorded[recordedMove].state) && (recordedMove == 0 || !moving(recorded[recordedMove - 1].state))) break;
+		}
+		if (recordedMove < recordedCount) {
+			uint8_t recordedEnd = 0;
+			long recordedDuration = moveTime(recorded, recordedCount, recordedMove, recordedEnd);
+			if (recordedDuration >= 0) printf(" recorded %ld", recordedDuration);
+			recordedMove++;
+		}
+		printf("\n");
+	}
+
+	if (loops > 0) {
+		printf("loops %llu loop_mean_us %.1f loop_max_us %.1f\n", (unsigned long long)loops,
+		       loopCycles / (double)loops / (F_CPU / 1000000.0), loopMax / (F_CPU / 1000000.0));
+	}
+
+	int count = capture.count < recordedCount ? capture.count : recordedCount;
+	for (int i = 0; i < count; i++) {
+		if (capture.states[i].state != recorded[i].state) {
+			printf("diverged %d replayed %u/%u recorded %u/%u at %lu\n", i,
+			       capture.states[i].state >> 8, capture.states[i].state & 0xFF,
+			       recorded[i].state >> 8, recorded[i].state & 0xFF, capture.states[i].ms);
+			return;
+		}
+	}
+	if (capture.count != recordedCount) {
+		printf("diverged %d replayed %d states recorded %d\n", count, capture.count, recordedCount);
+		return;
+	}
+	printf("matches\n");
+}
+
+int main(int argc, char **argv) {
+	const char *path = NULL;
+	unsigned long bootMs = DEFAULT_BOOT_MS;
+	double height = DEFAULT_HEIGHT_MM;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--boot") && i + 1 < argc) bootMs = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--height") && i + 1 < argc) height = strtod(argv[++i], NULL);
+		else if (argv[i][0] != '-' && !path) path = argv[i];
+		else path = NULL, i = argc;
+	}
+	if (!path) {
+		fprintf(stderr, "usage: %s trace.bin [--boot <ms>] [--height <mm>]\n", argv[0]);
+		return 2;
+	}
+	if (!load(path)) return 1;
+
+	// Power-on state after the constructors of main.cpp: erased EEPROM, open probe
+	memset(hostEeprom(), 0xFF, HOST_EEPROM_SIZE);
+	hostDrive(ENDSTOP_MAX_PIN, false);
+	hostDrive(PROBE_PIN, true);
+	Carriage carriage((long)(height * STEPS_PER_MM));
+	HD44780Model display(20, 4, LCD_RS, 255, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+	Capture capture;
+	hostSerialOutput(&capture);
+
+	setup();
+	while (hostCycles() < (uint64_t)bootMs * CYCLES_PER_MS) loop();
+	hostSerialInput("p");
+	capture.zero = hostCycles();
+
+	// Records go in as the receive buffer has room, until the firmware ends the replay
+	uint64_t loops = 0, loopCycles = 0, loopMax = 0, fed = hostCycles();
+	int next = 0;
+	do {
+		while (next < recordCount && Serial.available() <= SERIAL_RX_BUFFER_SIZE - TRACE_RECORD_SIZE) {
+			for (int i = 0; i < TRACE_RECORD_SIZE; i++) Serial.receive(records[next][i]);
+			next++;
+			fed = hostCycles();
+		}
+		uint64_t start = hostCycles();
+		loop();
+		uint64_t cycles = hostCycles() - start;
+		loops++;
+		loopCycles += cycles;
+		if (cycles > loopMax) loopMax = cycles;
+		if (hostCycles() - fed > (uint64_t)TIMEOUT_MS * CYCLES_PER_MS) {
+			fprintf(stderr, "replay did not end %d ms after the last record\n", TIMEOUT_MS);
+			break;
+		}
+	} while (trace.isReplaying() || next == 0);
+
+	report(capture, loops, loopCycles, loopMax);
+	char line[21];
+	for (uint8_t row = 0; row < 4; row++) {
+		display.getLine(row, line);
+		for (char *c = line; *c; c++) {
+			if (*c < ' ') *c = '#';
+		}
+		printf("lcd %s\n", line);
+	}
+	hostSerialOutput(NULL);
+	return trace.isReplaying() ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Firmware side of the simavr test setup, only built with env:simavr.
+ *
+ * The MCU section tells simavr the CPU clock and makes it write trace.vcd with
+ * the STEP/DIR and LCD pins, the sensor inputs, a loop marker and the axis
+ * states, all with cycle timestamps. Step rate, step jitter, loop blocking,
+ * homing time, the emergency stop latency (ENDSTOP_* edge to ENABLE high and
+ * the last STEP pulse) and the power fail snapshot time (POWER_LOW edge to the
+ * end of the last EEPROM_BUSY pulse) can be read from that trace with
+ * tools/simavr/vcd_report.py. tools/simavr/scenario.c runs the image and drives
+ * the inputs. Pin masks follow the default wiring in main.cpp.
+ */
+#ifdef SIMAVR
+
+#include <avr/io.h>
+#include <avr/avr_mcu_section.h>    // simavr headers, see env:simavr
+
+AVR_MCU(F_CPU, "atmega328p");
+AVR_MCU_VCD_FILE("trace.vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t simTrace[] _MMCU_ = {
+	// Stepper driver
+	{ AVR_MCU_VCD_SYMBOL("STEP"), .mask = (1 << PB4), .what = (void*)&PORTB, },    // D12
+	{ AVR_MCU_VCD_SYMBOL("DIR"), .mask = (1 << PB3), .what = (void*)&PORTB, },     // D11
+	{ AVR_MCU_VCD_SYMBOL("ENABLE"), .mask = (1 << PB2), .what = (void*)&PORTB, },  // D10
+	// LCD bus
+	{ AVR_MCU_VCD_SYMBOL("LCD_RS"), .mask = (1 << PD4), .what = (void*)&PORTD, },  // D4
+	{ AVR_MCU_VCD_SYMBOL("LCD_EN"), .mask = (1 << PD5), .what = (void*)&PORTD, },  // D5
+	{ AVR_MCU_VCD_SYMBOL("LCD_D4"), .mask = (1 << PD6), .what = (void*)&PORTD, },  // D6
+	{ AVR_MCU_VCD_SYMBOL("LCD_D5"), .mask = (1 << PD7), .what = (void*)&PORTD, },  // D7
+	{ AVR_MCU_VCD_SYMBOL("LCD_D6"), .mask = (1 << PB0), .what = (void*)&PORTB, },  // D8
+	{ AVR_MCU_VCD_SYMBOL("LCD_D7"), .mask = (1 << PB1), .what = (void*)&PORTB, },  // D9
+	// Inputs driven by the scenario
+	{ AVR_MCU_VCD_SYMBOL("BUTTON"), .mask = (1 << PC0), .what = (void*)&PINC, },   // A0
+	{ AVR_MCU_VCD_SYMBOL("ENDSTOP_MIN"), .mask = (1 << PC2), .what = (void*)&PINC, }, // A2
+	{ AVR_MCU_VCD_SYMBOL("ENDSTOP_MAX"), .mask = (1 << PC3), .what = (void*)&PINC, }, // A3
+	{ AVR_MCU_VCD_SYMBOL("PROBE"), .mask = (1 << PC4), .what = (void*)&PINC, },    // A4
+	// Power fail comparator output and EEPROM writes, see PowerFail.h
+	{ AVR_MCU_VCD_SYMBOL("POWER_LOW"), .mask = (1 << ACO), .what = (void*)&ACSR, },
+	{ AVR_MCU_VCD_SYMBOL("EEPROM_BUSY"), .mask = (1 << EEPE), .what = (void*)&EECR, },
+	// Written by loop() in main.cpp
+	{ AVR_MCU_VCD_SYMBOL("LOOP"), .what = (void*)&GPIOR1, },
+	{ AVR_MCU_VCD_SYMBOL("AXIS_STATE"), .what = (void*)&GPIOR2, },
+};
+
+#endif
@@ -0,0 +1,210 @@
+// Emergency stop of the Axis on the virtual Nano: latency from the endstop edge to
+// the driver enable and to the end of the last step pulse, also for an edge at the
+// start of a multi-step event, which the pin change interrupt has to wait for, and
+// the same latch for endstops overridden by a simulation or trace replay.
+#include <unity.h>
+#include <stdio.h>
+#include <NativeHost.h>
+#include <Axis.h>
+
+#define STEP_PIN 12
+#define DIR_PIN 11
+#define ENABLE_PIN 10
+#define ENDSTOP_MIN_PIN A2
+#define ENDSTOP_MAX_PIN A3
+#define PROBE_PIN A4
+#define STEPS_PER_MM 200
+#define LOOP_CYCLES 800             // 50 us per main loop pass
+#define CYCLES_PER_US 16
+#define EVENT_GAP_US 10             // Pause before a STEP pulse that starts a step event
+#define QUAD_RATE 2000              // Step rate in steps/s from which every event has 4 pulses
+#define TRACE_HOME_STEPS (5 * STEPS_PER_MM) // Min endstop of a replayed trace
+
+// Carriage on the STEP and DIR pins with the min endstop at 0 and the max endstop
+// at a height, keeps the times of the edges
+class Carriage : public HostPinListener {
+public:
+    long steps = 0;
+    long maxSteps = 0x7FFFFFFF;
+    bool atEventStart = false;      // Close the max endstop only on the first pulse of a step event
+    uint64_t edgeTime = 0;          // Max endstop closed
+    uint64_t lastPulseEnd = 0;      // Falling STEP edge
+    uint64_t enableTime = 0;        // ENABLE went high, driver off
+    long stepsAfterEdge = 0;
+    long stepsAfterFault = 0;
+
+    void pinChanged(uint8_t pin, bool level) {
+        if (pin == ENABLE_PIN && level) enableTime = hostCycles();
+        if (pin != STEP_PIN) return;
+        if (!level) {
+            lastPulseEnd = hostCycles();
+            return;
+        }
+        if (enableTime) stepsAfterFault++;
+        if (edgeTime) stepsAfterEdge++;
+        steps += hostPinLevel(DIR_PIN) ? 1 : -1;
+        update(hostCycles() - lastPulseEnd > EVENT_GAP_US * CYCLES_PER_US);
+    }
+
+    void update(bool eventStart = true) {
+        hostDrive(ENDSTOP_MIN_PIN, steps <= 0);
+        bool closed = hostPinLevel(ENDSTOP_MAX_PIN);
+        bool max = steps >= maxSteps && (closed || eventStart || !atEventStart);
+        if (max && !closed) edgeTime = hostCycles();
+        hostDrive(ENDSTOP_MAX_PIN, max);
+    }
+};
+
+struct TestConfig {
+    static const uint8_t stepPin = STEP_PIN, dirPin = DIR_PIN, enablePin = ENABLE_PIN;
+    static const uint8_t endstopMinPin = ENDSTOP_MIN_PIN, endstopMaxPin = ENDSTOP_MAX_PIN, probePin = PROBE_PIN;
+    static constexpr float stepsPerRev = 200, microsteps = 8, spindleLead = 8.0;
+    static constexpr float minPosition = 0.0, maxPosition = 119.0;
+};
+
+// The axis registers with the step timer and the endstop interrupt for good, so
+// all tests share one on the power-on state of the virtual MCU
+static Carriage carriage;
+static StaticAxis<TestConfig> axis;
+
+static bool runUntil(bool (*done)(), unsigned long ms) {
+    uint64_t end = hostCycles() + (uint64_t)ms * 1000 * CYCLES_PER_US;
+    while (hostCycles() < end) {
+        axis.handle();
+        if (done()) return true;
+        hostAdvance(LOOP_CYCLES);
+    }
+    return false;
+}
+
+static bool homed() {
+    return axis.getHomingState() == FINISHED;
+}
+
+static bool faulted() {
+    return axis.isFault();
+}
+
+static void home() {
+    carriage.maxSteps = 0x7FFFFFFF;
+    carriage.update();
+    axis.overrideSensors(0, 0);
+    axis.homing();
+    TEST_ASSERT_TRUE(runUntil(homed, 20000));
+    carriage.edgeTime = carriage.lastPulseEnd = carriage.enableTime = 0;
+    carriage.stepsAfterEdge = carriage.stepsAfterFault = 0;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_endstop_latency(void) {
+    carriage.steps = 10 * STEPS_PER_MM;
+    home();
+    // An endstop mounted too low, the move runs into it at full speed
+    carriage.maxSteps = 60 * STEPS_PER_MM;
+    axis.moveToMax();
+    TEST_ASSERT_TRUE(runUntil(faulted, 10000));
+    hostAdvance(10000 * CYCLES_PER_US);
+
+    TEST_ASSERT_NOT_EQUAL(0, carriage.edgeTime);
+    TEST_ASSERT_NOT_EQUAL(0, carriage.enableTime);
+    uint32_t enableLatency = (carriage.enableTime - carriage.edgeTime) / CYCLES_PER_US;
+    uint32_t pulseLatency = carriage.lastPulseEnd > carriage.edgeTime ? (carriage.lastPulseEnd - carriage.edgeTime) / CYCLES_PER_US : 0;
+    char message[80];
+    snprintf(message, sizeof(message), "estop_enable %u us, estop_last_pulse %u us, steps after %ld",
+             (unsigned)enableLatency, (unsigned)pulseLatency, carriage.stepsAfterFault);
+    TEST_MESSAGE(message);
+    // The bound documented at the endstop interrupt in Axis.cpp
+    TEST_ASSERT_LESS_THAN(50, enableLatency);
+    TEST_ASSERT_LESS_THAN(50, pulseLatency);
+    TEST_ASSERT_LESS_OR_EQUAL(4, carriage.stepsAfterFault);
+    TEST_ASSERT_TRUE(hostPinLevel(ENABLE_PIN));
+}
+
+void test_endstop_latency_at_event_start(void) {
+    carriage.steps = 10 * STEPS_PER_MM;
+    // 4 pulses per event at 20 mm/s, the edge comes with the first pulse of one: AVR
+    // interrupts do not nest, the pin change interrupt waits for the step interrupt
+    axis.setMultiStepping(QUAD_RATE / 2, QUAD_RATE);
+    home();
+    carriage.maxSteps = 60 * STEPS_PER_MM;
+    carriage.atEventStart = true;
+    axis.moveToMax();
+    TEST_ASSERT_TRUE(runUntil(faulted, 10000));
+    hostAdvance(10000 * CYCLES_PER_US);
+    carriage.atEventStart = false;
+    axis.setMultiStepping(0, 0);
+
+    uint32_t enableLatency = (carriage.enableTime - carriage.edgeTime) / CYCLES_PER_US;
+    uint32_t pulseLatency = (carriage.lastPulseEnd - carriage.edgeTime) / CYCLES_PER_US;
+    char message[80];
+    snprintf(message, sizeof(message), "estop_enable %u us, estop_last_pulse %u us, steps after edge %ld",
+             (unsigned)enableLatency, (unsigned)pulseLatency, carriage.stepsAfterEdge);
+    TEST_MESSAGE(message);
+    // The other 3 pulses of the event still go out, the driver is disabled after them
+    TEST_ASSERT_EQUAL(3, carriage.stepsAfterEdge);
+    TEST_ASSERT_EQUAL(0, carriage.stepsAfterFault);
+    TEST_ASSERT_GREATER_OR_EQUAL(3 * 2 * FASTSTEPPER_PULSE_WIDTH_US, pulseLatency);
+    TEST_ASSERT_GREATER_THAN(pulseLatency, enableLatency);
+    // The model charges no time for the speed calculation of the step interrupt, the
+    // AVR bound documented in Axis.cpp is one whole step interrupt
+    TEST_ASSERT_LESS_THAN(50, enableLatency);
+    TEST_ASSERT_TRUE(hostPinLevel(ENABLE_PIN));
+}
+
+void test_overridden_endstop_latches(void) {
+    home();
+    axis.moveToMax();
+    carriage.maxSteps = 0x7FFFFFFF;
+    hostAdvance(200000 * CYCLES_PER_US);
+    TEST_ASSERT_FALSE(axis.isFault());
+    long before = carriage.steps;
+
+    // A replayed trace closes the max endstop, the pin stays open
+    axis.overrideSensors(SENSOR_ALL, SENSOR_ENDSTOP_MAX);
+    TEST_ASSERT_TRUE(axis.isFault());
+    TEST_ASSERT_TRUE(hostPinLevel(ENABLE_PIN));
+    hostAdvance(100000 * CYCLES_PER_US);
+    TEST_ASSERT_LESS_OR_EQUAL(4, carriage.steps - before);
+    TEST_ASSERT_FALSE(hostPinLevel(ENDSTOP_MAX_PIN));
+}
+
+void test_overridden_endstop_ends_homing(void) {
+    carriage.steps = 10 * STEPS_PER_MM;
+    // Homing runs down onto an overridden min endstop: a halt, no emergency stop. The
+    // replayed trace closes it 5 mm above the pin, which stays open
+    axis.overrideSensors(SENSOR_ALL, 0);
+    axis.homing();
+    uint64_t end = hostCycles() + 20000000ULL * CYCLES_PER_US;
+    while (!homed() && hostCycles() < end) {
+        axis.overrideSensors(SENSOR_ALL, carriage.steps <= TRACE_HOME_STEPS ? SENSOR_ENDSTOP_MIN : 0);
+        axis.handle();
+        TEST_ASSERT_FALSE(axis.isFault());
+        hostAdvance(LOOP_CYCLES);
+    }
+    TEST_ASSERT_EQUAL(FINISHED, axis.getHomingState());
+    TEST_ASSERT_FALSE(hostPinLevel(ENDSTOP_MIN_PIN));
+    // The carriage stopped on the first step onto the overridden endstop
+    long stopped = carriage.steps;
+    TEST_ASSERT_EQUAL(TRACE_HOME_STEPS, stopped);
+    hostAdvance(100000 * CYCLES_PER_US);
+    axis.handle();
+    TEST_ASSERT_EQUAL(stopped, carriage.steps);
+    TEST_ASSERT_TRUE(axis.inPosition());
+    TEST_ASSERT_FALSE(axis.isFault());
+    axis.overrideSensors(0, 0);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    axis.begin();
+    RUN_TEST(test_endstop_latency);
+    RUN_TEST(test_endstop_latency_at_event_start);
+    RUN_TEST(test_overridden_endstop_latches);
+    RUN_TEST(test_overridden_endstop_ends_homing);
+    return UNITY_END();
+}
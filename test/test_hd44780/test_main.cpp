@@ -0,0 +1,243 @@
+// LiquidCrystalFast against the HD44780 model of NativeHost: what the display shows,
+// the bus protocol with and without RW and the bus statistics per frame.
+#include <unity.h>
+#include <NativeHost.h>
+#include <HD44780Model.h>
+#include <LiquidCrystalFast.h>
+
+#define LCD_RS 4
+#define LCD_RW 13
+#define LCD_EN 5
+#define LCD_EN2 12
+#define LCD_D4 6
+#define LCD_D5 7
+#define LCD_D6 8
+#define LCD_D7 9
+
+// Access to the raw bus, to send faster than the display allows
+class RawLcd : public LiquidCrystalFast {
+public:
+    RawLcd() : LiquidCrystalFast(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7) {}
+    void sendRaw(uint8_t value, uint8_t mode) { writeByte(value, mode, _enable_pin); }
+};
+
+static char line[41];
+
+static const char* lineOf(HD44780Model& model, uint8_t row) {
+    model.getLine(row, line);
+    return line;
+}
+
+void setUp(void) {
+    hostReset();
+}
+
+void tearDown(void) {
+}
+
+void test_text_on_four_rows(void) {
+    HD44780Model model(20, 4, LCD_RS, 255, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(20, 4);
+    lcd.setCursor(0, 0);
+    lcd.print("Hello");
+    lcd.setCursor(15, 3);
+    lcd.print("World");
+    // Rows 2 and 3 continue rows 0 and 1 in DDRAM, the library moves on to the next row
+    lcd.setCursor(18, 1);
+    lcd.print("ABCD");
+
+    TEST_ASSERT_EQUAL_STRING("Hello               ", lineOf(model, 0));
+    TEST_ASSERT_EQUAL_STRING("                  AB", lineOf(model, 1));
+    TEST_ASSERT_EQUAL_STRING("CD                  ", lineOf(model, 2));
+    TEST_ASSERT_EQUAL_STRING("               World", lineOf(model, 3));
+    TEST_ASSERT_EQUAL(LCD_DISPLAYON, model.getControl());
+    TEST_ASSERT_EQUAL(0, model.getStats().violations);
+}
+
+void test_custom_character(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(20, 4);
+    uint8_t arrow[8] = {0x04, 0x0E, 0x15, 0x04, 0x04, 0x04, 0x04, 0x00};
+    lcd.createChar(2, arrow);
+    lcd.setCursor(3, 1);
+    lcd.write(2);
+
+    TEST_ASSERT_EQUAL(2, model.getChar(3, 1));
+    for (uint8_t row = 0; row < 8; row++) {
+        TEST_ASSERT_EQUAL_HEX8(arrow[row], model.getGlyphRow(2, row));
+    }
+}
+
+void test_scroll_keeps_cursor_on_screen(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(20, 4);
+    lcd.print("Hello");
+    lcd.scrollDisplayLeft();
+    lcd.setCursor(0, 1);
+    lcd.print("X");
+
+    TEST_ASSERT_EQUAL_STRING("ello                ", lineOf(model, 0));
+    TEST_ASSERT_EQUAL_STRING("X                   ", lineOf(model, 1));
+}
+
+void test_two_controllers(void) {
+    HD44780Model model(40, 4, LCD_RS, LCD_RW, LCD_EN, LCD_EN2, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_EN2, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(40, 4);
+    // begin() clears both controllers before the second one is set up, count from here
+    model.resetStats();
+    lcd.setCursor(0, 0);
+    lcd.print("top");
+    lcd.setCursor(37, 3);
+    lcd.print("end");
+
+    model.getLine(0, line);
+    TEST_ASSERT_EQUAL(0, strncmp(line, "top ", 4));
+    model.getLine(2, line);
+    TEST_ASSERT_EQUAL(0, strncmp(line, "    ", 4));
+    model.getLine(3, line);
+    TEST_ASSERT_EQUAL_STRING("end", line + 37);
+    TEST_ASSERT_EQUAL(LCD_DISPLAYON, model.getControl(0));
+    TEST_ASSERT_EQUAL(LCD_DISPLAYON, model.getControl(1));
+
+    // The cursor shows on the controller it is on only
+    lcd.cursor();
+    TEST_ASSERT_EQUAL(LCD_DISPLAYON, model.getControl(0));
+    TEST_ASSERT_EQUAL(LCD_DISPLAYON | LCD_CURSORON, model.getControl(1));
+
+    lcd.clear();
+    model.getLine(3, line);
+    TEST_ASSERT_EQUAL_STRING("   ", line + 37);
+    TEST_ASSERT_EQUAL(0, model.getStats().violations);
+}
+
+void test_busy_flag_waits_for_clear(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(20, 4);
+    lcd.print("old");
+    model.resetStats();
+    lcd.clear();
+    lcd.print("A");
+
+    HD44780Stats stats = model.getStats();
+    TEST_ASSERT_EQUAL(0, stats.violations);
+    TEST_ASSERT_EQUAL(1, stats.commands);
+    TEST_ASSERT_EQUAL(1, stats.bytes);
+    TEST_ASSERT_GREATER_THAN(2, stats.reads);
+    TEST_ASSERT_GREATER_OR_EQUAL(HD44780_HOME_US + HD44780_DATA_US, stats.busMicros);
+    TEST_ASSERT_EQUAL_STRING("A                   ", lineOf(model, 0));
+}
+
+void test_write_while_busy_is_lost(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    RawLcd lcd;
+    lcd.begin(20, 4);
+    model.resetStats();
+    lcd.sendRaw(LCD_CLEARDISPLAY, LOW);
+    lcd.sendRaw('X', HIGH);
+
+    TEST_ASSERT_EQUAL(1, model.getStats().violations);
+    TEST_ASSERT_EQUAL(' ', model.getChar(0, 0));
+}
+
+// A full 20x4 frame as the UI draws it: one cursor command and 20 characters per row
+static void drawFrame(LiquidCrystalFast& lcd) {
+    for (uint8_t row = 0; row < 4; row++) {
+        lcd.setCursor(0, row);
+        lcd.print("0123456789abcdefghij");
+    }
+}
+
+void test_frame_statistics(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(20, 4);
+    model.resetStats();
+    lcd.resetBusStats();
+    drawFrame(lcd);
+
+    HD44780Stats stats = model.getStats();
+    TEST_ASSERT_EQUAL(80, stats.bytes);
+    TEST_ASSERT_EQUAL(4, stats.commands);
+    TEST_ASSERT_EQUAL(lcd.busChars(), stats.bytes);
+    TEST_ASSERT_EQUAL(lcd.busCommands(), stats.commands);
+    TEST_ASSERT_EQUAL(0, stats.violations);
+    // The library counts from its first busy check, the model from the first pulse
+    TEST_ASSERT_UINT32_WITHIN(lcd.busMicros() / 20, lcd.busMicros(), stats.busMicros);
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdefghij", lineOf(model, 3));
+}
+
+void test_frame_without_rw(void) {
+    HD44780Model model(20, 4, LCD_RS, 255, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    lcd.begin(20, 4);
+    model.resetStats();
+    lcd.clear();
+    drawFrame(lcd);
+
+    HD44780Stats stats = model.getStats();
+    TEST_ASSERT_EQUAL(0, stats.violations);
+    TEST_ASSERT_EQUAL(0, stats.reads);
+    // Fixed delays instead of the busy flag: slower than the display needs
+    TEST_ASSERT_GREATER_THAN(84 * DELAYPERCHAR, stats.busMicros);
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdefghij", lineOf(model, 0));
+}
+
+void test_async_frame(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    uint16_t queue[LCD_QUEUE_MAX];
+    lcd.begin(20, 4);
+    lcd.setAsync(queue, LCD_QUEUE_MAX);
+    model.resetStats();
+    drawFrame(lcd);
+    // The whole frame is queued, nothing went to the bus yet
+    TEST_ASSERT_EQUAL(84, lcd.queued());
+    TEST_ASSERT_EQUAL(0, model.getStats().bytes + model.getStats().commands);
+    while (lcd.queued()) lcd.poll();
+
+    HD44780Stats stats = model.getStats();
+    TEST_ASSERT_EQUAL(84, stats.bytes + stats.commands);
+    TEST_ASSERT_EQUAL(0, stats.violations);
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdefghij", lineOf(model, 2));
+    lcd.setAsync(nullptr, 0);
+}
+
+void test_async_queue_overflow(void) {
+    HD44780Model model(20, 4, LCD_RS, LCD_RW, LCD_EN, 255, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    LiquidCrystalFast lcd(LCD_RS, LCD_RW, LCD_EN, LCD_D4, LCD_D5, LCD_D6, LCD_D7);
+    uint16_t queue[24];
+    lcd.begin(20, 4);
+    // Rounded down to 16 entries, the rest of the frame waits for the busy flag
+    lcd.setAsync(queue, 24);
+    model.resetStats();
+    drawFrame(lcd);
+    TEST_ASSERT_EQUAL(16, lcd.queued());
+    TEST_ASSERT_EQUAL(84 - 16, model.getStats().bytes + model.getStats().commands);
+    lcd.flush();
+
+    HD44780Stats stats = model.getStats();
+    TEST_ASSERT_EQUAL(84, stats.bytes + stats.commands);
+    TEST_ASSERT_EQUAL(0, stats.violations);
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdefghij", lineOf(model, 3));
+    lcd.setAsync(nullptr, 0);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_text_on_four_rows);
+    RUN_TEST(test_custom_character);
+    RUN_TEST(test_scroll_keeps_cursor_on_screen);
+    RUN_TEST(test_two_controllers);
+    RUN_TEST(test_busy_flag_waits_for_clear);
+    RUN_TEST(test_write_while_busy_is_lost);
+    RUN_TEST(test_frame_statistics);
+    RUN_TEST(test_frame_without_rw);
+    RUN_TEST(test_async_frame);
+    RUN_TEST(test_async_queue_overflow);
+    return UNITY_END();
+}
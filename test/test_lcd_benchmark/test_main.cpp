@@ -0,0 +1,113 @@
+// The BenchmarkSuite example of LiquidCrystalFast on the HD44780 model of NativeHost:
+// runs the sketch unchanged, prints its CSV lines and checks that every mode sends
+// the same bytes without a violation, so the suite can be compared between library
+// versions without a display on the bench. Times are estimates of the virtual Nano.
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <NativeHost.h>
+#include <HD44780Model.h>
+#include "../../lib/LiquidCrystalFast/examples/BenchmarkSuite/BenchmarkSuite.pde"
+
+#define MAX_ROWS 24
+#define MAX_LINE 80
+
+typedef struct {
+    char line[MAX_LINE];        // As printed
+    char mode[12];
+    char test[16];
+    unsigned long ops;
+    unsigned long totalMicros;
+    unsigned long chars;
+    unsigned long commands;
+} BenchmarkRow;
+
+// Serial output of the sketch, split into CSV rows
+class Csv : public Print {
+public:
+    BenchmarkRow rows[MAX_ROWS];
+    int count = 0;
+    bool done = false;
+
+    size_t write(uint8_t value) {
+        if (value == '\r') return 1;
+        if (value != '\n') {
+            if (length < MAX_LINE - 1) line[length++] = value;
+            return 1;
+        }
+        line[length] = 0;
+        length = 0;
+        if (!strcmp(line, "done")) {
+            done = true;
+        } else if (count < MAX_ROWS && strncmp(line, "mode,", 5)) {
+            BenchmarkRow& row = rows[count];
+            strcpy(row.line, line);
+            unsigned long perOp;
+            if (sscanf(line, "%11[^,],%15[^,],%lu,%lu,%lu,%lu,%lu", row.mode, row.test, &row.ops,
+                       &row.totalMicros, &perOp, &row.chars, &row.commands) == 7) count++;
+        }
+        return 1;
+    }
+
+private:
+    char line[MAX_LINE];
+    int length = 0;
+};
+
+static Csv csv;
+static HD44780Model* model;
+
+static const BenchmarkRow* find(const char* mode, const char* test) {
+    for (int i = 0; i < csv.count; i++) {
+        if (!strcmp(csv.rows[i].mode, mode) && !strcmp(csv.rows[i].test, test)) return &csv.rows[i];
+    }
+    return NULL;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_suite_completes(void) {
+    for (int i = 0; i < csv.count; i++) TEST_MESSAGE(csv.rows[i].line);
+    TEST_ASSERT_TRUE(csv.done);
+    // Six tests in each of the rw, async and norw modes
+    TEST_ASSERT_EQUAL(18, csv.count);
+    TEST_ASSERT_EQUAL(0, model->getStats().violations);
+}
+
+void test_modes_send_the_same_bytes(void) {
+    for (int i = 0; i < csv.count; i++) {
+        const BenchmarkRow* rw = find("rw", csv.rows[i].test);
+        TEST_ASSERT_TRUE(rw != NULL);
+        TEST_ASSERT_EQUAL(rw->chars, csv.rows[i].chars);
+        TEST_ASSERT_EQUAL(rw->commands, csv.rows[i].commands);
+    }
+    // A full refresh is every cell and one cursor command per row
+    const BenchmarkRow* full = find("rw", "full_refresh");
+    TEST_ASSERT_EQUAL(repetitions * nRows * nColumns, full->chars);
+    TEST_ASSERT_EQUAL(repetitions * nRows, full->commands);
+}
+
+void test_busy_flag_beats_fixed_delays(void) {
+    static const char* tests[] = {"full_refresh", "field_update", "set_cursor", "create_char", "clear", "home"};
+    for (uint8_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        TEST_ASSERT_LESS_THAN(find("norw", tests[i])->totalMicros, find("rw", tests[i])->totalMicros);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    // The sketch's LCD objects are constructed already; the model sees every
+    // begin() of the suite, which starts from 8-bit mode
+    model = new HD44780Model(nColumns, nRows, PIN_RS, PIN_RW, PIN_EN, 255, 5, 4, 3, 2);
+    hostSerialOutput(&csv);
+    setup();
+    hostSerialOutput(NULL);
+    RUN_TEST(test_suite_completes);
+    RUN_TEST(test_modes_send_the_same_bytes);
+    RUN_TEST(test_busy_flag_beats_fixed_delays);
+    return UNITY_END();
+}
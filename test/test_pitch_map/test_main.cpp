@@ -0,0 +1,104 @@
+// Pitch map and backlash conversions of the Axis: the interpolation before, between
+// and after the map points, negative corrections and the round trip between axis
+// positions and motor steps in both directions.
+#include <unity.h>
+#include <PitchMap.h>
+
+// Geometry of the lift: 200 steps/mm, map from 1 mm to 118 mm
+#define ORIGIN 200
+#define SPACING 1560
+#define BACKLASH 12
+
+static PitchMap pitchMap(ORIGIN, SPACING);
+static AxisCalibration table;
+
+void setUp(void) {
+    // Rising, falling and negative corrections, the steepest segment 90 steps
+    static const int16_t pitch[PITCH_MAP_POINTS] = {
+        -40, -25, 0, 30, 60, 80, 40, -50, -70, -30, 10, 20, 15, 5, -5, -20
+    };
+    for (uint8_t i = 0; i < PITCH_MAP_POINTS; i++) table.pitch[i] = pitch[i];
+    table.backlash = BACKLASH;
+}
+
+void tearDown(void) {
+}
+
+void test_before_first_point(void) {
+    TEST_ASSERT_EQUAL(-40, pitchMap.correction(table, ORIGIN));
+    TEST_ASSERT_EQUAL(-40, pitchMap.correction(table, ORIGIN - 1));
+    TEST_ASSERT_EQUAL(-40, pitchMap.correction(table, 0));
+    // Positions below the home switch, e.g. a negative work offset
+    TEST_ASSERT_EQUAL(-40, pitchMap.correction(table, -5000));
+    TEST_ASSERT_EQUAL(-5000 - 40, pitchMap.toMotor(table, -5000, -1));
+    TEST_ASSERT_EQUAL(-5000 - 40 + BACKLASH, pitchMap.toMotor(table, -5000, 1));
+}
+
+void test_between_points(void) {
+    TEST_ASSERT_EQUAL(-25, pitchMap.correction(table, pitchMap.getPoint(1)));
+    // Halfway and a quarter between the points
+    TEST_ASSERT_EQUAL(15, pitchMap.correction(table, pitchMap.getPoint(2) + SPACING / 2));
+    TEST_ASSERT_EQUAL(70, pitchMap.correction(table, pitchMap.getPoint(4) + SPACING / 2));
+    TEST_ASSERT_EQUAL(-5, pitchMap.correction(table, pitchMap.getPoint(6) + SPACING / 2));
+    TEST_ASSERT_EQUAL(-55, pitchMap.correction(table, pitchMap.getPoint(7) + SPACING / 4));
+    // Negative corrections on both ends of a segment
+    TEST_ASSERT_EQUAL(-60, pitchMap.correction(table, pitchMap.getPoint(7) + SPACING / 2));
+}
+
+void test_after_last_point(void) {
+    long last = pitchMap.getPoint(PITCH_MAP_POINTS - 1);
+    TEST_ASSERT_EQUAL(-20, pitchMap.correction(table, last));
+    TEST_ASSERT_EQUAL(-20, pitchMap.correction(table, last + 1));
+    TEST_ASSERT_EQUAL(-20, pitchMap.correction(table, last + 100000));
+    TEST_ASSERT_EQUAL(last + 500 - 20, pitchMap.toMotor(table, last + 500, -1));
+    TEST_ASSERT_EQUAL(last + 500, pitchMap.toAxis(table, last + 500 - 20, -1));
+}
+
+void test_motor_steps_are_monotonic(void) {
+    for (int8_t direction = -1; direction <= 1; direction += 2) {
+        long previous = pitchMap.toMotor(table, -1000, direction);
+        for (long position = -999; position < pitchMap.getPoint(PITCH_MAP_POINTS - 1) + 1000; position++) {
+            long motor = pitchMap.toMotor(table, position, direction);
+            TEST_ASSERT_GREATER_OR_EQUAL(previous, motor);
+            previous = motor;
+        }
+    }
+}
+
+void test_round_trip_from_axis(void) {
+    for (int8_t direction = -1; direction <= 1; direction += 2) {
+        for (long position = -1000; position < pitchMap.getPoint(PITCH_MAP_POINTS - 1) + 1000; position += 7) {
+            long motor = pitchMap.toMotor(table, position, direction);
+            TEST_ASSERT_INT_WITHIN(1, position, pitchMap.toAxis(table, motor, direction));
+        }
+    }
+}
+
+void test_round_trip_from_motor(void) {
+    for (int8_t direction = -1; direction <= 1; direction += 2) {
+        for (long motor = -1000; motor < pitchMap.getPoint(PITCH_MAP_POINTS - 1) + 1000; motor += 7) {
+            long position = pitchMap.toAxis(table, motor, direction);
+            TEST_ASSERT_INT_WITHIN(1, motor, pitchMap.toMotor(table, position, direction));
+        }
+    }
+}
+
+void test_empty_map(void) {
+    AxisCalibration empty = {};
+    for (long position = -1000; position < 30000; position += 997) {
+        TEST_ASSERT_EQUAL(position, pitchMap.toMotor(empty, position, -1));
+        TEST_ASSERT_EQUAL(position, pitchMap.toAxis(empty, position, 1));
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_before_first_point);
+    RUN_TEST(test_between_points);
+    RUN_TEST(test_after_last_point);
+    RUN_TEST(test_motor_steps_are_monotonic);
+    RUN_TEST(test_round_trip_from_axis);
+    RUN_TEST(test_round_trip_from_motor);
+    RUN_TEST(test_empty_map);
+    return UNITY_END();
+}
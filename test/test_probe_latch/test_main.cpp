@@ -0,0 +1,144 @@
+// Probe touches of the Axis on the virtual Nano: the pin change interrupt halts the
+// approach on the probe edge and latches the position, so the touches, their spread
+// and the fast approach trigger do not depend on how often the main loop runs.
+#include <unity.h>
+#include <stdio.h>
+#include <NativeHost.h>
+#include <Axis.h>
+
+#define STEP_PIN 12
+#define DIR_PIN 11
+#define ENABLE_PIN 10
+#define ENDSTOP_MIN_PIN A2
+#define ENDSTOP_MAX_PIN A3
+#define PROBE_PIN A4
+#define STEPS_PER_MM 200
+#define CYCLES_PER_US 16
+#define PROBE_HEIGHT 20             // Probe closes this far above home in mm
+#define TOUCHES 3
+
+// Carriage on the STEP and DIR pins with the min endstop at 0 and the probe, which
+// closes to ground, at a height
+class Carriage : public HostPinListener {
+public:
+    long steps = 0;
+    long probeSteps = (long)PROBE_HEIGHT * STEPS_PER_MM;
+
+    void pinChanged(uint8_t pin, bool level) {
+        if (pin != STEP_PIN || !level) return;
+        steps += hostPinLevel(DIR_PIN) ? 1 : -1;
+        update();
+    }
+
+    void update() {
+        hostDrive(ENDSTOP_MIN_PIN, steps <= 0);
+        hostDrive(ENDSTOP_MAX_PIN, false);
+        hostDrive(PROBE_PIN, steps < probeSteps);
+    }
+};
+
+struct TestConfig {
+    static const uint8_t stepPin = STEP_PIN, dirPin = DIR_PIN, enablePin = ENABLE_PIN;
+    static const uint8_t endstopMinPin = ENDSTOP_MIN_PIN, endstopMaxPin = ENDSTOP_MAX_PIN, probePin = PROBE_PIN;
+    static constexpr float stepsPerRev = 200, microsteps = 8, spindleLead = 8.0;
+    static constexpr float minPosition = 0.0, maxPosition = 119.0;
+};
+
+// The axis registers with the step timer and the pin change interrupt for good, so
+// all tests share one on the power-on state of the virtual MCU
+static Carriage carriage;
+static StaticAxis<TestConfig> axis;
+
+// Main loop that calls handle() every loopUs, e.g. slowed down by an LCD refresh
+static bool runUntil(bool (*done)(), unsigned long loopUs, unsigned long ms) {
+    uint64_t end = hostCycles() + (uint64_t)ms * 1000 * CYCLES_PER_US;
+    while (hostCycles() < end) {
+        axis.handle();
+        if (done()) return true;
+        hostAdvance((uint64_t)loopUs * CYCLES_PER_US);
+    }
+    return false;
+}
+
+static bool homed() {
+    return axis.getHomingState() == FINISHED;
+}
+
+static bool probed() {
+    return axis.getProbingState() == FINISHED || axis.getProbingState() == ERROR;
+}
+
+// Move to a height above home in mm, whatever the work offset
+static void moveToHeight(float height) {
+    axis.moveToPos(height - axis.getWorkoffset());
+    TEST_ASSERT_TRUE(runUntil([]() { return axis.inPosition(); }, 50, 10000));
+}
+
+static ProbeStats probe(unsigned long loopUs) {
+    // Start from the same height below the probe
+    moveToHeight(PROBE_HEIGHT - 5.0);
+    axis.probing();
+    TEST_ASSERT_TRUE(runUntil(probed, loopUs, 60000));
+    TEST_ASSERT_EQUAL(FINISHED, axis.getProbingState());
+    ProbeStats stats = axis.getProbeStats();
+    char message[100];
+    snprintf(message, sizeof(message), "loop %lu us: mean %.4f mm spread %.4f mm fast trigger %.4f mm",
+             loopUs, stats.mean, stats.spread, stats.fastTrigger);
+    TEST_MESSAGE(message);
+    return stats;
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_touches_at_the_probe_edge(void) {
+    ProbeStats stats = probe(50);
+    TEST_ASSERT_EQUAL(TOUCHES, stats.touches);
+    TEST_ASSERT_EQUAL(0, stats.rejected);
+    TEST_ASSERT_TRUE(stats.approached);
+    // The step that closed the probe, within one step
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / STEPS_PER_MM, PROBE_HEIGHT, stats.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / STEPS_PER_MM, PROBE_HEIGHT, stats.fastTrigger);
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / STEPS_PER_MM, 0.0, stats.spread);
+}
+
+void test_slow_loop_does_not_move_the_touches(void) {
+    ProbeStats fast = probe(50);
+    // A 20 ms loop would add 0.16 mm at the 8 mm/s approach and 0.01 mm at the touches
+    ProbeStats slow = probe(20000);
+    TEST_ASSERT_TRUE(slow.approached);
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / STEPS_PER_MM, fast.mean, slow.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / STEPS_PER_MM, fast.fastTrigger, slow.fastTrigger);
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / STEPS_PER_MM, 0.0, slow.spread);
+}
+
+void test_stopped_probing_is_disarmed(void) {
+    moveToHeight(PROBE_HEIGHT - 5.0);
+    axis.probing();
+    runUntil([]() { return axis.getProbingState() == MOVE_FAST; }, 50, 1000);
+    axis.stopProbing();
+    // The workpiece sits lower now: a move through the probe height is not stopped by it
+    carriage.probeSteps = (long)(PROBE_HEIGHT - 2) * STEPS_PER_MM;
+    carriage.update();
+    moveToHeight(PROBE_HEIGHT + 5.0);
+    TEST_ASSERT_EQUAL((long)(PROBE_HEIGHT + 5) * STEPS_PER_MM, carriage.steps);
+    carriage.probeSteps = (long)PROBE_HEIGHT * STEPS_PER_MM;
+    carriage.update();
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    axis.begin();
+    axis.setProbeTouches(TOUCHES);
+    carriage.steps = 10 * STEPS_PER_MM;
+    carriage.update();
+    axis.homing();
+    if (!runUntil(homed, 50, 20000)) return 1;
+    RUN_TEST(test_touches_at_the_probe_edge);
+    RUN_TEST(test_slow_loop_does_not_move_the_touches);
+    RUN_TEST(test_stopped_probing_is_disarmed);
+    return UNITY_END();
+}
@@ -0,0 +1,148 @@
+// Speed selection of the ProbeTuner on noisy probing results: the spread of the runs,
+// the fastest repeatable speed of both phases with noise that grows with the speed,
+// a spread exactly at the tolerance, the cap at the fastest tested speed and at the
+// move speed of the axis, and a slowest speed that already fails.
+#include <unity.h>
+#include <NativeHost.h>
+#include <ProbeTuner.h>
+
+#define SURFACE 42.0                // Probed position in mm
+#define TOLERANCE 0.02              // Allowed spread of the probed position in mm
+#define FAST_TOLERANCE 0.1          // Allowed spread of the approach trigger in mm
+
+// Lift geometry and pins of main.cpp
+struct TestConfig {
+    static const uint8_t stepPin = 12, dirPin = 11, enablePin = 10;
+    static const uint8_t endstopMinPin = A2, endstopMaxPin = A3, probePin = A4;
+    static constexpr float stepsPerRev = 200, microsteps = 8, spindleLead = 8.0;
+    static constexpr float minPosition = 0.0, maxPosition = 119.0;
+};
+
+static StaticAxis<TestConfig> axis;
+static uint32_t seed;
+
+// Uniform noise in -1..1 from a linear congruential generator, the same on every run
+static float noise() {
+    seed = seed * 1103515245UL + 12345UL;
+    return ((seed >> 8) & 0xFFFF) / 32767.5 - 1.0;
+}
+
+// Runs of one speed: the position lands above and below the surface in turn, by
+// half to all of the amplitude, so the spread is between amplitude and twice it
+static float testSpeed(float amplitude, float* results) {
+    for (uint8_t i = 0; i < PROBETUNE_RUNS; i++) {
+        float offset = amplitude * (0.75 + 0.25 * noise());
+        results[i] = i & 1 ? SURFACE - offset : SURFACE + offset;
+    }
+    return ProbeTuner::spread(results, PROBETUNE_RUNS);
+}
+
+// One phase from the first to the last speed like ProbeTuner::finishSpeed, the
+// amplitude of the noise is gain * speed^3; returns the chosen speed, 0 if none
+static float tunePhase(float first, float last, float tolerance, float gain, uint8_t& tested) {
+    float results[PROBETUNE_RUNS];
+    float best = 0.0;
+    float speed = first;
+    tested = 0;
+    while (speed) {
+        float amplitude = gain * speed * speed * speed;
+        float spread = testSpeed(amplitude, results);
+        TEST_ASSERT_TRUE(spread >= amplitude * 0.999 && spread <= amplitude * 2.001);
+        tested++;
+        speed = ProbeTuner::nextSpeed(speed, spread, tolerance, last, best);
+    }
+    return best;
+}
+
+void setUp(void) {
+    seed = 1;
+}
+
+void tearDown(void) {
+}
+
+void test_spread(void) {
+    static const float results[] = {10.02, 9.99, 10.0, 10.03, 10.01};
+    TEST_ASSERT_EQUAL_FLOAT(0.0, ProbeTuner::spread(results, 0));
+    TEST_ASSERT_EQUAL_FLOAT(0.0, ProbeTuner::spread(results, 1));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.03, ProbeTuner::spread(results, 2));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.04, ProbeTuner::spread(results, 5));
+    // Below the origin of the work offset
+    static const float negative[] = {-0.5, -0.52, -0.49};
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 0.03, ProbeTuner::spread(negative, 3));
+}
+
+void test_touch_speed_on_noisy_runs(void) {
+    // Up to 1.27 mm/s the amplitude is below half the tolerance, at 1.9 mm/s above all of it
+    uint8_t tested;
+    float best = tunePhase(PROBETUNE_SLOW_FIRST, PROBETUNE_SLOW_LAST, TOLERANCE, 0.004, tested);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 1.265625, best);
+    TEST_ASSERT_EQUAL(6, tested);
+}
+
+void test_approach_speed_on_noisy_runs(void) {
+    // Up to 9 mm/s the amplitude is below half the tolerance, at 13.5 mm/s above all of it
+    uint8_t tested;
+    float best = tunePhase(PROBETUNE_FAST_FIRST, PROBETUNE_FAST_LAST, FAST_TOLERANCE, 0.00005, tested);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 9.0, best);
+    TEST_ASSERT_EQUAL(4, tested);
+}
+
+void test_approach_speed_stays_below_the_move_speed(void) {
+    uint8_t tested;
+    // 13.5 mm/s is the fastest tested approach, the next 20.25 mm/s is above the cap
+    float best = tunePhase(PROBETUNE_FAST_FIRST, PROBETUNE_FAST_LAST, FAST_TOLERANCE, 0.0, tested);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 13.5, best);
+    TEST_ASSERT_EQUAL(4, tested);
+    TEST_ASSERT_TRUE(PROBETUNE_FAST_LAST <= axis.getMoveSpeed());
+    // The axis clamps faster probe speeds, e.g. stored by an older firmware
+    axis.setProbeSpeeds(30.0, 0.5);
+    TEST_ASSERT_EQUAL_FLOAT(axis.getMoveSpeed(), axis.getProbeFastSpeed());
+    TEST_ASSERT_EQUAL_FLOAT(0.5, axis.getProbeSlowSpeed());
+}
+
+void test_noise_free_runs_reach_the_last_speed(void) {
+    uint8_t tested;
+    float best = tunePhase(PROBETUNE_SLOW_FIRST, PROBETUNE_SLOW_LAST, TOLERANCE, 0.0, tested);
+    // The next speed 4.27 mm/s is above PROBETUNE_SLOW_LAST and not tested
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 2.84765625, best);
+    TEST_ASSERT_EQUAL(7, tested);
+}
+
+void test_spread_at_tolerance_is_repeatable(void) {
+    float best = 0.0;
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 1.5, ProbeTuner::nextSpeed(1.0, TOLERANCE, TOLERANCE, 4.0, best));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 1.0, best);
+    // Just above it the speed fails and the previous one stays
+    TEST_ASSERT_EQUAL_FLOAT(0.0, ProbeTuner::nextSpeed(1.5, TOLERANCE * 1.001, TOLERANCE, 4.0, best));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 1.0, best);
+}
+
+void test_last_speed_caps_the_phase(void) {
+    float best = 0.0;
+    // A next speed exactly at the last one is still tested, beyond it the phase ends
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 3.0, ProbeTuner::nextSpeed(2.0, 0.0, TOLERANCE, 3.0, best));
+    TEST_ASSERT_EQUAL_FLOAT(0.0, ProbeTuner::nextSpeed(3.0, 0.0, TOLERANCE, 3.0, best));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5, 3.0, best);
+}
+
+void test_first_speed_fails(void) {
+    uint8_t tested;
+    // Already the slowest speed scatters by far more than the tolerance
+    float best = tunePhase(PROBETUNE_SLOW_FIRST, PROBETUNE_SLOW_LAST, TOLERANCE, 1.0, tested);
+    TEST_ASSERT_EQUAL_FLOAT(0.0, best);
+    TEST_ASSERT_EQUAL(1, tested);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_spread);
+    RUN_TEST(test_touch_speed_on_noisy_runs);
+    RUN_TEST(test_approach_speed_on_noisy_runs);
+    RUN_TEST(test_approach_speed_stays_below_the_move_speed);
+    RUN_TEST(test_noise_free_runs_reach_the_last_speed);
+    RUN_TEST(test_spread_at_tolerance_is_repeatable);
+    RUN_TEST(test_last_speed_caps_the_phase);
+    RUN_TEST(test_first_speed_fails);
+    return UNITY_END();
+}
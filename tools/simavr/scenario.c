@@ -0,0 +1,318 @@
+/*
+ * Scenario runner for the simavr firmware image (env:simavr).
+ *
+ * Runs the ELF in simavr and drives the button, encoder, endstop and probe pins
+ * from a scenario file. The firmware writes trace.vcd itself (see src/simtrace.c);
+ * vcd_report.py turns it into step rate, step jitter, loop blocking, homing time
+ * and emergency stop latency.
+ *
+ *   cc -O2 -o scenario tools/simavr/scenario.c -I/usr/include/simavr -lsimavr -lelf
+ *   pio run -e simavr
+ *   ./scenario .pio/build/simavr/firmware.elf tools/simavr/scenarios/homing.txt
+ *   python3 tools/simavr/vcd_report.py trace.vcd
+ *
+ * The carriage is modelled from the STEP and DIR pins, so the endstops and the
+ * probe switch at a height instead of at a fixed time. Scenario lines, times in
+ * ms after reset, '#' starts a comment:
+ *
+ *   <ms> steps_per_mm <steps>           carriage geometry, default 200
+ *   <ms> position <mm>                  move the carriage without steps
+ *   <ms> below <input> <mm> <level>     input reads level at or below mm, the inverse above
+ *   <ms> above <input> <mm> <level>     input reads level at or above mm, the inverse below
+ *   <ms> set <input> <level>            drive an input, ends a below/above rule
+ *   <ms> turn <detents> [<ms>]          turn the encoder, ms per detent (default 40)
+ *   <ms> end                            stop the simulation
+ *
+ * Inputs: BUTTON (A0, low = pressed), SCALE_A (A1), ENDSTOP_MIN (A2, high =
+ * triggered), ENDSTOP_MAX (A3), PROBE (A4, low = touching), SCALE_B (A5),
+ * ENC_A (D2), ENC_B (D3). Pins follow the default wiring in main.cpp.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <avr_ioport.h>
+
+#define MAX_EVENTS 4096
+#define MAX_LINE 160
+#define DETENT_EDGES 4		// Encoder edges per detent (ENC_STEPS in main.cpp)
+#define DEFAULT_DETENT_MS 40
+
+// Carriage pins
+#define STEP_PORT 'B'
+#define STEP_BIT 4		// D12
+#define DIR_PORT 'B'
+#define DIR_BIT 3		// D11
+
+typedef struct {
+	const char *name;
+	char port;
+	uint8_t bit;
+} input_t;
+
+static const input_t inputs[] = {
+	{ "BUTTON", 'C', 0 },
+	{ "SCALE_A", 'C', 1 },
+	{ "ENDSTOP_MIN", 'C', 2 },
+	{ "ENDSTOP_MAX", 'C', 3 },
+	{ "PROBE", 'C', 4 },
+	{ "SCALE_B", 'C', 5 },
+	{ "ENC_A", 'D', 2 },
+	{ "ENC_B", 'D', 3 },
+};
+#define INPUT_COUNT (int)(sizeof(inputs) / sizeof(inputs[0]))
+
+typedef enum { EV_GEOMETRY, EV_POSITION, EV_BELOW, EV_ABOVE, EV_SET, EV_END } event_type_t;
+
+typedef struct {
+	double ms;
+	event_type_t type;
+	int input;
+	double value;
+	uint8_t level;
+	int order;		// Line order, keeps events of the same time in file order
+} event_t;
+
+// Height rule of an input, follows the carriage
+typedef struct {
+	int active;
+	int above;		// Active at or above the height, otherwise at or below
+	long threshold;		// Height in steps
+	uint8_t level;		// Level while the rule matches
+} rule_t;
+
+static event_t events[MAX_EVENTS];
+static int eventCount = 0;
+static rule_t rules[INPUT_COUNT];
+static avr_irq_t *inputIrq[INPUT_COUNT];
+static int inputLevel[INPUT_COUNT];
+static avr_t *avr;
+static double stepsPerMM = 200.0;
+static long position = 0;	// Carriage height in steps
+static int direction = 1;
+static int stepLevel = 0;
+static unsigned long steps = 0;
+
+static int find_input(const char *name)
+{
+	for (int i = 0; i < INPUT_COUNT; i++)
+		if (!strcmp(inputs[i].name, name)) return i;
+	return -1;
+}
+
+static void drive(int input, int level)
+{
+	if (inputLevel[input] == level) return;
+	inputLevel[input] = level;
+	avr_raise_irq(inputIrq[input], level);
+}
+
+static void apply_rule(int input)
+{
+	rule_t *rule = &rules[input];
+	if (!rule->active) return;
+	int match = rule->above ? position >= rule->threshold : position <= rule->threshold;
+	drive(input, match ? rule->level : !rule->level);
+}
+
+static void apply_rules(void)
+{
+	for (int i = 0; i < INPUT_COUNT; i++) apply_rule(i);
+}
+
+static void step_changed(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	(void)param;
+	// The carriage moves on the rising edge, the sensors follow at once
+	if (value && !stepLevel) {
+		position += direction;
+		steps++;
+		apply_rules();
+	}
+	stepLevel = value != 0;
+}
+
+static void dir_changed(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+	(void)irq;
+	(void)param;
+	direction = value ? 1 : -1;
+}
+
+static void add_event(double ms, event_type_t type, int input, double value, uint8_t level)
+{
+	if (eventCount == MAX_EVENTS) {
+		fprintf(stderr, "scenario: more than %d events\n", MAX_EVENTS);
+		exit(2);
+	}
+	event_t *event = &events[eventCount];
+	event->ms = ms;
+	event->type = type;
+	event->input = input;
+	event->value = value;
+	event->level = level;
+	event->order = eventCount;
+	eventCount++;
+}
+
+static void add_turn(double ms, int detents, double detentMs)
+{
+	// B leads A for positive turns (the Encoder library counts up), one quadrature cycle per detent
+	static const uint8_t sequence[DETENT_EDGES][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } };
+	int a = find_input("ENC_A"), b = find_input("ENC_B");
+	int count = detents < 0 ? -detents : detents;
+	double edgeMs = detentMs / DETENT_EDGES;
+	for (int i = 0; i < count * DETENT_EDGES; i++) {
+		int phase = detents > 0 ? i % DETENT_EDGES : DETENT_EDGES - 1 - (i + 1) % DETENT_EDGES;
+		add_event(ms + i * edgeMs, EV_SET, a, 0, sequence[phase][0]);
+		add_event(ms + i * edgeMs, EV_SET, b, 0, sequence[phase][1]);
+	}
+}
+
+static int parse_error(const char *file, int line, const char *text)
+{
+	fprintf(stderr, "%s:%d: %s\n", file, line, text);
+	return -1;
+}
+
+static int load_scenario(const char *file)
+{
+	FILE *in = fopen(file, "r");
+	if (!in) {
+		perror(file);
+		return -1;
+	}
+	char text[MAX_LINE];
+	int line = 0;
+	while (fgets(text, sizeof(text), in)) {
+		line++;
+		char *comment = strchr(text, '#');
+		if (comment) *comment = 0;
+		char command[32], name[32];
+		double ms, value;
+		int level, count;
+		int fields = sscanf(text, "%lf %31s", &ms, command);
+		if (fields <= 0) continue;
+		if (fields != 2) return parse_error(file, line, "expected <ms> <command>");
+
+		if (!strcmp(command, "steps_per_mm")) {
+			if (sscanf(text, "%*f %*s %lf", &value) != 1 || value <= 0)
+				return parse_error(file, line, "steps_per_mm needs a positive value");
+			add_event(ms, EV_GEOMETRY, -1, value, 0);
+		} else if (!strcmp(command, "position")) {
+			if (sscanf(text, "%*f %*s %lf", &value) != 1)
+				return parse_error(file, line, "position needs a height in mm");
+			add_event(ms, EV_POSITION, -1, value, 0);
+		} else if (!strcmp(command, "below") || !strcmp(command, "above")) {
+			if (sscanf(text, "%*f %*s %31s %lf %d", name, &value, &level) != 3 || find_input(name) < 0)
+				return parse_error(file, line, "expected below|above <input> <mm> <level>");
+			add_event(ms, command[0] == 'a' ? EV_ABOVE : EV_BELOW, find_input(name), value, level != 0);
+		} else if (!strcmp(command, "set")) {
+			if (sscanf(text, "%*f %*s %31s %d", name, &level) != 2 || find_input(name) < 0)
+				return parse_error(file, line, "expected set <input> <level>");
+			add_event(ms, EV_SET, find_input(name), 0, level != 0);
+		} else if (!strcmp(command, "turn")) {
+			double detentMs = DEFAULT_DETENT_MS;
+			fields = sscanf(text, "%*f %*s %d %lf", &count, &detentMs);
+			if (fields < 1 || detentMs <= 0) return parse_error(file, line, "expected turn <detents> [<ms>]");
+			add_turn(ms, count, detentMs);
+		} else if (!strcmp(command, "end")) {
+			add_event(ms, EV_END, -1, 0, 0);
+		} else {
+			return parse_error(file, line, "unknown command");
+		}
+	}
+	fclose(in);
+	return 0;
+}
+
+static int compare_events(const void *a, const void *b)
+{
+	const event_t *ea = a, *eb = b;
+	if (ea->ms != eb->ms) return ea->ms < eb->ms ? -1 : 1;
+	return ea->order - eb->order;
+}
+
+// Returns 1 when the scenario ends
+static int apply_event(const event_t *event)
+{
+	rule_t *rule;
+	switch (event->type) {
+	case EV_GEOMETRY:
+		stepsPerMM = event->value;
+		break;
+	case EV_POSITION:
+		position = (long)(event->value * stepsPerMM);
+		apply_rules();
+		break;
+	case EV_BELOW:
+	case EV_ABOVE:
+		rule = &rules[event->input];
+		rule->active = 1;
+		rule->above = event->type == EV_ABOVE;
+		rule->threshold = (long)(event->value * stepsPerMM);
+		rule->level = event->level;
+		apply_rule(event->input);
+		break;
+	case EV_SET:
+		rules[event->input].active = 0;
+		drive(event->input, event->level);
+		break;
+	case EV_END:
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s firmware.elf scenario.txt\n", argv[0]);
+		return 2;
+	}
+	if (load_scenario(argv[2])) return 2;
+	qsort(events, eventCount, sizeof(event_t), compare_events);
+
+	elf_firmware_t firmware;
+	memset(&firmware, 0, sizeof(firmware));
+	if (elf_read_firmware(argv[1], &firmware)) {
+		fprintf(stderr, "%s: cannot read firmware\n", argv[1]);
+		return 2;
+	}
+	if (!firmware.mmcu[0]) strcpy(firmware.mmcu, "atmega328p");
+	if (!firmware.frequency) firmware.frequency = 16000000;
+	avr = avr_make_mcu_by_name(firmware.mmcu);
+	if (!avr) {
+		fprintf(stderr, "%s: unknown MCU\n", firmware.mmcu);
+		return 2;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &firmware);	// Also starts trace.vcd from the MCU section
+
+	for (int i = 0; i < INPUT_COUNT; i++) {
+		inputIrq[i] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(inputs[i].port), inputs[i].bit);
+		inputLevel[i] = -1;
+	}
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(STEP_PORT), STEP_BIT), step_changed, NULL);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(DIR_PORT), DIR_BIT), dir_changed, NULL);
+
+	// Run to each event, a scenario without "end" stops at its last event
+	int next = 0, ended = 0, state = cpu_Running;
+	while (!ended && next < eventCount && state != cpu_Done && state != cpu_Crashed) {
+		avr_cycle_count_t due = (avr_cycle_count_t)(events[next].ms * avr->frequency / 1000.0);
+		while (avr->cycle < due && state != cpu_Done && state != cpu_Crashed)
+			state = avr_run(avr);
+		while (next < eventCount && (avr_cycle_count_t)(events[next].ms * avr->frequency / 1000.0) <= avr->cycle)
+			ended |= apply_event(&events[next++]);
+	}
+
+	printf("cycles %llu\n", (unsigned long long)avr->cycle);
+	printf("ms %.3f\n", avr->cycle * 1000.0 / avr->frequency);
+	printf("steps %lu\n", steps);
+	printf("position_mm %.4f\n", position / stepsPerMM);
+	if (state == cpu_Crashed) printf("crashed\n");
+	avr_terminate(avr);	// Flushes trace.vcd
+	return state == cpu_Crashed ? 1 : 0;
+}
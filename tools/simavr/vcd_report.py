@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""Timing report from the trace.vcd of the simavr firmware image.
+
+Reads the signals written by src/simtrace.c and prints one "name value" line per
+number, times in us unless the name says otherwise:
+
+  steps, step_events         STEP pulses and timing events (2 or 4 pulses per event
+                             above the multi-step rates)
+  step_rate_max              highest step rate in steps/s
+  step_jitter_max/_p99       deviation of an event from the middle of its neighbours,
+                             only where the rate is steady, so the ramps do not count
+  loop_mean/_p99/_max        time between two LOOP marker changes = one loop() pass
+  homing_ms, probing_ms      duration of the last homing/probing run from AXIS_STATE,
+                             with homing_runs/homing_errors, probing_runs/probing_errors
+  estop_enable_max           endstop edge to ENABLE high (driver off)
+  estop_last_pulse_max       endstop edge to the end of the last STEP pulse
+  powerfail_save_max         POWER_LOW edge to the end of the last EEPROM write
+  lcd_bytes, lcd_burst_max   LCD transfers (two EN pulses each) and the longest
+                             stretch of bus activity without a 1 ms pause
+
+usage: vcd_report.py trace.vcd [--json] [--max NAME=VALUE]... [--min NAME=VALUE]...
+
+--max and --min turn the report into a check: the exit code is 1 when a number is
+out of its bound or missing, so performance regressions fail an automated run.
+"""
+import json
+import sys
+
+# Axis states in AXIS_STATE: homing << 4 | probing, see HomingState in Axis.h
+FINISHED = 4
+ERROR = 5
+HOMING_IDLE = (0, FINISHED, ERROR)  # NOT_HOMED before the first run
+PROBING_IDLE = (FINISHED, ERROR)
+
+EVENT_GAP_US = 20.0       # Pulses closer than this belong to one timing event
+MOVE_GAP_US = 50000.0     # Longer pauses end a move
+STEADY_RATIO = 0.05       # Neighbouring intervals within 5 % count as a steady rate
+ESTOP_WINDOW_US = 5000.0  # An emergency stop disables the driver within this time
+POWERFAIL_WINDOW_US = 20000.0
+LCD_GAP_US = 1000.0
+
+TIMESCALES = {"s": 1e6, "ms": 1e3, "us": 1.0, "ns": 1e-3, "ps": 1e-6, "fs": 1e-9}
+
+
+def read_vcd(path):
+    """Return {signal name: [(time in us, int value), ...]}."""
+    names = {}
+    changes = {}
+    scale = 1e-3
+    time = 0.0
+    with open(path) as vcd:
+        tokens = vcd.read().split()
+    i = 0
+    while i < len(tokens):
+        token = tokens[i]
+        if token == "$timescale":
+            unit = tokens[i + 1]
+            i += 2
+            if tokens[i] != "$end":
+                unit += tokens[i]
+                i += 1
+            number = unit.rstrip("munpfs") or "1"
+            scale = float(number) * TIMESCALES[unit[len(number):]]
+        elif token == "$var":
+            # $var wire <width> <id> <name> $end
+            names[tokens[i + 3]] = tokens[i + 4]
+            changes.setdefault(tokens[i + 4], [])
+            i += 5
+        elif token.startswith("$"):
+            # Skip other sections, but keep $dumpvars contents
+            if token not in ("$dumpvars", "$end", "$dumpall", "$dumpon", "$dumpoff"):
+                while tokens[i] != "$end":
+                    i += 1
+        elif token.startswith("#"):
+            time = int(token[1:]) * scale
+        elif token[0] in "bB":
+            value = token[1:]
+            ident = tokens[i + 1]
+            i += 1
+            if ident in names:
+                changes[names[ident]].append((time, int(value, 2) if set(value) <= set("01") else 0))
+        elif token[0] in "01xXzZ":
+            ident = token[1:]
+            if ident in names:
+                changes[names[ident]].append((time, 1 if token[0] == "1" else 0))
+        i += 1
+    return changes
+
+
+def edges(changes, rising=True):
+    result = []
+    last = None
+    for time, value in changes:
+        if last is not None and value != last and bool(value) == rising:
+            result.append(time)
+        last = value
+    return result
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def step_report(signals, report):
+    pulses = edges(signals.get("STEP", []))
+    report["steps"] = len(pulses)
+    # Group the pulses of one timing event
+    events = []
+    for time in pulses:
+        if events and time - events[-1][2] < EVENT_GAP_US:
+            events[-1][1] += 1
+            events[-1][2] = time
+        else:
+            events.append([time, 1, time])
+    report["step_events"] = len(events)
+    if len(events) < 2:
+        return
+    rate = 0.0
+    jitter = []
+    for i in range(1, len(events)):
+        interval = events[i][0] - events[i - 1][0]
+        if interval >= MOVE_GAP_US:
+            continue
+        rate = max(rate, events[i - 1][1] * 1e6 / interval)
+        if i + 1 < len(events):
+            following = events[i + 1][0] - events[i][0]
+            if following < MOVE_GAP_US and abs(following - interval) <= STEADY_RATIO * interval:
+                jitter.append(abs(events[i][0] - (events[i - 1][0] + events[i + 1][0]) / 2))
+    report["step_rate_max"] = round(rate, 1)
+    if jitter:
+        report["step_jitter_max"] = round(max(jitter), 3)
+        report["step_jitter_p99"] = round(percentile(jitter, 0.99), 3)
+
+
+def loop_report(signals, report):
+    marks = [time for time, _ in signals.get("LOOP", [])]
+    loops = [b - a for a, b in zip(marks, marks[1:])]
+    if not loops:
+        return
+    report["loops"] = len(loops)
+    report["loop_mean"] = round(sum(loops) / len(loops), 1)
+    report["loop_p99"] = round(percentile(loops, 0.99), 1)
+    report["loop_max"] = round(max(loops), 1)
+
+
+def run_report(changes, shift, idle, name, report):
+    start = None
+    runs = []
+    for time, value in changes:
+        state = (value >> shift) & 0x0F
+        if start is None and state not in idle:
+            start = time
+        elif start is not None and state in (FINISHED, ERROR):
+            runs.append((time - start, state))
+            start = None
+    report[name + "_runs"] = len(runs)
+    report[name + "_errors"] = sum(1 for _, state in runs if state == ERROR)
+    if runs:
+        report[name + "_ms"] = round(runs[-1][0] / 1000.0, 3)
+
+
+def estop_report(signals, report):
+    enable = edges(signals.get("ENABLE", []))
+    step_ends = edges(signals.get("STEP", []), rising=False)
+    enable_latency = []
+    pulse_latency = []
+    for name in ("ENDSTOP_MIN", "ENDSTOP_MAX"):
+        for edge in edges(signals.get(name, [])):
+            off = [time - edge for time in enable if 0 <= time - edge <= ESTOP_WINDOW_US]
+            if not off:
+                continue  # Homing touch, no emergency stop
+            enable_latency.append(off[0])
+            last = [time - edge for time in step_ends if 0 <= time - edge <= ESTOP_WINDOW_US]
+            pulse_latency.append(max(last) if last else 0.0)
+    report["estops"] = len(enable_latency)
+    if enable_latency:
+        report["estop_enable_max"] = round(max(enable_latency), 3)
+        report["estop_last_pulse_max"] = round(max(pulse_latency), 3)
+
+
+def powerfail_report(signals, report):
+    writes = edges(signals.get("EEPROM_BUSY", []), rising=False)
+    saves = []
+    for edge in edges(signals.get("POWER_LOW", [])):
+        done = [time - edge for time in writes if 0 <= time - edge <= POWERFAIL_WINDOW_US]
+        if done:
+            saves.append(max(done))
+    if saves:
+        report["powerfail_save_max"] = round(max(saves), 1)
+
+
+def lcd_report(signals, report):
+    pulses = edges(signals.get("LCD_EN", []), rising=False)
+    report["lcd_bytes"] = len(pulses) // 2
+    longest = 0.0
+    start = None
+    for previous, time in zip([None] + pulses, pulses):
+        if previous is None or time - previous > LCD_GAP_US:
+            start = time
+        longest = max(longest, time - start)
+    report["lcd_burst_max"] = round(longest, 1)
+
+
+def parse_bounds(args, option):
+    bounds = {}
+    for i, arg in enumerate(args):
+        if arg == option and i + 1 < len(args):
+            name, value = args[i + 1].split("=")
+            bounds[name] = float(value)
+    return bounds
+
+
+def main(args):
+    if not args or args[0].startswith("-"):
+        print(__doc__, file=sys.stderr)
+        return 2
+    signals = read_vcd(args[0])
+    report = {}
+    step_report(signals, report)
+    loop_report(signals, report)
+    state = signals.get("AXIS_STATE", [])
+    run_report(state, 4, HOMING_IDLE, "homing", report)
+    run_report(state, 0, PROBING_IDLE, "probing", report)
+    estop_report(signals, report)
+    powerfail_report(signals, report)
+    lcd_report(signals, report)
+
+    if "--json" in args:
+        print(json.dumps(report, indent=2))
+    else:
+        for name, value in report.items():
+            print(name, value)
+
+    failed = False
+    for name, bound in parse_bounds(args, "--max").items():
+        if name not in report or report[name] > bound:
+            print("FAIL %s %s > %s" % (name, report.get(name, "missing"), bound), file=sys.stderr)
+            failed = True
+    for name, bound in parse_bounds(args, "--min").items():
+        if name not in report or report[name] < bound:
+            print("FAIL %s %s < %s" % (name, report.get(name, "missing"), bound), file=sys.stderr)
+            failed = True
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))